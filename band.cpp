@@ -0,0 +1,240 @@
+#include "band.h"
+#include "simd.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/** Builds the adjacency structure of the pattern of @m + @m^T without the
+ *  diagonal, the neighbours of node i are @adj[@adj_ptr[i]..@adj_ptr[i+1]-1].
+ *  The columns of @m are taken as they are stored.
+ */
+void
+build_adjacency( const matrix_t* m, indx_t** adj_ptr, indx_t** adj ) {
+    const size_t n =m->m;
+    std::vector< std::pair<indx_t,indx_t> > edges;
+    edges.reserve( 2 * m->count );
+    for( size_t i =0; i < n; i++ )
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const indx_t k =m->col_ind[j];
+            if( k == i ) continue;
+            edges.push_back( std::make_pair( i, k ) );
+            edges.push_back( std::make_pair( k, i ) );
+        }
+    std::sort( edges.begin(), edges.end() );
+    edges.erase( std::unique( edges.begin(), edges.end() ), edges.end() );
+
+    *adj_ptr =(indx_t*)calloc( n + 1, sizeof(indx_t) );
+    *adj =(indx_t*)malloc( (edges.size() + 1) * sizeof(indx_t) );
+    for( size_t e =0; e < edges.size(); e++ ) {
+        (*adj_ptr)[edges[e].first + 1]++;
+        (*adj)[e] =edges[e].second;
+    }
+    for( size_t i =0; i < n; i++ ) (*adj_ptr)[i+1] += (*adj_ptr)[i];
+}
+
+/** Breadth first search from @root over the unvisited nodes, appending them
+ *  to @order from offset @head. If @by_degree is set, the neighbours of each
+ *  node are visited in order of increasing degree (Cuthill-McKee). Returns
+ *  the number of levels, @last is set to the offset of the last level.
+ *  The visited marks are reset afterwards unless @keep is set.
+ */
+static size_t
+bfs( const indx_t adj_ptr[], const indx_t adj[], indx_t root, char visited[],
+     indx_t order[], size_t head, bool by_degree, bool keep, size_t* tail, size_t* last ) {
+    size_t begin =head, end =head + 1, n_levels =0;
+    order[head] =root;
+    visited[root] =1;
+    while( begin < end ) {
+        *last =begin;
+        n_levels++;
+        const size_t level_end =end;
+        for( size_t k =begin; k < level_end; k++ ) {
+            const indx_t i =order[k];
+            const size_t first =end;
+            for( indx_t j =adj_ptr[i]; j < adj_ptr[i+1]; j++ )
+                if( !visited[adj[j]] ) {
+                    visited[adj[j]] =1;
+                    order[end++] =adj[j];
+                }
+            if( by_degree )
+                std::sort( &order[first], &order[end], [adj_ptr]( indx_t a, indx_t b ) {
+                    return adj_ptr[a+1] - adj_ptr[a] < adj_ptr[b+1] - adj_ptr[b];
+                } );
+        }
+        begin =level_end;
+    }
+    if( !keep )
+        for( size_t k =head; k < end; k++ ) visited[order[k]] =0;
+    *tail =end;
+    return n_levels;
+}
+
+/** Computes the reverse Cuthill-McKee ordering of the pattern of @m + @m^T:
+ *  original row and column @perm[ii] become row and column ii. Each connected
+ *  component is started at a pseudo-peripheral node, found by repeating the
+ *  search from a node of minimum degree in the last level (George and Liu).
+ */
+void
+rcm_order( indx_t perm[], const matrix_t* m ) {
+    const size_t n =m->m;
+    indx_t *adj_ptr, *adj;
+    build_adjacency( m, &adj_ptr, &adj );
+    char* visited =(char*)calloc( n, sizeof(char) );
+    auto degree =[adj_ptr]( indx_t i ) { return adj_ptr[i+1] - adj_ptr[i]; };
+
+    size_t head =0;
+    for( size_t start =0; start < n; start++ ) {
+        if( visited[start] ) continue;
+        // Unvisited node of minimum degree in this component
+        size_t tail, last;
+        bfs( adj_ptr, adj, start, visited, perm, head, false, false, &tail, &last );
+        indx_t root =start;
+        for( size_t k =head; k < tail; k++ )
+            if( degree( perm[k] ) < degree( root ) ) root =perm[k];
+
+        size_t n_levels =bfs( adj_ptr, adj, root, visited, perm, head, false, false, &tail, &last );
+        while( true ) {
+            indx_t candidate =perm[last];
+            for( size_t k =last; k < tail; k++ )
+                if( degree( perm[k] ) < degree( candidate ) ) candidate =perm[k];
+            const size_t levels =bfs( adj_ptr, adj, candidate, visited, perm, head, false, false, &tail, &last );
+            if( levels <= n_levels ) break;
+            n_levels =levels;
+            root =candidate;
+        }
+
+        bfs( adj_ptr, adj, root, visited, perm, head, true, true, &tail, &last );
+        head =tail;
+    }
+    std::reverse( perm, perm + n );
+
+    free( visited );
+    free( adj_ptr );
+    free( adj );
+}
+
+/** Computes the RCM ordering of @m, see rcm_order(), and the bandwidths of
+ *  the permuted matrix. Returns the number of elements of the packed band.
+ */
+size_t
+band_analyse( band_t* b, const matrix_t* m ) {
+    const size_t n =m->m;
+    b->n =n;
+    b->ab =NULL;
+    b->ipiv =NULL;
+    b->perm =(indx_t*)malloc( n * sizeof(indx_t) );
+    rcm_order( b->perm, m );
+
+    indx_t* inv =(indx_t*)malloc( n * sizeof(indx_t) );
+    for( size_t ii =0; ii < n; ii++ ) inv[b->perm[ii]] =ii;
+    b->kl =b->ku =0;
+    for( size_t i =0; i < n; i++ )
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const sindx_t d =(sindx_t)inv[i] - (sindx_t)inv[m->col_ind[j]];
+            if( d > 0 ) b->kl =std::max( b->kl, (size_t)d );
+            else b->ku =std::max( b->ku, (size_t)-d );
+        }
+    free( inv );
+    b->ldab =2 * b->kl + b->ku + 1;
+    return n * b->ldab;
+}
+
+/** Copies P A P^T into the band and computes its LU-factorisation with
+ *  partial pivotting, column by column like LAPACK's gbtf2(). Each step only
+ *  touches the columns up to the last one reached by an interchange so far.
+ *  Returns the number of zero pivots.
+ */
+size_t
+band_factor( band_t* b, const matrix_t* m ) {
+    const size_t n =b->n, kl =b->kl, kv =b->kl + b->ku, ldab =b->ldab;
+    b->ab =(double*)calloc( n * ldab, sizeof(double) );
+    b->ipiv =(indx_t*)malloc( n * sizeof(indx_t) );
+    double* ab =b->ab;
+
+    indx_t* inv =(indx_t*)malloc( n * sizeof(indx_t) );
+    for( size_t ii =0; ii < n; ii++ ) inv[b->perm[ii]] =ii;
+    for( size_t i =0; i < n; i++ )
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const size_t ii =inv[i], jj =inv[m->col_ind[j]];
+            ab[jj * ldab + kv + ii - jj] =m->values[j];
+        }
+    free( inv );
+
+    size_t n_zero =0, ju =0;
+    for( size_t jj =0; jj < n; jj++ ) {
+        // Column jj holds element (ii,jj) at ab[jj*ldab + kv + ii-jj]
+        double* col =&ab[jj * ldab + kv];
+        const size_t km =std::min( kl, n - 1 - jj );
+        const size_t p =SIMD.iamax( col, km + 1 );
+        b->ipiv[jj] =jj + p;
+        if( col[p] == 0.0 ) {
+            n_zero++;
+            continue;
+        }
+
+        // Interchange rows jj and jj+p in the columns that can hold them
+        ju =std::max( ju, std::min( jj + b->ku + p, n - 1 ) );
+        if( p != 0 )
+            for( size_t c =jj; c <= ju; c++ )
+                std::swap( ab[c * ldab + kv + jj - c], ab[c * ldab + kv + jj + p - c] );
+
+        const double pivot =col[0];
+#pragma omp simd
+        for( size_t k =1; k <= km; k++ ) col[k] /= pivot;
+
+        // Rank-1 update of the columns to the right, contiguous in the band
+        for( size_t c =jj + 1; c <= ju; c++ ) {
+            double* dst =&ab[c * ldab + kv + jj - c];
+            const double u =dst[0];
+            if( u == 0.0 ) continue;
+#pragma omp simd
+            for( size_t k =1; k <= km; k++ ) dst[k] -= col[k] * u;
+        }
+    }
+    return n_zero;
+}
+
+/** Solves A x = @rhs with the factors of band_factor(), both @x and @rhs
+ *  are in natural order.
+ */
+void
+band_solve( double x[], const band_t* b, const double rhs[] ) {
+    const size_t n =b->n, kl =b->kl, kv =b->kl + b->ku, ldab =b->ldab;
+    const double* ab =b->ab;
+    double* y =(double*)malloc( n * sizeof(double) );
+    for( size_t ii =0; ii < n; ii++ ) y[ii] =rhs[b->perm[ii]];
+
+    // L y = P b, applying the interchanges as they were made
+    for( size_t jj =0; jj < n; jj++ ) {
+        if( b->ipiv[jj] != jj ) std::swap( y[jj], y[b->ipiv[jj]] );
+        const double* col =&ab[jj * ldab + kv];
+        const size_t km =std::min( kl, n - 1 - jj );
+        const double t =y[jj];
+#pragma omp simd
+        for( size_t k =1; k <= km; k++ ) y[jj + k] -= col[k] * t;
+    }
+
+    // U x = y, column by column with kl+ku superdiagonals
+    for( ssize_t jj =(ssize_t)n - 1; jj >= 0; jj-- ) {
+        const double* col =&ab[jj * ldab + kv];
+        y[jj] /= col[0];
+        const double t =y[jj];
+        const size_t ku_j =std::min( (size_t)jj, kv );
+#pragma omp simd
+        for( size_t k =1; k <= ku_j; k++ ) y[jj - k] -= col[-(ssize_t)k] * t;
+    }
+
+    for( size_t ii =0; ii < n; ii++ ) x[b->perm[ii]] =y[ii];
+    free( y );
+}
+
+void
+band_free( band_t* b ) {
+    free( b->ab );
+    free( b->ipiv );
+    free( b->perm );
+    memset( b, 0, sizeof( band_t ) );
+}
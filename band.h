@@ -0,0 +1,31 @@
+#ifndef BAND_H
+#define BAND_H
+
+#include "lup.h"
+
+#define BAND_DEFAULT_FACTOR 16.0 // The band is factored if it holds at most factor*nnz elements
+
+/* Reverse Cuthill-McKee ordering of A+A^T and the LU-factorisation of the
+ * band of P A P^T with partial pivotting. The band is stored packed like
+ * LAPACK's gbtrf() does: element (ii,jj) of P A P^T is kept at row
+ * kv+ii-jj of column jj, with kv = kl+ku. The kl superdiagonals above the
+ * original ones are zero initially and receive the fill of the row
+ * interchanges.
+ */
+typedef struct {
+    size_t  n;
+    size_t  kl, ku;             // Sub- and superdiagonals of P A P^T
+    size_t  ldab;               // 2*kl + ku + 1
+    double* ab;                 // Column jj at ab + jj*ldab
+    indx_t* ipiv;               // Row interchanged with row ii in step ii
+    indx_t* perm;               // Position -> original row and column
+} band_t;
+
+void build_adjacency( const matrix_t* m, indx_t** adj_ptr, indx_t** adj );
+void rcm_order( indx_t perm[], const matrix_t* m );
+size_t band_analyse( band_t* b, const matrix_t* m );
+size_t band_factor( band_t* b, const matrix_t* m );
+void band_solve( double x[], const band_t* b, const double rhs[] );
+void band_free( band_t* b );
+
+#endif
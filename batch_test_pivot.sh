@@ -0,0 +1,10 @@
+#!/bin/bash
+#
+# Static pivotting on matrices with pivots that have to be perturbed: the
+# solutions of test_perturb.mtx are recovered by iterative refinement, c-21.mtx
+# is factored again with partial pivotting. Every variance should be 0.000.
+
+./verkade --static-pivot matrices/test_perturb.mtx
+./verkade --tree matrices/test_perturb.mtx
+./verkade --static-pivot matrices/c-21.mtx
+./verkade --tree matrices/c-21.mtx
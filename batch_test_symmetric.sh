@@ -0,0 +1,8 @@
+#!/bin/bash
+#
+# LDL^T with Bunch-Kaufman pivots on indefinite symmetric matrices that need
+# 2x2 pivots: test_indefinite.mtx has zeroes on the diagonal, c-21.mtx takes
+# 783 of them. Every variance should be 0.000.
+
+./verkade --symmetric matrices/test_indefinite.mtx
+./verkade --symmetric matrices/c-21.mtx
@@ -0,0 +1,56 @@
+#!/bin/bash
+#
+# Retrains the rule table of --plan: every candidate plan is run on every
+# matrix, and the fastest plan that solves all reference vectors becomes the
+# rule of that matrix. The table is written to stdout, it can be passed to
+# --plan-table or pasted into DEFAULT_TABLE in plan.cpp.
+#
+# Usage: ./batch_train_plan.sh [matrix.mtx ...] > plan.tab
+# TIMEOUT sets the seconds a single run may take (120), THREADS the thread
+# counts to try (0, the default number of threads).
+
+TIMEOUT=${TIMEOUT:-120}
+THREADS=${THREADS:-0}
+
+if [ $# -eq 0 ]; then
+    set -- matrices/mcfe.mtx matrices/c-21.mtx matrices/flowmeter5.mtx matrices/epb1.mtx \
+           matrices/meg4.mtx matrices/cell1.mtx matrices/nopoly.mtx matrices/mhd4800b.mtx \
+           matrices/ex10.mtx matrices/aft01.mtx
+fi
+
+CANDIDATES="ordering=natural,engine=lup,pivoting=partial
+ordering=natural,engine=lookahead,pivoting=partial
+ordering=natural,engine=lup,pivoting=static
+ordering=rcm,engine=band,pivoting=partial
+ordering=rcm,engine=lup,pivoting=partial
+ordering=nd,engine=lup,pivoting=partial"
+
+echo "# name n nnz symmetry bandwidth row_max row_cv zero_diag fill fill_rcm plan"
+for matrix in "$@"; do
+    name=$(basename "$matrix" .mtx)
+    best=""
+    best_time=""
+    stats=""
+    for plan in $(for p in $CANDIDATES; do for t in $THREADS; do echo "$p,threads=$t"; done; done); do
+        out=$(timeout "$TIMEOUT" ./verkade --plan="$plan" "$matrix" 2>&1 | tr '\b' '\n')
+        time=$(echo "$out" | sed -n 's/.*elapsed time: \([0-9.]*\) s$/\1/p')
+        if [ -z "$time" ]; then
+            echo "(i) $name $plan: failed or timed out" >&2
+            continue
+        fi
+        # Every reference vector has to be solved
+        if echo "$out" | grep -a "Variance" | grep -aqv ": 0.000$"; then
+            echo "(i) $name $plan: inaccurate" >&2
+            continue
+        fi
+        echo "(i) $name $plan: $time s" >&2
+        stats=$(echo "$out" | sed -n 's/^(i) Structure ([^)]*): //p')
+        if [ -z "$best" ] || awk "BEGIN { exit !($time < $best_time) }"; then
+            best=$plan
+            best_time=$time
+        fi
+    done
+    if [ -n "$best" ]; then
+        echo "$name $stats $best"
+    fi
+done
@@ -0,0 +1,294 @@
+#include "btf.h"
+#include <algorithm>
+#include <utility>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/** Finds an augmenting path starting at row @k using depth first search, 
+ *  see Duff's algorithm MC21. On success the matching in @jmatch (row ->
+ *  column) and @imatch (column -> row) is extended by one.
+ *  @cheap, @visited and the three stacks are workspace of length n.
+ */
+static void
+augment( const matrix_t* m, indx_t k, sindx_t jmatch[], sindx_t imatch[],
+         indx_t cheap[], indx_t visited[], indx_t rstack[], indx_t cstack[], indx_t pstack[] ) {
+    bool found =false;
+    sindx_t head =0;
+    rstack[0] =k;
+    while( head >= 0 ) {
+        const indx_t i =rstack[head];
+        const indx_t end =m->row_ptr_end[i] + 1;
+        if( visited[i] != k+1 ) {
+            // First visit of row i, try a cheap assignment to a free column
+            visited[i] =k+1;
+            indx_t p;
+            for( p =cheap[i]; p < end && !found; p++ ) {
+                found =imatch[m->col_ind[p]] == -1;
+                cstack[head] =m->col_ind[p];
+            }
+            cheap[i] =p;
+            if( found ) break;
+            pstack[head] =m->row_ptr_begin[i];
+        }
+        // Continue the search at the row matched to the next column
+        indx_t p;
+        for( p =pstack[head]; p < end; p++ ) {
+            const indx_t j =m->col_ind[p];
+            const sindx_t r =imatch[j];
+            if( visited[r] == k+1 ) continue;
+            pstack[head] =p+1;
+            cstack[head] =j;
+            rstack[++head] =r;
+            break;
+        }
+        if( p == end ) head--;
+    }
+    if( found )
+        for( sindx_t p =head; p >= 0; p-- ) {
+            jmatch[rstack[p]] =cstack[p];
+            imatch[cstack[p]] =rstack[p];
+        }
+}
+
+/** Finds the strongly connected components of the graph in which row i has 
+ *  an edge to row @imatch[j] for every element (i,j), using Tarjan's algorithm.
+ *  Components are stored consecutively in @comp, delimited by @comp_ptr, in
+ *  reverse topological order. Returns the number of components.
+ */
+static size_t
+tarjan( const matrix_t* m, const sindx_t imatch[], indx_t comp[], indx_t comp_ptr[] ) {
+    const size_t n =m->m;
+    sindx_t* index =(sindx_t*)malloc( n * sizeof(sindx_t) );
+    indx_t* low    =(indx_t*)malloc( n * sizeof(indx_t) );
+    indx_t* cstack =(indx_t*)malloc( n * sizeof(indx_t) );  // Call stack
+    indx_t* pstack =(indx_t*)malloc( n * sizeof(indx_t) );  // Next element per call
+    indx_t* stack  =(indx_t*)malloc( n * sizeof(indx_t) );  // Tarjan's stack
+    bool* on_stack =(bool*)calloc( n, sizeof(bool) );
+    size_t counter =0, top =0, n_comp =0, n_done =0;
+
+    for( size_t i =0; i < n; i++ ) index[i] =-1;
+    comp_ptr[0] =0;
+
+    for( size_t root =0; root < n; root++ ) {
+        if( index[root] != -1 ) continue;
+        sindx_t head =0;
+        cstack[0] =root;
+        pstack[0] =m->row_ptr_begin[root];
+        index[root] =low[root] =counter++;
+        stack[top++] =root;
+        on_stack[root] =true;
+
+        while( head >= 0 ) {
+            const indx_t v =cstack[head];
+            const indx_t end =m->row_ptr_end[v] + 1;
+            bool descended =false;
+            for( indx_t p =pstack[head]; p < end; p++ ) {
+                const indx_t w =imatch[m->col_ind[p]];
+                if( index[w] == -1 ) {
+                    pstack[head] =p+1;
+                    index[w] =low[w] =counter++;
+                    stack[top++] =w;
+                    on_stack[w] =true;
+                    cstack[++head] =w;
+                    pstack[head] =m->row_ptr_begin[w];
+                    descended =true;
+                    break;
+                }
+                if( on_stack[w] ) low[v] =std::min( low[v], (indx_t)index[w] );
+            }
+            if( descended ) continue;
+
+            if( low[v] == (indx_t)index[v] ) {
+                // v is the root of a component
+                indx_t w;
+                do {
+                    w =stack[--top];
+                    on_stack[w] =false;
+                    comp[n_done++] =w;
+                } while( w != v );
+                comp_ptr[++n_comp] =n_done;
+            }
+            if( --head >= 0 ) {
+                const indx_t u =cstack[head];
+                low[u] =std::min( low[u], low[v] );
+            }
+        }
+    }
+
+    free( index ); free( low ); free( cstack ); free( pstack ); free( stack ); free( on_stack );
+    return n_comp;
+}
+
+/** Computes the block triangular form of @m using a maximum transversal 
+ *  followed by the strongly connected components of the matched graph.
+ *  Returns 0 on success and -1 if @m is structurally singular.
+ */
+int
+btf_analyse( btf_t* b, const matrix_t* m ) {
+    const size_t n =m->m;
+    memset( b, 0, sizeof( btf_t ) );
+    b->n =n;
+
+    sindx_t* jmatch =(sindx_t*)malloc( n * sizeof(sindx_t) );
+    sindx_t* imatch =(sindx_t*)malloc( n * sizeof(sindx_t) );
+    indx_t* work    =(indx_t*)malloc( 5 * n * sizeof(indx_t) );
+    indx_t* cheap =work, *visited =work+n;
+    for( size_t i =0; i < n; i++ ) {
+        jmatch[i] =imatch[i] =-1;
+        cheap[i] =m->row_ptr_begin[i];
+        visited[i] =0;
+    }
+
+    for( size_t k =0; k < n; k++ )
+        augment( m, k, jmatch, imatch, cheap, visited, work+2*n, work+3*n, work+4*n );
+    for( size_t i =0; i < n; i++ )
+        if( jmatch[i] != -1 ) b->rank++;
+
+    if( b->rank < n ) {
+        fprintf( stderr, "(e) btf_analyse(): matrix is structurally singular (rank %ld of %ld).\n", b->rank, n );
+        free( jmatch ); free( imatch ); free( work );
+        return -1;
+    }
+
+    b->row_perm  =(indx_t*)malloc( n * sizeof(indx_t) );
+    b->col_perm  =(indx_t*)malloc( n * sizeof(indx_t) );
+    b->block_ptr =(indx_t*)malloc( (n+1) * sizeof(indx_t) );
+    indx_t* comp =work; // The workspace is no longer needed
+    b->n_blocks =tarjan( m, imatch, comp, b->block_ptr );
+
+    // Tarjan finds the components in reverse topological order, while
+    // the rows of a block may only depend on the columns of later blocks
+    size_t pos =0;
+    for( size_t c =b->n_blocks; c-- > 0; ) {
+        const indx_t begin =b->block_ptr[c], end =b->block_ptr[c+1];
+        for( indx_t p =begin; p < end; p++, pos++ ) {
+            b->row_perm[pos] =comp[p];
+            b->col_perm[pos] =jmatch[comp[p]];
+        }
+    }
+    pos =0;
+    for( size_t c =0; c < b->n_blocks; c++ ) {
+        const indx_t size =b->block_ptr[b->n_blocks-c] - b->block_ptr[b->n_blocks-c-1];
+        work[c] =pos;
+        pos += size;
+    }
+    memcpy( b->block_ptr, work, b->n_blocks * sizeof(indx_t) );
+    b->block_ptr[b->n_blocks] =n;
+
+    free( jmatch ); free( imatch ); free( work );
+    return 0;
+}
+
+/** Permutes @m into block triangular form and moves the off-diagonal blocks
+ *  into @b, leaving only the diagonal blocks in @m. The rows of @m are stored
+ *  contiguously afterwards, as expected by lup_blocks().
+ */
+int
+btf_apply( btf_t* b, matrix_t* m ) {
+    const size_t n =m->m;
+    indx_t* qinv  =(indx_t*)malloc( n * sizeof(indx_t) );
+    indx_t* block =(indx_t*)malloc( n * sizeof(indx_t) ); // Block of each original row
+    std::pair<indx_t,double>* row =(std::pair<indx_t,double>*)malloc( n * sizeof(std::pair<indx_t,double>) );
+
+    for( size_t pos =0; pos < n; pos++ ) qinv[b->col_perm[pos]] =pos;
+    for( size_t blk =0; blk < b->n_blocks; blk++ )
+        for( indx_t pos =b->block_ptr[blk]; pos < b->block_ptr[blk+1]; pos++ )
+            block[b->row_perm[pos]] =blk;
+
+    // Count the elements in the off-diagonal blocks
+    b->off_ptr =(indx_t*)malloc( (n+1) * sizeof(indx_t) );
+    b->off_ptr[0] =0;
+    for( size_t i =0; i < n; i++ ) {
+        const indx_t end =b->block_ptr[block[i]+1];
+        size_t count =0;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( qinv[m->col_ind[j]] >= end ) count++;
+        b->off_ptr[i+1] =b->off_ptr[i] + count;
+    }
+    b->off_col =(indx_t*)malloc( b->off_ptr[n] * sizeof(indx_t) );
+    b->off_val =(double*)malloc( b->off_ptr[n] * sizeof(double) );
+
+    // Relabel the columns, then split each row into its diagonal block part 
+    // (kept in m, compacted in place) and its off-diagonal part
+    indx_t k =0;
+    for( size_t i =0; i < n; i++ ) {
+        const indx_t end =b->block_ptr[block[i]+1];
+        size_t len =0;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            row[len++] =std::make_pair( qinv[m->col_ind[j]], m->values[j] );
+        std::sort( row, row + len );
+
+        m->row_ptr_begin[i] =k;
+        indx_t o =b->off_ptr[i];
+        for( size_t j =0; j < len; j++ ) {
+            assert( row[j].first >= b->block_ptr[block[i]] );
+            if( row[j].first >= end ) {
+                b->off_col[o] =row[j].first;
+                b->off_val[o++] =row[j].second;
+            } else {
+                m->col_ind[k] =row[j].first;
+                m->values[k++] =row[j].second;
+            }
+        }
+        m->row_ptr_end[i] =k - 1;
+    }
+    m->count =k;
+    memcpy( m->row_order, b->row_perm, n * sizeof(indx_t) );
+
+    free( qinv ); free( block ); free( row );
+    return 0;
+}
+
+/** Solves Ax = @rhs by block back substitution, using the diagonal blocks in 
+ *  @m factored by lup_blocks() and the off-diagonal blocks in @b.
+ *  @x is returned in the original (unpermuted) order.
+ */
+void
+btf_solve( double x[], const btf_t* b, matrix_t* m, const double rhs[] ) {
+    const size_t n =b->n;
+    double* c =(double*)malloc( 2 * n * sizeof(double) ); // By physical row
+    double* y =c + n;                                     // By position
+
+    for( size_t blk =b->n_blocks; blk-- > 0; ) {
+        const sindx_t begin =b->block_ptr[blk], end =b->block_ptr[blk+1];
+
+        // Forward substitution with L, after subtracting the solved blocks
+        for( sindx_t ii =begin; ii < end; ii++ ) {
+            const indx_t i =m->row_order[ii];
+            c[i] =rhs[i];
+            for( indx_t j =b->off_ptr[i]; j < b->off_ptr[i+1]; j++ )
+                c[i] -= b->off_val[j] * y[b->off_col[j]];
+            for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+                const sindx_t jj =m->col_ind[j];
+                if( jj >= ii ) break;
+                c[i] -= m->values[j] * c[m->row_order[jj]];
+            }
+        }
+        // Backward substitution with U
+        for( sindx_t ii =end-1; ii >= begin; ii-- ) {
+            const indx_t i =m->row_order[ii];
+            double d_value =1.0, sum =c[i];
+            for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+                const sindx_t jj =m->col_ind[j];
+                if( jj == ii ) d_value =m->values[j];
+                else if( jj > ii ) sum -= m->values[j] * y[jj];
+            }
+            y[ii] =sum / d_value;
+        }
+    }
+
+    for( size_t pos =0; pos < n; pos++ ) x[b->col_perm[pos]] =y[pos];
+    free( c );
+}
+
+void
+btf_free( btf_t* b ) {
+    free( b->row_perm );
+    free( b->col_perm );
+    free( b->block_ptr );
+    free( b->off_ptr );
+    free( b->off_col );
+    free( b->off_val );
+    memset( b, 0, sizeof( btf_t ) );
+}
@@ -0,0 +1,30 @@
+#ifndef BTF_H
+#define BTF_H
+
+#include "lup.h"
+
+/* Block triangular form of a square matrix.
+ * The rows and columns are permuted such that the matrix becomes block upper
+ * triangular with irreducible diagonal blocks. After btf_apply() the matrix
+ * only holds the diagonal blocks; the off-diagonal blocks are kept here.
+ */
+typedef struct {
+    size_t  n;
+    size_t  n_blocks;
+    size_t  rank;               // Structural rank found by the maximum transversal
+    indx_t* row_perm;           // Position -> original row
+    indx_t* col_perm;           // Position -> original column
+    indx_t* block_ptr;          // First position of each block (n_blocks+1)
+
+    // Off-diagonal blocks in CRS form by original row, columns are positions
+    indx_t* off_ptr;
+    indx_t* off_col;
+    double* off_val;
+} btf_t;
+
+int btf_analyse( btf_t* b, const matrix_t* m );
+int btf_apply( btf_t* b, matrix_t* m );
+void btf_solve( double x[], const btf_t* b, matrix_t* m, const double rhs[] );
+void btf_free( btf_t* b );
+
+#endif
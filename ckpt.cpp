@@ -0,0 +1,277 @@
+#include "ckpt.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <omp.h>
+#include <vector>
+#include <string>
+
+static const char FILE_MAGIC[8] ={ 'V', 'K', 'C', 'K', 'P', 'T', '1', '\0' };
+static const uint64_t RECORD_MAGIC =0x5245434f52440a00; // Starts each record
+static const uint64_t RECORD_END =(uint64_t)-1;         // Takes the place of a row number after the last row
+
+/** Returns the FNV-1a hash of @size bytes at @data, continuing from @h. */
+static uint64_t
+hash_bytes( uint64_t h, const void* data, size_t size ) {
+    const unsigned char* p =(const unsigned char*)data;
+    for( size_t k =0; k < size; k++ ) {
+        h ^= p[k];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+/** Hashes the dimensions and rows of @m, in order of row number. */
+static uint64_t
+hash_matrix( const matrix_t* m ) {
+    uint64_t h =hash_bytes( 0xcbf29ce484222325, &m->m, sizeof( m->m ) );
+    h =hash_bytes( h, &m->n, sizeof( m->n ) );
+    for( size_t i =0; i < m->m; i++ ) {
+        const indx_t begin =m->row_ptr_begin[i];
+        const size_t len =1 + m->row_ptr_end[i] - begin;
+        h =hash_bytes( h, &len, sizeof( len ) );
+        h =hash_bytes( h, &m->col_ind[begin], len * sizeof(indx_t) );
+        h =hash_bytes( h, &m->values[begin], len * sizeof(double) );
+    }
+    return h;
+}
+
+/** Prepares checkpoints of the factorisation of @m, which has not started
+ *  yet, every @interval seconds to the file @path. Nothing is written before
+ *  the first checkpoint, an existing file is left for ckpt_restore().
+ */
+int
+ckpt_open( ckpt_t* c, const char* path, double interval, const matrix_t* m ) {
+    memset( c, 0, sizeof( ckpt_t ) );
+    c->path =strdup( path );
+    c->m =m->m;
+    c->n =m->n;
+    c->input_hash =hash_matrix( m );
+    c->interval =interval;
+    c->last =omp_get_wtime();
+    c->dirty =(char*)calloc( m->m, 1 );
+    return 0;
+}
+
+/** Reads @size bytes from @fh. Returns false if the file ends before. */
+static inline bool
+read_bytes( FILE* fh, void* data, size_t size ) {
+    return fread( data, 1, size, fh ) == size;
+}
+
+/** Restores @m from the last complete record of the checkpoint file of @c,
+ *  if it belongs to the same matrix. The rows are stored contiguously, in
+ *  order of row number, and @step is set to the elimination step to continue
+ *  with. Returns 1 if there is nothing to resume from, -1 on error.
+ */
+int
+ckpt_restore( ckpt_t* c, matrix_t* m, size_t* step ) {
+    FILE* fh =fopen( c->path, "rb" );
+    if( !fh ) {
+        printf( "(i) No checkpoint in '%s', starting from the first step\n", c->path );
+        return 1;
+    }
+    char magic[8];
+    uint64_t header[3];
+    if( !read_bytes( fh, magic, sizeof( magic ) ) || memcmp( magic, FILE_MAGIC, sizeof( magic ) ) != 0
+     || !read_bytes( fh, header, sizeof( header ) )
+     || header[0] != c->m || header[1] != c->n || header[2] != c->input_hash ) {
+        printf( "(i) '%s' is not a checkpoint of this matrix, starting from the first step\n", c->path );
+        fclose( fh );
+        return 1;
+    }
+
+    // Rows are taken over from a record once its trailer has been read
+    std::vector< std::vector<double> > values( c->m );
+    std::vector< std::vector<indx_t> > col_ind( c->m );
+    std::vector<indx_t> order( c->m );
+    size_t n_records =0, last_step =0;
+    while( true ) {
+        uint64_t rec[2];
+        if( !read_bytes( fh, rec, sizeof( rec ) ) || rec[0] != RECORD_MAGIC ) break;
+        std::vector<indx_t> rec_order( c->m );
+        if( !read_bytes( fh, rec_order.data(), c->m * sizeof(indx_t) ) ) break;
+
+        std::vector<uint64_t> rows;
+        std::vector< std::vector<double> > rec_values;
+        std::vector< std::vector<indx_t> > rec_col_ind;
+        bool complete =false;
+        while( true ) {
+            uint64_t row[2];
+            if( !read_bytes( fh, row, sizeof( row ) ) ) break;
+            if( row[0] == RECORD_END ) {
+                complete =row[1] == rows.size();
+                break;
+            }
+            if( row[0] >= c->m || row[1] > c->n ) break;
+            rows.push_back( row[0] );
+            rec_values.push_back( std::vector<double>( row[1] ) );
+            rec_col_ind.push_back( std::vector<indx_t>( row[1] ) );
+            if( !read_bytes( fh, rec_values.back().data(), row[1] * sizeof(double) )
+             || !read_bytes( fh, rec_col_ind.back().data(), row[1] * sizeof(indx_t) ) ) break;
+        }
+        if( !complete ) break;
+        for( size_t r =0; r < rows.size(); r++ ) {
+            values[rows[r]].swap( rec_values[r] );
+            col_ind[rows[r]].swap( rec_col_ind[r] );
+        }
+        order.swap( rec_order );
+        last_step =rec[1];
+        n_records++;
+    }
+    fclose( fh );
+    if( n_records == 0 ) {
+        printf( "(i) '%s' holds no complete checkpoint, starting from the first step\n", c->path );
+        return 1;
+    }
+
+    if( last_step >= c->m ) {
+        fprintf( stderr, "(e) ckpt_restore(): step %ld in '%s' is past the last row.\n", last_step, c->path );
+        return -1;
+    }
+    std::vector<char> seen( c->m, 0 );
+    for( size_t ii =0; ii < c->m; ii++ ) {
+        if( order[ii] >= c->m || seen[order[ii]] ) {
+            fprintf( stderr, "(e) ckpt_restore(): the row order in '%s' is not a permutation.\n", c->path );
+            return -1;
+        }
+        seen[order[ii]] =1;
+    }
+
+    size_t count =0;
+    for( size_t i =0; i < c->m; i++ ) {
+        if( values[i].empty() ) {
+            fprintf( stderr, "(e) ckpt_restore(): row %ld is missing from '%s'.\n", i, c->path );
+            return -1;
+        }
+        count += values[i].size();
+    }
+    if( count > MAX_N_ELEMENTS ) {
+        fprintf( stderr, "(e) ckpt_restore(): the checkpoint holds %ld elements, more than MAX_N_ELEMENTS.\n", count );
+        return -1;
+    }
+    indx_t o =0;
+    for( size_t i =0; i < c->m; i++ ) {
+        const size_t len =values[i].size();
+        memcpy( &m->values[o], values[i].data(), len * sizeof(double) );
+        memcpy( &m->col_ind[o], col_ind[i].data(), len * sizeof(indx_t) );
+        m->row_ptr_begin[i] =o;
+        m->row_ptr_end[i] =o + len - 1;
+        o += len;
+    }
+    memcpy( m->row_order, order.data(), c->m * sizeof(indx_t) );
+    m->count =count;
+    *step =last_step;
+    printf( "(i) Resuming from step %ld of %ld, restored from %ld records of '%s'\n", last_step, c->m, n_records, c->path );
+    return 0;
+}
+
+/** Returns the file a full record is written to before it replaces the
+ *  checkpoint file. */
+static std::string
+temp_path( const ckpt_t* c ) {
+    return std::string( c->path ) + ".tmp";
+}
+
+/** Returns true if the interval of @c has passed since the last checkpoint. */
+bool
+ckpt_due( const ckpt_t* c ) {
+    return omp_get_wtime() - c->last >= c->interval;
+}
+
+/** Writes @size bytes to the file of the record being written. */
+static int
+write_bytes( ckpt_t* c, const void* data, size_t size ) {
+    FILE* fh =c->full ? c->tmp : c->f;
+    if( fwrite( data, 1, size, fh ) != size ) {
+        fprintf( stderr, "(e) ckpt: write to '%s' failed: %s\n", c->path, strerror( errno ) );
+        return -1;
+    }
+    c->record_size += size;
+    return 0;
+}
+
+/** Starts the checkpoint of the factorisation of @m before step @step. The
+ *  record is full if it is the first one, or if the incremental records have
+ *  grown larger than the last full one; a full record goes to a new file that
+ *  replaces the old one on ckpt_commit(). Returns 1 if all rows must be
+ *  appended, 0 if only the dirty rows, -1 on error.
+ */
+int
+ckpt_begin( ckpt_t* c, const matrix_t* m, size_t step ) {
+    c->full =c->f == NULL || c->log_size > c->full_size;
+    c->n_rows =0;
+    c->record_size =0;
+    if( c->full ) {
+        const std::string tmp_path =temp_path( c );
+        c->tmp =fopen( tmp_path.c_str(), "wb" );
+        if( !c->tmp ) {
+            fprintf( stderr, "(e) ckpt_begin(): cannot open '%s': %s\n", tmp_path.c_str(), strerror( errno ) );
+            return -1;
+        }
+        const uint64_t header[3] ={ c->m, c->n, c->input_hash };
+        if( write_bytes( c, FILE_MAGIC, sizeof( FILE_MAGIC ) ) != 0
+         || write_bytes( c, header, sizeof( header ) ) != 0 ) return -1;
+    }
+    const uint64_t rec[2] ={ RECORD_MAGIC, step };
+    if( write_bytes( c, rec, sizeof( rec ) ) != 0
+     || write_bytes( c, m->row_order, m->m * sizeof(indx_t) ) != 0 ) return -1;
+    return c->full ? 1 : 0;
+}
+
+/** Appends the row @row of @len elements to the record being written. */
+int
+ckpt_append_row( ckpt_t* c, indx_t row, const double values[], const indx_t col_ind[], size_t len ) {
+    const uint64_t head[2] ={ row, len };
+    c->n_rows++;
+    if( write_bytes( c, head, sizeof( head ) ) != 0
+     || write_bytes( c, values, len * sizeof(double) ) != 0 ) return -1;
+    return write_bytes( c, col_ind, len * sizeof(indx_t) );
+}
+
+/** Completes the record being written and waits until it is on disk. A full
+ *  record then replaces the checkpoint file. The dirty marks are cleared.
+ */
+int
+ckpt_commit( ckpt_t* c ) {
+    const uint64_t end[2] ={ RECORD_END, c->n_rows };
+    if( write_bytes( c, end, sizeof( end ) ) != 0 ) return -1;
+    FILE* fh =c->full ? c->tmp : c->f;
+    if( fflush( fh ) != 0 || fsync( fileno( fh ) ) != 0 ) {
+        fprintf( stderr, "(e) ckpt_commit(): cannot write '%s': %s\n", c->path, strerror( errno ) );
+        return -1;
+    }
+    if( c->full ) {
+        const std::string tmp_path =temp_path( c );
+        if( rename( tmp_path.c_str(), c->path ) != 0 ) {
+            fprintf( stderr, "(e) ckpt_commit(): cannot replace '%s': %s\n", c->path, strerror( errno ) );
+            return -1;
+        }
+        if( c->f ) fclose( c->f );
+        c->f =c->tmp;
+        c->tmp =NULL;
+        c->full_size =c->record_size;
+        c->log_size =0;
+    } else
+        c->log_size += c->record_size;
+    memset( c->dirty, 0, c->m );
+    c->n_records++;
+    c->last =omp_get_wtime();
+    return 0;
+}
+
+/** Closes the checkpoint file, which is kept for a later ckpt_restore(). */
+void
+ckpt_close( ckpt_t* c ) {
+    if( c->tmp ) {
+        // An incomplete full record is discarded
+        fclose( c->tmp );
+        const std::string tmp_path =temp_path( c );
+        unlink( tmp_path.c_str() );
+    }
+    if( c->f ) fclose( c->f );
+    free( c->path );
+    free( c->dirty );
+    memset( c, 0, sizeof( ckpt_t ) );
+}
@@ -0,0 +1,42 @@
+#ifndef CKPT_H
+#define CKPT_H
+
+#include "lup.h"
+#include <stdint.h>
+
+#define CKPT_DEFAULT_INTERVAL 60.0 // Seconds between two checkpoints of lup()
+
+/* Checkpoint file of a running factorisation. Each checkpoint is a record
+ * holding the next elimination step, the row order and the rows modified
+ * since the previous record. The file starts with a full record, which holds
+ * all rows; incremental records are appended until they outgrow it, then the
+ * file is replaced by a new full record. A record only counts once its
+ * trailer is on disk, so a job stopped while writing one resumes from the
+ * record before.
+ */
+typedef struct ckpt_t {
+    char*    path;
+    FILE*    f;                 // File the records are appended to, NULL before the first
+    FILE*    tmp;               // Replacement of the file while a full record is written
+    size_t   m, n;
+    uint64_t input_hash;        // Identifies the matrix the factorisation started from
+    double   interval;          // Seconds between two checkpoints
+    double   last;              // Time of the last checkpoint
+    char*    dirty;             // Rows modified since the last checkpoint (m)
+    bool     full;              // The record being written holds all rows
+    size_t   n_rows;            // Rows in the record being written
+    size_t   record_size;       // Bytes of the record being written
+    size_t   full_size;         // Bytes of the last full record
+    size_t   log_size;          // Bytes of the incremental records after it
+    size_t   n_records;         // Records written
+} ckpt_t;
+
+int ckpt_open( ckpt_t* c, const char* path, double interval, const matrix_t* m );
+int ckpt_restore( ckpt_t* c, matrix_t* m, size_t* step );
+bool ckpt_due( const ckpt_t* c );
+int ckpt_begin( ckpt_t* c, const matrix_t* m, size_t step );
+int ckpt_append_row( ckpt_t* c, indx_t row, const double values[], const indx_t col_ind[], size_t len );
+int ckpt_commit( ckpt_t* c );
+void ckpt_close( ckpt_t* c );
+
+#endif
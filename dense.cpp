@@ -0,0 +1,125 @@
+#include "dense.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define DENSE_PARALLEL_MIN 256 // Smallest trailing matrix updated in parallel
+
+/** Computes the LU-factorisation with partial pivotting of the dense, 
+ *  row-major @n x @n matrix @a in place. L has a unit diagonal and is stored
+ *  below the diagonal. On return row r of @a is row @perm[r] of the input.
+ *  Returns the number of zero pivots.
+ */
+size_t
+dense_lu( double a[], size_t n, indx_t perm[] ) {
+    size_t n_zero =0;
+    for( size_t r =0; r < n; r++ ) perm[r] =r;
+
+    for( size_t k =0; k < n; k++ ) {
+        // Find the largest element in column k
+        size_t p =k;
+        double abs_max =fabs( a[k*n+k] );
+        for( size_t i =k+1; i < n; i++ )
+            if( fabs( a[i*n+k] ) > abs_max ) {
+                abs_max =fabs( a[i*n+k] );
+                p =i;
+            }
+        if( abs_max == 0.0 ) {
+            n_zero++;
+            continue;
+        }
+        if( p != k ) {
+            for( size_t j =0; j < n; j++ ) {
+                const double tmp =a[k*n+j];
+                a[k*n+j] =a[p*n+j];
+                a[p*n+j] =tmp;
+            }
+            const indx_t tmp =perm[k];
+            perm[k] =perm[p];
+            perm[p] =tmp;
+        }
+
+        const double* pivot_row =&a[k*n];
+#pragma omp parallel for schedule(static) if(n-k > DENSE_PARALLEL_MIN)
+        for( size_t i =k+1; i < n; i++ ) {
+            double* row =&a[i*n];
+            if( row[k] == 0.0 ) continue;
+            const double mult =row[k] / pivot_row[k];
+            row[k] =mult;
+#pragma omp simd
+            for( size_t j =k+1; j < n; j++ )
+                row[j] -= mult * pivot_row[j];
+        }
+    }
+    return n_zero;
+}
+
+/** Solves the system with the factors of dense_lu() in place: on entry @x
+ *  holds the right-hand side, on return the solution.
+ */
+void
+dense_solve( const double a[], size_t n, const indx_t perm[], double x[] ) {
+    double* y =(double*)malloc( n * sizeof(double) );
+    for( size_t r =0; r < n; r++ ) {
+        y[r] =x[perm[r]];
+        for( size_t c =0; c < r; c++ ) y[r] -= a[r*n+c] * y[c];
+    }
+    for( ssize_t r =n-1; r >= 0; r-- ) {
+        for( size_t c =r+1; c < n; c++ ) y[r] -= a[r*n+c] * y[c];
+        y[r] /= a[r*n+r];
+    }
+    memcpy( x, y, n * sizeof(double) );
+    free( y );
+}
+
+/** Finds the rows and columns of @m with more than @factor*sqrt(n) elements.
+ *  Returns the size of the trailing block, i.e. the larger of both numbers.
+ */
+int
+dense_detect( dense_t* d, const matrix_t* m, double factor ) {
+    const size_t n =m->m;
+    const size_t threshold =(size_t)(factor * sqrt( (double)n ));
+    memset( d, 0, sizeof( dense_t ) );
+    d->n =n;
+    d->row_perm =(indx_t*)malloc( n * sizeof(indx_t) );
+    d->col_perm =(indx_t*)malloc( n * sizeof(indx_t) );
+
+    indx_t* col_count =(indx_t*)calloc( m->n, sizeof(indx_t) );
+    for( size_t i =0; i < n; i++ )
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            col_count[m->col_ind[j]]++;
+
+    // Sparse rows and columns first, in their original order, then the dense ones
+    size_t r =0, c =0;
+    for( size_t pass =0; pass < 2; pass++ ) {
+        for( size_t i =0; i < n; i++ ) {
+            const bool dense =1 + m->row_ptr_end[i] - m->row_ptr_begin[i] > threshold;
+            if( dense == (pass == 1) ) d->row_perm[r++] =i;
+            if( dense && pass == 1 ) d->n_rows++;
+        }
+        for( size_t j =0; j < m->n; j++ ) {
+            const bool dense =col_count[j] > threshold;
+            if( dense == (pass == 1) ) d->col_perm[c++] =j;
+            if( dense && pass == 1 ) d->n_cols++;
+        }
+    }
+    free( col_count );
+
+    d->n_trailing =d->n_rows > d->n_cols ? d->n_rows : d->n_cols;
+    return d->n_trailing;
+}
+
+/** Orders the dense rows and columns of @m last.
+ */
+void
+dense_apply( const dense_t* d, matrix_t* m ) {
+    matrix_permute_columns( m, d->col_perm );
+    memcpy( m->row_order, d->row_perm, d->n * sizeof(indx_t) );
+}
+
+void
+dense_free( dense_t* d ) {
+    free( d->row_perm );
+    free( d->col_perm );
+    memset( d, 0, sizeof( dense_t ) );
+}
@@ -0,0 +1,26 @@
+#ifndef DENSE_H
+#define DENSE_H
+
+#include "lup.h"
+
+#define DENSE_DEFAULT_FACTOR 10.0 // Rows/columns with more than factor*sqrt(n) elements are dense
+
+/* Rows and columns that are (nearly) dense, ordered last by dense_apply().
+ */
+typedef struct {
+    size_t  n;
+    size_t  n_rows;             // Number of dense rows
+    size_t  n_cols;             // Number of dense columns
+    size_t  n_trailing;         // Size of the trailing block factored as dense
+    indx_t* row_perm;           // Position -> original row
+    indx_t* col_perm;           // Position -> original column
+} dense_t;
+
+size_t dense_lu( double a[], size_t n, indx_t perm[] );
+void dense_solve( const double a[], size_t n, const indx_t perm[], double x[] );
+
+int dense_detect( dense_t* d, const matrix_t* m, double factor );
+void dense_apply( const dense_t* d, matrix_t* m );
+void dense_free( dense_t* d );
+
+#endif
@@ -0,0 +1,258 @@
+#include "dist.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+
+/* Row of the matrix kept by its owner: the multipliers of the steps so far
+ * and the remaining elements, from the column of the current step on.
+ */
+typedef struct {
+    indx_t              row;
+    std::vector<indx_t> l_col, u_col;
+    std::vector<double> l_val, u_val;
+} dist_row_t;
+
+template<typename T> static int
+send_vec( transport_t* t, int dest, const std::vector<T>& v ) {
+    const size_t n =v.size();
+    if( t->send( t, dest, &n, sizeof(n) ) != 0 ) return -1;
+    return t->send( t, dest, v.data(), n * sizeof(T) );
+}
+
+template<typename T> static int
+recv_vec( transport_t* t, int src, std::vector<T>& v ) {
+    size_t n;
+    if( t->recv( t, src, &n, sizeof(n) ) != 0 ) return -1;
+    v.resize( n );
+    return t->recv( t, src, v.data(), n * sizeof(T) );
+}
+
+template<typename T> static int
+bcast_vec( transport_t* t, int root, std::vector<T>& v ) {
+    size_t n =v.size();
+    if( transport_bcast( t, root, &n, sizeof(n) ) != 0 ) return -1;
+    v.resize( n );
+    return transport_bcast( t, root, v.data(), n * sizeof(T) );
+}
+
+/** Sends the rows of @rows, L and U part together, to rank @dest. */
+static int
+send_rows( transport_t* t, int dest, const std::vector<dist_row_t>& rows ) {
+    std::vector<indx_t> id, len, col;
+    std::vector<double> val;
+    for( const dist_row_t& r : rows ) {
+        id.push_back( r.row );
+        len.push_back( r.l_col.size() );
+        len.push_back( r.u_col.size() );
+        col.insert( col.end(), r.l_col.begin(), r.l_col.end() );
+        col.insert( col.end(), r.u_col.begin(), r.u_col.end() );
+        val.insert( val.end(), r.l_val.begin(), r.l_val.end() );
+        val.insert( val.end(), r.u_val.begin(), r.u_val.end() );
+    }
+    if( send_vec( t, dest, id ) != 0 || send_vec( t, dest, len ) != 0 ) return -1;
+    if( send_vec( t, dest, col ) != 0 || send_vec( t, dest, val ) != 0 ) return -1;
+    return 0;
+}
+
+/** Receives the rows sent by send_rows() from rank @src, appending them to @rows. */
+static int
+recv_rows( transport_t* t, int src, std::vector<dist_row_t>& rows ) {
+    std::vector<indx_t> id, len, col;
+    std::vector<double> val;
+    if( recv_vec( t, src, id ) != 0 || recv_vec( t, src, len ) != 0 ) return -1;
+    if( recv_vec( t, src, col ) != 0 || recv_vec( t, src, val ) != 0 ) return -1;
+    size_t off =0;
+    for( size_t k =0; k < id.size(); k++ ) {
+        dist_row_t r;
+        r.row =id[k];
+        r.l_col.assign( &col[off], &col[off] + len[2*k] );
+        r.l_val.assign( &val[off], &val[off] + len[2*k] );
+        off += len[2*k];
+        r.u_col.assign( &col[off], &col[off] + len[2*k+1] );
+        r.u_val.assign( &val[off], &val[off] + len[2*k+1] );
+        off += len[2*k+1];
+        rows.push_back( r );
+    }
+    return 0;
+}
+
+/** Subtracts @mult times the pivot row @p_col, @p_val (from its pivot on)
+ *  from row @r, whose first remaining element is in the pivot column.
+ */
+static void
+update_row( dist_row_t& r, double mult, const std::vector<indx_t>& p_col, const std::vector<double>& p_val,
+            std::vector<indx_t>& col_tmp, std::vector<double>& val_tmp ) {
+    r.l_col.push_back( r.u_col[0] );
+    r.l_val.push_back( mult );
+
+    col_tmp.clear();
+    val_tmp.clear();
+    size_t i =1, k =1;
+    while( i < p_col.size() || k < r.u_col.size() ) {
+        indx_t jj;
+        double val;
+        if( k >= r.u_col.size() || (i < p_col.size() && p_col[i] < r.u_col[k]) ) {
+            jj =p_col[i];
+            val =0.0 - p_val[i++] * mult;
+        } else if( i >= p_col.size() || r.u_col[k] < p_col[i] ) {
+            jj =r.u_col[k];
+            val =r.u_val[k++];
+        } else {
+            jj =r.u_col[k];
+            val =r.u_val[k++] - p_val[i++] * mult;
+        }
+        if( val != 0.0 ) {
+            col_tmp.push_back( jj );
+            val_tmp.push_back( val );
+        }
+    }
+    r.u_col.swap( col_tmp );
+    r.u_val.swap( val_tmp );
+}
+
+int
+lup_dist( matrix_t* m, transport_t* t ) {
+    const int size =t->size, rank =t->rank;
+    size_t n =m->m;
+    if( transport_bcast( t, 0, &n, sizeof(n) ) != 0 ) return -1;
+
+    // Rank 0 keeps rows rank, rank+size, ... and sends the others away. The
+    // parts are copied and sent one at a time, so that rank 0 holds at most
+    // one part besides its own rows and @m.
+    std::vector<dist_row_t> rows;
+    if( rank == 0 ) {
+        std::vector<dist_row_t> part;
+        for( int p =size-1; p >= 0; p-- ) {
+            for( size_t i =p; i < n; i += size ) {
+                dist_row_t r;
+                r.row =i;
+                part.push_back( r );
+                part.back().u_col.assign( &m->col_ind[m->row_ptr_begin[i]], &m->col_ind[m->row_ptr_end[i]] + 1 );
+                part.back().u_val.assign( &m->values[m->row_ptr_begin[i]], &m->values[m->row_ptr_end[i]] + 1 );
+            }
+            if( p == 0 ) break;
+            if( send_rows( t, p, part ) != 0 ) return -1;
+            std::vector<dist_row_t>().swap( part );
+        }
+        rows.swap( part );
+    } else if( recv_rows( t, 0, rows ) != 0 ) return -1;
+
+    std::vector<size_t> active( rows.size() ); // Rows that have not been pivot row yet
+    for( size_t a =0; a < rows.size(); a++ ) active[a] =a;
+    std::vector<indx_t> perm( n ), p_col, col_tmp;
+    std::vector<double> p_val, val_tmp;
+
+    for( size_t ii =0; ii < n; ii++ ) {
+        if( rank == 0 ) printf( "\b\b\b\b%3d%%", (int)((ii * 100) / n) );
+
+        // Largest element in column ii among the own rows, then among all ranks
+        double abs_max =-1.0;
+        sindx_t best_row =-1;
+        for( size_t a : active ) {
+            const dist_row_t& r =rows[a];
+            if( r.u_col.empty() || r.u_col[0] != ii ) continue;
+            const double x =fabs( r.u_val[0] );
+            if( x > abs_max || (x == abs_max && (sindx_t)r.row < best_row) ) {
+                abs_max =x;
+                best_row =r.row;
+            }
+        }
+        if( transport_allreduce_maxloc( t, &abs_max, &best_row ) != 0 ) return -1;
+        const bool empty =best_row == -1;
+        if( empty ) {
+            // Complete column is empty, take the first remaining row
+            abs_max =active.empty() ? -1.0 : 0.0;
+            for( size_t a : active )
+                if( best_row == -1 || (sindx_t)rows[a].row < best_row ) best_row =rows[a].row;
+            if( transport_allreduce_maxloc( t, &abs_max, &best_row ) != 0 ) return -1;
+        }
+        perm[ii] =best_row;
+        if( !empty && abs_max < DBL_MIN ) {
+            // All ranks see the same maximum, so they all stop here
+            if( rank == 0 )
+                fprintf( stderr, "\n(e) lup_dist(): zero pivot %g in column %ld, the matrix is singular.\n", abs_max, ii );
+            return -1;
+        }
+
+        // The owner retires the pivot row and broadcasts it
+        const int owner =best_row % size;
+        if( owner == rank ) {
+            for( size_t k =0; k < active.size(); k++ )
+                if( rows[active[k]].row == (indx_t)best_row ) {
+                    const dist_row_t& r =rows[active[k]];
+                    p_col =r.u_col;
+                    p_val =r.u_val;
+                    active[k] =active.back();
+                    active.pop_back();
+                    break;
+                }
+        }
+        if( empty ) continue;
+        if( bcast_vec( t, owner, p_col ) != 0 || bcast_vec( t, owner, p_val ) != 0 ) return -1;
+
+        for( size_t a : active ) {
+            dist_row_t& r =rows[a];
+            if( r.u_col.empty() || r.u_col[0] != ii ) continue;
+            update_row( r, r.u_val[0] / p_val[0], p_col, p_val, col_tmp, val_tmp );
+        }
+    }
+
+    // Multipliers can still overflow on pivots just above DBL_MIN, the ranks
+    // agree on that before the factors are collected
+    double overflow =0.0;
+    sindx_t overflow_row =-1;
+    for( const dist_row_t& r : rows )
+        for( double x : r.l_val )
+            if( !std::isfinite( x ) ) {
+                overflow =1.0;
+                overflow_row =r.row;
+            }
+    if( transport_allreduce_maxloc( t, &overflow, &overflow_row ) != 0 ) return -1;
+    if( overflow != 0.0 ) {
+        if( rank == 0 )
+            fprintf( stderr, "\n(e) lup_dist(): row %ld has non-finite multipliers, the pivots are too small.\n", overflow_row );
+        return -1;
+    }
+
+    // Collect the factors on rank 0
+    if( rank != 0 ) return send_rows( t, 0, rows );
+    for( int p =1; p < size; p++ )
+        if( recv_rows( t, p, rows ) != 0 ) return -1;
+
+    std::vector<const dist_row_t*> by_row( n );
+    size_t count =0;
+    for( const dist_row_t& r : rows ) {
+        by_row[r.row] =&r;
+        count += std::max( r.l_col.size() + r.u_col.size(), (size_t)1 );
+    }
+    if( count > MAX_N_ELEMENTS ) {
+        fprintf( stderr, "(e) lup_dist(): the factors (%ld elements) exceed MAX_N_ELEMENTS.\n", count );
+        return -1;
+    }
+    std::vector<indx_t> pos( n );
+    for( size_t ii =0; ii < n; ii++ ) pos[perm[ii]] =ii;
+    indx_t k =0;
+    for( size_t i =0; i < n; i++ ) {
+        const dist_row_t* r =by_row[i];
+        m->row_ptr_begin[i] =k;
+        for( size_t j =0; j < r->l_col.size(); j++ ) {
+            m->col_ind[k] =r->l_col[j];
+            m->values[k++] =r->l_val[j];
+        }
+        for( size_t j =0; j < r->u_col.size(); j++ ) {
+            m->col_ind[k] =r->u_col[j];
+            m->values[k++] =r->u_val[j];
+        }
+        if( k == m->row_ptr_begin[i] ) {
+            // Row cancelled completely, keep its (zero) pivot
+            m->col_ind[k] =pos[i];
+            m->values[k++] =0.0;
+        }
+        m->row_ptr_end[i] =k - 1;
+    }
+    memcpy( m->row_order, perm.data(), n * sizeof(indx_t) );
+    m->count =count;
+    return 0;
+}
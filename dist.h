@@ -0,0 +1,18 @@
+#ifndef DIST_H
+#define DIST_H
+
+#include "lup.h"
+#include "transport.h"
+
+/* LU-factorisation with partial pivotting with the rows distributed over the
+ * processes of @t: row i belongs to rank i % size. Each step reduces the
+ * candidate pivots of all ranks to the largest one and broadcasts the pivot
+ * row, after which every rank updates its own rows. Rank 0 holds the input
+ * in @m, sends the other ranks their rows and collects the factors in @m in
+ * the format of lup(); @m is not used on the other ranks. Besides @m, rank 0
+ * holds a copy of its own rows and of the part being sent. All ranks return
+ * -1 on a zero pivot or on multipliers that are not finite.
+ */
+int lup_dist( matrix_t* m, transport_t* t );
+
+#endif
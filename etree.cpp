@@ -0,0 +1,80 @@
+#include "etree.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+/** Computes the elimination tree of the pattern of @m + @m^T, where element
+ *  (ii,jj) is column jj of the row at position ii. Uses Liu's algorithm with
+ *  path compression, visiting the lower triangle of row ii and the upper 
+ *  triangle of column ii for each position ii.
+ */
+void
+etree_compute( etree_t* t, const matrix_t* m ) {
+    const size_t n =m->m;
+    t->n =n;
+    t->parent =(sindx_t*)malloc( n * sizeof(sindx_t) );
+    sindx_t* ancestor =(sindx_t*)malloc( n * sizeof(sindx_t) );
+
+    // Transposed pattern of the strict upper triangle: for each column jj the
+    // positions ii < jj with an element (ii,jj)
+    indx_t* col_ptr =(indx_t*)calloc( n + 1, sizeof(indx_t) );
+    for( size_t ii =0; ii < n; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( m->col_ind[j] > ii ) col_ptr[m->col_ind[j]+1]++;
+    }
+    for( size_t jj =0; jj < n; jj++ ) col_ptr[jj+1] += col_ptr[jj];
+    indx_t* row_ind =(indx_t*)malloc( (col_ptr[n] + 1) * sizeof(indx_t) );
+    indx_t* next =(indx_t*)malloc( n * sizeof(indx_t) );
+    memcpy( next, col_ptr, n * sizeof(indx_t) );
+    for( size_t ii =0; ii < n; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( m->col_ind[j] > ii ) row_ind[next[m->col_ind[j]]++] =ii;
+    }
+
+    // Attaches the root of the subtree containing @k to @ii
+    auto link =[t, ancestor]( sindx_t k, sindx_t ii ) {
+        while( k != -1 && k < ii ) {
+            const sindx_t a =ancestor[k];
+            ancestor[k] =ii; // Path compression
+            if( a == -1 ) t->parent[k] =ii;
+            k =a;
+        }
+    };
+
+    for( size_t ii =0; ii < n; ii++ ) {
+        t->parent[ii] =-1;
+        ancestor[ii] =-1;
+        const indx_t i =m->row_order[ii];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            if( m->col_ind[j] >= ii ) break;
+            link( m->col_ind[j], ii );
+        }
+        for( indx_t j =col_ptr[ii]; j < col_ptr[ii+1]; j++ )
+            link( row_ind[j], ii );
+    }
+
+    // Parents always follow their children, so the depths are computed backwards
+    indx_t* depth =next;
+    t->n_roots =0;
+    t->height =0;
+    for( ssize_t ii =n-1; ii >= 0; ii-- ) {
+        if( t->parent[ii] == -1 ) {
+            depth[ii] =1;
+            t->n_roots++;
+        } else
+            depth[ii] =depth[t->parent[ii]] + 1;
+        t->height =std::max( t->height, (size_t)depth[ii] );
+    }
+
+    free( ancestor );
+    free( col_ptr );
+    free( row_ind );
+    free( next );
+}
+
+void
+etree_free( etree_t* t ) {
+    free( t->parent );
+}
@@ -0,0 +1,20 @@
+#ifndef ETREE_H
+#define ETREE_H
+
+#include "lup.h"
+
+/* Elimination tree of the symmetrised structure A+A^T in the current order,
+ * i.e. of the row at position ii and column ii. Without row interchanges,
+ * the row at position ii only depends on its descendants in this tree.
+ */
+typedef struct etree_t {
+    size_t   n;
+    sindx_t* parent;            // Parent position of each position, -1 for roots
+    size_t   n_roots;
+    size_t   height;            // Length of the longest path from a leaf to a root
+} etree_t;
+
+void etree_compute( etree_t* t, const matrix_t* m );
+void etree_free( etree_t* t );
+
+#endif
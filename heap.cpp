@@ -3,6 +3,10 @@
 #include <limits.h>
 #include <stdio.h>
 #include <assert.h>
+#include <time.h>
+#include <omp.h>
+#include <algorithm>
+#include <vector>
 
 #define is_free(r) (((r).size & (1<<30)) != 0)
 #define is_nonfree(r) (((r).size & (1<<30)) == 0)
@@ -10,9 +14,21 @@
 #define set_nonfree(r) ((r).size &= ~(1<<30))
 #define size(r) ((r).size & ~(1<<30))
 
+#define HEAP_PARALLEL_MOVE 65536 // Compaction copies at least this size concurrently
+
+static double
+now() {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
 void 
 heap_clear( heap_t* h, size_t totalsize ) {
     memset( h->regions, 0, h->capacity * sizeof( region_desc_t ) );
+    memset( &h->counters, 0, sizeof( heap_counters_t ) );
+    h->free_total =h->largest_free =totalsize;
+    h->compact_budget =0;
     h->count =1;
     h->regions[0].start    =0;
     h->regions[0].size     =totalsize;
@@ -26,17 +42,25 @@ heapsptr_t
 heap_alloc( heap_t* h, size_t size, int userdata ) {
 
     size_t loss  = INT_MAX, i;
-    ssize_t best = -1;
+    ssize_t best = -1, largest = -1;
+    size_t second =0; // Size of the largest free region except the one at @largest
     for( i =0; i < h->count; i++ ) {
         region_desc_t* r =&h->regions[i];
         if( is_nonfree( *r ) ) continue;
+        if( largest == -1 || size( *r ) > size( h->regions[largest] ) ) {
+            if( largest != -1 ) second =size( h->regions[largest] );
+            largest =i;
+        } else if( size( *r ) > second )
+            second =size( *r );
         if( size <= size( *r ) && size( *r ) - size < loss ) {
             loss = size( *r ) - size;
             best = i;
         }
     }
+    h->largest_free =largest == -1 ? 0 : size( h->regions[largest] );
     if( best == -1 ) {
         // Insufficient space
+        h->counters.n_failed++;
         return -1;
     }
     if( loss != 0 && h->count == h->capacity ) {
@@ -45,6 +69,8 @@ heap_alloc( heap_t* h, size_t size, int userdata ) {
     }
 
     heapptr_t ptr =h->regions[best].start;
+    h->free_total -= size;
+    if( best == largest ) h->largest_free =std::max( second, loss );
 
     if( loss != 0 ) {
         if( best != h->count-1 )
@@ -62,6 +88,10 @@ heap_alloc( heap_t* h, size_t size, int userdata ) {
     set_nonfree( h->regions[best] );
     h->regions[best].userdata =userdata;
 
+    const size_t bucket =size ? 63 - __builtin_clzl( size ) : 0;
+    h->counters.alloc_hist[bucket < HEAP_HIST_BUCKETS ? bucket : HEAP_HIST_BUCKETS-1]++;
+    h->counters.n_alloc++;
+
     return ptr;
 }
 
@@ -90,7 +120,8 @@ heap_free( heap_t* h, heapptr_t ptr ) {
     heapptr_t base =h->regions[i].start;
     heapptr_t size =size( h->regions[i] );
 
-    if( i != h->count && is_free( h->regions[i+1] ) ) {
+    h->free_total += size;
+    if( i+1 < h->count && is_free( h->regions[i+1] ) ) {
         move++;
         size += size( h->regions[i+1] );
     }
@@ -110,10 +141,12 @@ heap_free( heap_t* h, heapptr_t ptr ) {
         h->count -= move;
 
     }
+    h->largest_free =std::max( h->largest_free, (size_t)size );
     // Set the region to free
 //    h->regions[i].free  =true;
     set_free( h->regions[i] );
     h->regions[i].userdata =0;
+    h->counters.n_free++;
 
     return 0;
 }
@@ -124,6 +157,8 @@ heap_defrag( heap_t* h, heap_movefunc_t func, void* user ) {
     if( h->count < 2 ) return;
     size_t first_empty =0; // Offset of the first empty element
     size_t first_empty_desc =0;
+    const double start =now();
+    h->counters.n_defrag++;
 
     for( size_t i =0; i < h->count; i++ ) {
         region_desc_t *desc = &h->regions[i];
@@ -133,6 +168,7 @@ heap_defrag( heap_t* h, heap_movefunc_t func, void* user ) {
                     fprintf( stderr, "(e) heap_defrag(): user memmove function returned non-zero.\n" );
                     return;
                 }
+                h->counters.moved +=size( *desc );
             }
             h->regions[first_empty_desc].size = desc->size;
             h->regions[first_empty_desc].start = first_empty;
@@ -151,6 +187,89 @@ heap_defrag( heap_t* h, heap_movefunc_t func, void* user ) {
     h->regions[first_empty_desc].start =first_empty;
     h->regions[first_empty_desc].size  =empty_size;
     set_free( h->regions[first_empty_desc] );
+    h->largest_free =empty_size;
+    h->counters.defrag_time +=now() - start;
+}
+
+/** Moves allocated regions of about @budget in total down into the free
+ *  region just below them, so that free regions merge without stopping for a 
+ *  full heap_defrag(). Regions are chosen by the size of the free region that
+ *  results from the move relative to their own size: a small region between
+ *  two large free regions goes first. The moves are disjoint and copied
+ *  concurrently if they are large enough together, so the move function must
+ *  be thread safe for distinct regions.
+ *  Returns the size moved.
+ */
+size_t
+heap_compact_step( heap_t* h, size_t budget, heap_movefunc_t func, void* user ) {
+    const double start =now();
+
+    // Candidates are the allocated regions with a free region below them.
+    // Only the best of them are kept, in a min-heap by score: the lowest is
+    // dropped while the others still fill the budget, so the heap holds about
+    // as many regions as are moved instead of all candidates.
+    typedef std::pair<double,size_t> cand_t;
+    static thread_local std::vector<cand_t> cand;
+    const auto worse =[]( const cand_t& a, const cand_t& b ) { return a.first > b.first; };
+    cand.clear();
+    size_t moved =0;
+    for( size_t i =1; i < h->count && budget; i++ ) {
+        if( is_free( h->regions[i] ) || is_nonfree( h->regions[i-1] ) ) continue;
+        size_t merged =size( h->regions[i-1] );
+        if( i+1 < h->count && is_free( h->regions[i+1] ) ) merged += size( h->regions[i+1] );
+        const double score =(double)merged / (double)(size( h->regions[i] ) + 1);
+        if( moved >= budget && score <= cand.front().first ) continue;
+        cand.push_back( std::make_pair( score, i ) );
+        std::push_heap( cand.begin(), cand.end(), worse );
+        moved += size( h->regions[i] );
+        while( moved - size( h->regions[cand.front().second] ) >= budget ) {
+            moved -= size( h->regions[cand.front().second] );
+            std::pop_heap( cand.begin(), cand.end(), worse );
+            cand.pop_back();
+        }
+    }
+
+    // Free regions never border each other, so no two candidates share one
+    // and all moves are disjoint
+    const size_t n_moves =cand.end() - cand.begin(); // size() is a macro here
+    const cand_t* moves =cand.data(); // cand is thread local, the copies below are not
+
+    int error =0;
+#pragma omp parallel for schedule(dynamic) reduction(|:error) if(moved >= HEAP_PARALLEL_MOVE && !omp_in_parallel())
+    for( size_t k =0; k < n_moves; k++ ) {
+        const size_t i =moves[k].second;
+        error |= func( user, h->regions[i], h->regions[i-1].start );
+    }
+    if( error ) {
+        fprintf( stderr, "(e) heap_compact_step(): user memmove function returned non-zero.\n" );
+        abort();
+    }
+
+    // Swap the regions with the free regions below them, then merge adjacent 
+    // free regions
+    for( size_t k =0; k < n_moves; k++ ) {
+        region_desc_t* r =&h->regions[moves[k].second];
+        const region_desc_t hole =r[-1];
+        r[-1] =r[0];
+        r[-1].start =hole.start;
+        r[0] =hole;
+        r[0].start =hole.start + size( r[-1] );
+    }
+    size_t n =0;
+    for( size_t i =0; i < h->count; i++ ) {
+        if( n && is_free( h->regions[i] ) && is_free( h->regions[n-1] ) )
+            h->regions[n-1].size += size( h->regions[i] );
+        else
+            h->regions[n++] =h->regions[i];
+        if( is_free( h->regions[n-1] ) )
+            h->largest_free =std::max( h->largest_free, (size_t)size( h->regions[n-1] ) );
+    }
+    h->count =n;
+
+    if( n_moves ) h->counters.n_compact++;
+    h->counters.moved += moved;
+    h->counters.compact_time +=now() - start;
+    return moved;
 }
 
 size_t 
@@ -158,6 +277,70 @@ heap_regionSize( region_desc_t* r ) {
     return size( *r );
 }
 
+/** Computes the current state of the heap in @s, scanning all regions.
+ */
+void
+heap_stats( const heap_t* h, heap_stats_t* s ) {
+    memset( s, 0, sizeof( heap_stats_t ) );
+    s->n_regions =h->count;
+    for( size_t i =0; i < h->count; i++ ) {
+        const size_t sz =size( h->regions[i] );
+        s->total += sz;
+        if( is_free( h->regions[i] ) ) {
+            s->free += sz;
+            s->n_free_regions++;
+            if( sz > s->largest_free ) s->largest_free =sz;
+        } else
+            s->live += sz;
+    }
+    s->fragmentation =s->free ? 1.0 - (double)s->largest_free / (double)s->free : 0.0;
+    s->counters =h->counters;
+}
+
+/** Creates the CSV file @filename for a time series of heap_stats(), sampled
+ *  every @interval steps by the caller of heap_trace_sample().
+ *  Returns -1 if the file cannot be created.
+ */
+int
+heap_trace_open( heap_trace_t* t, const char* filename, size_t interval ) {
+    t->f =fopen( filename, "w" );
+    if( !t->f ) {
+        perror( "heap_trace_open" );
+        return -1;
+    }
+    t->interval =interval ? interval : 1;
+    t->start =now();
+    memset( &t->last, 0, sizeof( heap_stats_t ) );
+    fprintf( t->f, "step,time,live,free,largest_free,free_regions,fragmentation,"
+                   "allocs,frees,failed,defrags,compactions,moved,defrag_time,compact_time" );
+    for( size_t b =0; b < HEAP_HIST_BUCKETS; b++ )
+        fprintf( t->f, ",hist_%ld", (size_t)1 << b );
+    fprintf( t->f, "\n" );
+    return 0;
+}
+
+/** Appends one row with the state of @h at @step to the trace.
+ */
+void
+heap_trace_sample( heap_trace_t* t, const heap_t* h, size_t step ) {
+    heap_stats_t& s =t->last;
+    heap_stats( h, &s );
+    fprintf( t->f, "%ld,%.6f,%ld,%ld,%ld,%ld,%.6f,%ld,%ld,%ld,%ld,%ld,%ld,%.6f,%.6f",
+             step, now() - t->start, s.live, s.free, s.largest_free, s.n_free_regions, s.fragmentation,
+             s.counters.n_alloc, s.counters.n_free, s.counters.n_failed,
+             s.counters.n_defrag, s.counters.n_compact, s.counters.moved,
+             s.counters.defrag_time, s.counters.compact_time );
+    for( size_t b =0; b < HEAP_HIST_BUCKETS; b++ )
+        fprintf( t->f, ",%ld", s.counters.alloc_hist[b] );
+    fprintf( t->f, "\n" );
+}
+
+void
+heap_trace_close( heap_trace_t* t ) {
+    fclose( t->f );
+    t->f =NULL;
+}
+
 void 
 heap_debugPrint( heap_t* h ) {
     printf( "(i) Heap: total regions %ld, capacity %ld.\n", h->count, h->capacity );
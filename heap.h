@@ -3,6 +3,9 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
+
+#define HEAP_HIST_BUCKETS 24    // Allocation sizes [2^b, 2^(b+1)), the last bucket takes the rest
 
 typedef size_t heapptr_t;       // Offset (pointer) within the user dats array
 typedef ssize_t heapsptr_t;     // Signed offset
@@ -13,12 +16,51 @@ typedef struct {
     int       userdata;
 } region_desc_t;
 
+/* Cumulative counters, maintained by the heap functions. Sizes are in the
+ * same units as the heap itself.
+ */
+typedef struct {
+    size_t    n_alloc;
+    size_t    n_free;
+    size_t    n_failed;         // Allocations that did not fit
+    size_t    alloc_hist[HEAP_HIST_BUCKETS];
+    size_t    n_defrag;
+    size_t    n_compact;        // Calls of heap_compact_step() that moved regions
+    size_t    moved;            // Total size of the regions moved by heap_defrag() and heap_compact_step()
+    double    defrag_time;      // Seconds spent in heap_defrag(), the move function included
+    double    compact_time;     // Seconds spent in heap_compact_step(), the move function included
+} heap_counters_t;
+
 typedef struct {
     region_desc_t* regions;     
     size_t         capacity;    // Length of the region array
     size_t         count;       // Actual number of regions
+    size_t         free_total;  // Size of all free regions
+    size_t         largest_free;
+    size_t         compact_budget; // Size moved per heap_compact_step() by the owner, 0 for none
+    heap_counters_t counters;
 } heap_t;
 
+/* State of the heap at one moment, see heap_stats() */
+typedef struct {
+    size_t    total;
+    size_t    live;             // Size of the allocated regions
+    size_t    free;
+    size_t    largest_free;
+    size_t    n_free_regions;   // Length of the free list
+    size_t    n_regions;
+    double    fragmentation;    // 1 - largest_free/free, 0 if nothing is free
+    heap_counters_t counters;
+} heap_stats_t;
+
+/* Time series of heap_stats(), written as CSV */
+typedef struct heap_trace_t {
+    FILE*     f;
+    size_t    interval;         // Steps between two samples
+    double    start;            // Time of heap_trace_open() in seconds
+    heap_stats_t last;          // Most recent sample
+} heap_trace_t;
+
 /* Custom memmove function that takes four arguments (in order):
  * - user pointer passed to heap_defrag()
  * - occupied region
@@ -32,8 +74,14 @@ heapsptr_t heap_alloc( heap_t* h, size_t size, int userdata );
 int heap_free( heap_t* h, heapptr_t ptr );
 
 void heap_defrag( heap_t* h, heap_movefunc_t, void* user );
+size_t heap_compact_step( heap_t* h, size_t budget, heap_movefunc_t, void* user );
 size_t heap_regionSize( region_desc_t* );
 
+void heap_stats( const heap_t* h, heap_stats_t* s );
+int heap_trace_open( heap_trace_t* t, const char* filename, size_t interval );
+void heap_trace_sample( heap_trace_t* t, const heap_t* h, size_t step );
+void heap_trace_close( heap_trace_t* t );
+
 void heap_debugPrint( heap_t* h );
 
 #endif
@@ -0,0 +1,238 @@
+#include "krylov.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+static double
+dot( const double x[], const double y[], size_t n ) {
+    double sum =0.0;
+#pragma omp parallel for simd reduction(+:sum)
+    for( size_t i =0; i < n; i++ ) sum += x[i] * y[i];
+    return sum;
+}
+
+/** y = y + alpha * x
+ */
+static void
+axpy( double y[], double alpha, const double x[], size_t n ) {
+#pragma omp parallel for simd
+    for( size_t i =0; i < n; i++ ) y[i] += alpha * x[i];
+}
+
+/** Computes r = b - Ax
+ */
+static void
+residual( double r[], matrix_t* a, const double x[], const double b[] ) {
+    mult_matvec( r, a, x );
+#pragma omp parallel for simd
+    for( size_t i =0; i < a->m; i++ ) r[i] =b[i] - r[i];
+}
+
+/** Applies the preconditioner, i.e. solves z in LUz = r using the factors
+ *  @p computed by lup() or ilut(). @tmp and @tmp2 are scratch vectors of 
+ *  length @n. If @p is NULL the preconditioner is the identity.
+ */
+static void
+precond( double z[], matrix_t* p, const double r[], double tmp[], double tmp2[], size_t n ) {
+    if( !p ) {
+        memcpy( z, r, n * sizeof(double) );
+        return;
+    }
+    l_subst( tmp, p, r );
+    u_subst( tmp2, p, tmp );
+    // u_subst() stores unknown jj at position row_order[jj]
+    for( size_t jj =0; jj < p->m; jj++ ) z[jj] =tmp2[p->row_order[jj]];
+}
+
+/** Solves Ax = b using restarted GMRES with right preconditioning by the 
+ *  factors in @p. The matrix @a must be stored with an unpermuted row order.
+ *  @x contains the initial guess on entry. Returns 0 if the tolerance was 
+ *  reached and -1 otherwise.
+ */
+int
+gmres( double x[], matrix_t* a, matrix_t* p, const double b[], krylov_t* k ) {
+    const size_t n =a->m;
+    const size_t mr =k->restart ? k->restart : KRYLOV_DEFAULT_RESTART;
+    double* v    =(double*)malloc( (mr+1) * n * sizeof(double) );
+    double* z    =(double*)malloc( 4 * n * sizeof(double) );
+    double* tmp  =z + n;
+    double* tmp2 =z + 2*n;
+    double* u    =z + 3*n;
+    double h[mr+1][mr], cs[mr], sn[mr], g[mr+1], y[mr];
+
+    if( !v || !z ) {
+        fprintf( stderr, "(e) gmres(): out of memory.\n" );
+        free( v ); free( z );
+        return -1;
+    }
+
+    const double bnorm =sqrt( dot( b, b, n ) );
+    k->iter =0;
+    k->resid =1.0;
+    int ret =-1;
+
+    while( k->iter < k->max_iter ) {
+        residual( v, a, x, b );
+        double beta =sqrt( dot( v, v, n ) );
+        k->resid =bnorm > 0.0 ? beta / bnorm : beta;
+        if( k->resid <= k->tol ) { ret =0; break; }
+
+        for( size_t i =0; i < n; i++ ) v[i] /= beta;
+        memset( g, 0, sizeof( g ) );
+        g[0] =beta;
+
+        size_t j;
+        for( j =0; j < mr && k->iter < k->max_iter; j++, k->iter++ ) {
+            double* vj =&v[j*n];
+            double* w  =&v[(j+1)*n];
+            precond( z, p, vj, tmp, tmp2, n );
+            mult_matvec( w, a, z );
+
+            // Modified Gram-Schmidt
+            for( size_t i =0; i <= j; i++ ) {
+                h[i][j] =dot( w, &v[i*n], n );
+                axpy( w, -h[i][j], &v[i*n], n );
+            }
+            h[j+1][j] =sqrt( dot( w, w, n ) );
+            if( h[j+1][j] != 0.0 )
+                for( size_t i =0; i < n; i++ ) w[i] /= h[j+1][j];
+
+            // Apply the previous Givens rotations and compute a new one
+            for( size_t i =0; i < j; i++ ) {
+                const double t =cs[i] * h[i][j] + sn[i] * h[i+1][j];
+                h[i+1][j] =-sn[i] * h[i][j] + cs[i] * h[i+1][j];
+                h[i][j] =t;
+            }
+            const double r =hypot( h[j][j], h[j+1][j] );
+            cs[j] =h[j][j] / r;
+            sn[j] =h[j+1][j] / r;
+            h[j][j] =r;
+            h[j+1][j] =0.0;
+            g[j+1] =-sn[j] * g[j];
+            g[j]   =cs[j] * g[j];
+
+            k->resid =bnorm > 0.0 ? fabs( g[j+1] ) / bnorm : fabs( g[j+1] );
+            if( k->resid <= k->tol ) { j++; k->iter++; break; }
+        }
+
+        // Solve the upper triangular system Hy = g and update x += M^-1 V y
+        for( ssize_t i =j-1; i >= 0; i-- ) {
+            y[i] =g[i];
+            for( size_t l =i+1; l < j; l++ ) y[i] -= h[i][l] * y[l];
+            y[i] /= h[i][i];
+        }
+        memset( u, 0, n * sizeof(double) );
+        for( size_t i =0; i < j; i++ ) axpy( u, y[i], &v[i*n], n );
+        precond( z, p, u, tmp, tmp2, n );
+        axpy( x, 1.0, z, n );
+
+        if( k->resid <= k->tol ) {
+            // Confirm using the true residual, the recurrence may drift
+            residual( tmp, a, x, b );
+            k->resid =bnorm > 0.0 ? sqrt( dot( tmp, tmp, n ) ) / bnorm : 0.0;
+            if( k->resid <= k->tol ) { ret =0; break; }
+        }
+    }
+
+    free( v );
+    free( z );
+    return ret;
+}
+
+/** Solves Ax = b using BiCGSTAB with right preconditioning by the factors in
+ *  @p. The matrix @a must be stored with an unpermuted row order.
+ *  @x contains the initial guess on entry. Returns 0 if the tolerance was 
+ *  reached and -1 otherwise.
+ */
+int
+bicgstab( double x[], matrix_t* a, matrix_t* p, const double b[], krylov_t* k ) {
+    const size_t n =a->m;
+    double* buf =(double*)malloc( 9 * n * sizeof(double) );
+    if( !buf ) {
+        fprintf( stderr, "(e) bicgstab(): out of memory.\n" );
+        return -1;
+    }
+    double *r =buf, *rhat =buf+n, *pv =buf+2*n, *v =buf+3*n, *s =buf+4*n, 
+           *t =buf+5*n, *y =buf+6*n, *tmp =buf+7*n, *tmp2 =buf+8*n;
+
+    const double bnorm =sqrt( dot( b, b, n ) );
+    double rho =1.0, alpha =1.0, omega =1.0;
+    int ret =-1;
+
+    residual( r, a, x, b );
+    memcpy( rhat, r, n * sizeof(double) );
+    memset( pv, 0, n * sizeof(double) );
+    memset( v, 0, n * sizeof(double) );
+    k->resid =bnorm > 0.0 ? sqrt( dot( r, r, n ) ) / bnorm : 0.0;
+
+    for( k->iter =0; k->iter < k->max_iter && k->resid > k->tol; k->iter++ ) {
+        const double rho_new =dot( rhat, r, n );
+        if( rho_new == 0.0 || omega == 0.0 ) break; // Breakdown
+        const double beta =(rho_new / rho) * (alpha / omega);
+        rho =rho_new;
+
+#pragma omp parallel for simd
+        for( size_t i =0; i < n; i++ ) pv[i] =r[i] + beta * (pv[i] - omega * v[i]);
+
+        precond( y, p, pv, tmp, tmp2, n );
+        mult_matvec( v, a, y );
+        alpha =rho / dot( rhat, v, n );
+        axpy( x, alpha, y, n );
+
+#pragma omp parallel for simd
+        for( size_t i =0; i < n; i++ ) s[i] =r[i] - alpha * v[i];
+        k->resid =bnorm > 0.0 ? sqrt( dot( s, s, n ) ) / bnorm : 0.0;
+        if( k->resid <= k->tol ) { k->iter++; break; }
+
+        precond( y, p, s, tmp, tmp2, n );
+        mult_matvec( t, a, y );
+        const double tt =dot( t, t, n );
+        omega =tt > 0.0 ? dot( t, s, n ) / tt : 0.0;
+        axpy( x, omega, y, n );
+
+#pragma omp parallel for simd
+        for( size_t i =0; i < n; i++ ) r[i] =s[i] - omega * t[i];
+        k->resid =bnorm > 0.0 ? sqrt( dot( r, r, n ) ) / bnorm : 0.0;
+    }
+
+    // Report the true residual
+    residual( r, a, x, b );
+    k->resid =bnorm > 0.0 ? sqrt( dot( r, r, n ) ) / bnorm : 0.0;
+    if( k->resid <= k->tol ) ret =0;
+
+    free( buf );
+    return ret;
+}
+
+/** Improves the solution @x of Ax = b by iterative refinement, where @solve 
+ *  solves with an (approximate) factorisation of @a. Stops when the relative 
+ *  residual reaches @k->tol, stops decreasing, or after @k->max_iter steps.
+ *  @k->iter counts the steps that were kept. Returns 0 if the tolerance was
+ *  reached and -1 otherwise.
+ */
+int
+refine( double x[], matrix_t* a, const double b[], solve_func_t solve, void* user, krylov_t* k ) {
+    const size_t n =a->m;
+    double* r =(double*)malloc( 2 * n * sizeof(double) );
+    double* d =r + n;
+    const double bnorm =sqrt( dot( b, b, n ) );
+
+    residual( r, a, x, b );
+    k->resid =bnorm > 0.0 ? sqrt( dot( r, r, n ) ) / bnorm : 0.0;
+    for( k->iter =0; k->iter < k->max_iter && k->resid > k->tol; k->iter++ ) {
+        solve( d, r, user );
+        axpy( x, 1.0, d, n );
+        residual( r, a, x, b );
+        const double resid =bnorm > 0.0 ? sqrt( dot( r, r, n ) ) / bnorm : 0.0;
+        if( resid >= k->resid ) {
+            // No further improvement, undo the last step; it is not counted
+            axpy( x, -1.0, d, n );
+            break;
+        }
+        k->resid =resid;
+    }
+
+    free( r );
+    return k->resid <= k->tol ? 0 : -1;
+}
@@ -0,0 +1,26 @@
+#ifndef KRYLOV_H
+#define KRYLOV_H
+
+#include "lup.h"
+
+#define KRYLOV_DEFAULT_RESTART 30
+#define KRYLOV_DEFAULT_MAX_ITER 1000
+#define KRYLOV_DEFAULT_TOL 1e-10
+
+typedef struct {
+    size_t restart;             // Krylov subspace dimension of GMRES
+    size_t max_iter;            // Maximum number of iterations
+    double tol;                 // Relative residual norm to reach
+    size_t iter;                // Number of iterations performed (out)
+    double resid;               // Relative residual norm reached (out)
+} krylov_t;
+
+/* Solves x in Ax = b using a factorisation, see refine() */
+typedef void (*solve_func_t)( double x[], const double b[], void* user );
+
+int gmres( double x[], matrix_t* a, matrix_t* p, const double b[], krylov_t* k );
+int bicgstab( double x[], matrix_t* a, matrix_t* p, const double b[], krylov_t* k );
+
+int refine( double x[], matrix_t* a, const double b[], solve_func_t solve, void* user, krylov_t* k );
+
+#endif
@@ -0,0 +1,252 @@
+#include "lowrank.h"
+#include "dense.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+/** Sets up the updatable factorisation of @a, of which @lu holds the factors
+ *  computed by lup(). Both matrices are kept by reference and changed by the
+ *  updates. At most @max_k rank-1 changes are applied before refactoring.
+ */
+void
+lowrank_init( lowrank_t* lr, matrix_t* a, matrix_t* lu, size_t max_k ) {
+    const size_t n =a->m;
+    lr->a =a;
+    lr->lu =lu;
+    lr->n =n;
+    lr->k =0;
+    lr->max_k =max_k;
+    lr->top =0;
+    for( size_t i =0; i < n; i++ ) lr->top =std::max( lr->top, (size_t)a->row_ptr_end[i] + 1 );
+    lr->n_updates =lr->n_refactor =0;
+    lr->v =(double*)malloc( max_k * n * sizeof(double) );
+    lr->w =(double*)malloc( max_k * n * sizeof(double) );
+    lr->s =(double*)malloc( max_k * max_k * sizeof(double) );
+    lr->s_lu =(double*)malloc( max_k * max_k * sizeof(double) );
+    lr->s_perm =(indx_t*)malloc( max_k * sizeof(indx_t) );
+    lr->s_row =(double*)malloc( max_k * sizeof(double) );
+    lr->s_col =(double*)malloc( max_k * sizeof(double) );
+    lr->tmp =(double*)malloc( 3 * n * sizeof(double) );
+}
+
+void
+lowrank_free( lowrank_t* lr ) {
+    free( lr->v );
+    free( lr->w );
+    free( lr->s );
+    free( lr->s_lu );
+    free( lr->s_perm );
+    free( lr->s_row );
+    free( lr->s_col );
+    free( lr->tmp );
+}
+
+/** Solves A_0 x = @b with the stored factors, x in natural order */
+static void
+base_solve( double x[], lowrank_t* lr, const double b[] ) {
+    double* c =&lr->tmp[lr->n];
+    double* y =&lr->tmp[2*lr->n];
+    l_subst( c, lr->lu, b );
+    u_subst( y, lr->lu, c );
+    for( size_t jj =0; jj < lr->n; jj++ ) x[jj] =y[lr->lu->row_order[jj]];
+}
+
+/** Factors the current matrix, which discards the correction.
+ */
+static void
+refactor( lowrank_t* lr ) {
+    // The copy is compact, copying it back also compacts the current matrix
+    matrix_copy( lr->lu, lr->a );
+    matrix_copy( lr->a, lr->lu );
+    lr->top =lr->a->count;
+    for( size_t i =0; i < lr->n; i++ ) lr->lu->row_order[i] =i;
+    lup( lr->lu );
+    lr->k =0;
+    lr->n_refactor++;
+}
+
+/** Factors the leading k x k block of the capacitance matrix, equilibrated
+ *  by rows and columns since the changes can be of any scale. Returns false 
+ *  if it is (nearly) singular.
+ */
+static bool
+factor_capacitance( lowrank_t* lr ) {
+    const size_t k =lr->k;
+    double* a =lr->s_lu;
+    for( size_t i =0; i < k; i++ ) {
+        memcpy( &a[i*k], &lr->s[i*lr->max_k], k * sizeof(double) );
+        double max =0.0;
+        for( size_t j =0; j < k; j++ ) max =fmax( max, fabs( a[i*k+j] ) );
+        if( max == 0.0 ) return false;
+        lr->s_row[i] =1.0 / max;
+        for( size_t j =0; j < k; j++ ) a[i*k+j] *= lr->s_row[i];
+    }
+    for( size_t j =0; j < k; j++ ) {
+        double max =0.0;
+        for( size_t i =0; i < k; i++ ) max =fmax( max, fabs( a[i*k+j] ) );
+        lr->s_col[j] =1.0 / max;
+        for( size_t i =0; i < k; i++ ) a[i*k+j] *= lr->s_col[j];
+    }
+
+    if( dense_lu( a, k, lr->s_perm ) != 0 ) return false;
+    double min_pivot =INFINITY, max_pivot =0.0;
+    for( size_t i =0; i < k; i++ ) {
+        min_pivot =fmin( min_pivot, fabs( a[i*k+i] ) );
+        max_pivot =fmax( max_pivot, fabs( a[i*k+i] ) );
+    }
+    return min_pivot >= LOWRANK_MIN_PIVOT * max_pivot;
+}
+
+/** Adds the rank-1 change u v^T, which has already been applied to the 
+ *  current matrix. @u is indexed by row, @v by column.
+ */
+static void
+add_update( lowrank_t* lr, const double u[], const double v[] ) {
+    const size_t n =lr->n, j =lr->k;
+    lr->n_updates++;
+    if( j == lr->max_k ) {
+        refactor( lr );
+        return;
+    }
+    double* w =&lr->w[j*n];
+    memcpy( &lr->v[j*n], v, n * sizeof(double) );
+    base_solve( w, lr, u );
+
+    // New row and column of I + V^T W
+    for( size_t i =0; i <= j; i++ ) {
+        double row =0.0, col =0.0;
+        for( size_t c =0; c < n; c++ ) {
+            row += v[c] * lr->w[i*n+c];
+            col += lr->v[i*n+c] * w[c];
+        }
+        lr->s[j*lr->max_k+i] =row + (i == j);
+        lr->s[i*lr->max_k+j] =col + (i == j);
+    }
+    lr->k++;
+    if( !factor_capacitance( lr ) ) refactor( lr );
+}
+
+/** Stores row @row of the current matrix after the used part of the arrays,
+ *  the old elements are abandoned until the next refactorisation.
+ */
+static int
+store_row( lowrank_t* lr, indx_t row, const double values[], const indx_t col_ind[], size_t len ) {
+    matrix_t* a =lr->a;
+    if( lr->top + len > MAX_N_ELEMENTS ) {
+        fprintf( stderr, "(e) lowrank: insufficient space to store row %ld.\n", row );
+        return -1;
+    }
+    memcpy( &a->values[lr->top], values, len * sizeof(double) );
+    memcpy( &a->col_ind[lr->top], col_ind, len * sizeof(indx_t) );
+    a->count += len - (1 + a->row_ptr_end[row] - a->row_ptr_begin[row]);
+    a->row_ptr_begin[row] =lr->top;
+    a->row_ptr_end[row] =lr->top + len - 1;
+    lr->top += len;
+    return 0;
+}
+
+/** Replaces row @row of the matrix by the @len elements in @values and 
+ *  @col_ind (sorted by column). This is the rank-1 change e_row (new - old)^T.
+ */
+int
+lowrank_replace_row( lowrank_t* lr, indx_t row, const double values[], const indx_t col_ind[], size_t len ) {
+    matrix_t* a =lr->a;
+    double* u =lr->tmp;
+    double v[lr->n];
+    memset( v, 0, lr->n * sizeof(double) );
+    for( indx_t j =a->row_ptr_begin[row]; j <= a->row_ptr_end[row]; j++ )
+        v[a->col_ind[j]] -= a->values[j];
+    for( size_t j =0; j < len; j++ )
+        v[col_ind[j]] += values[j];
+
+    if( store_row( lr, row, values, col_ind, len ) != 0 ) return -1;
+    memset( u, 0, lr->n * sizeof(double) );
+    u[row] =1.0;
+    add_update( lr, u, v );
+    return 0;
+}
+
+/** Replaces column @col of the matrix by the @len elements in @values and
+ *  @row_ind. This is the rank-1 change (new - old) e_col^T.
+ */
+int
+lowrank_replace_col( lowrank_t* lr, indx_t col, const double values[], const indx_t row_ind[], size_t len ) {
+    matrix_t* a =lr->a;
+    const size_t n =lr->n;
+    double u[n];
+    memset( u, 0, n * sizeof(double) );
+    for( size_t j =0; j < len; j++ ) u[row_ind[j]] =values[j];
+
+    double values_tmp[n];
+    indx_t col_ind_tmp[n];
+    for( size_t i =0; i < n; i++ ) {
+        const indx_t* begin =&a->col_ind[a->row_ptr_begin[i]];
+        const indx_t* end =&a->col_ind[a->row_ptr_end[i]] + 1;
+        const indx_t* pos =std::lower_bound( begin, end, col );
+        const bool found =pos != end && *pos == col;
+        const double old =found ? a->values[a->row_ptr_begin[i] + (pos - begin)] : 0.0;
+        if( u[i] == old ) {
+            u[i] =0.0;
+            continue;
+        }
+
+        // Rebuild the row with the new element
+        const size_t before =pos - begin, len_i =end - begin;
+        const size_t after =len_i - before - (found ? 1 : 0);
+        size_t o =before;
+        memcpy( values_tmp, &a->values[a->row_ptr_begin[i]], before * sizeof(double) );
+        memcpy( col_ind_tmp, begin, before * sizeof(indx_t) );
+        if( u[i] != 0.0 ) {
+            values_tmp[o] =u[i];
+            col_ind_tmp[o++] =col;
+        }
+        memcpy( &values_tmp[o], &a->values[a->row_ptr_end[i] + 1 - after], after * sizeof(double) );
+        memcpy( &col_ind_tmp[o], end - after, after * sizeof(indx_t) );
+        u[i] -= old;
+        if( store_row( lr, i, values_tmp, col_ind_tmp, o + after ) != 0 ) return -1;
+    }
+
+    double* v =lr->tmp;
+    memset( v, 0, n * sizeof(double) );
+    v[col] =1.0;
+    add_update( lr, u, v );
+    return 0;
+}
+
+/** Applies the Sherman-Morrison-Woodbury formula, x in natural order */
+static void
+smw_solve( double x[], lowrank_t* lr, const double b[] ) {
+    const size_t n =lr->n, k =lr->k;
+    base_solve( x, lr, b );
+    if( k == 0 ) return;
+
+    double z[k];
+    for( size_t j =0; j < k; j++ ) {
+        z[j] =0.0;
+        for( size_t c =0; c < n; c++ ) z[j] += lr->v[j*n+c] * x[c];
+        z[j] *= lr->s_row[j];
+    }
+    dense_solve( lr->s_lu, k, lr->s_perm, z );
+    for( size_t j =0; j < k; j++ ) {
+        z[j] *= lr->s_col[j];
+        for( size_t c =0; c < n; c++ ) x[c] -= lr->w[j*n+c] * z[j];
+    }
+}
+
+/** Solves Ax = @b for the current matrix, x in natural order. Since the
+ *  Woodbury formula is less accurate than the factors themselves, the 
+ *  solution is refined LOWRANK_REFINE times with the current matrix.
+ */
+void
+lowrank_solve( double x[], lowrank_t* lr, const double b[] ) {
+    const size_t n =lr->n;
+    smw_solve( x, lr, b );
+    for( size_t step =0; step < LOWRANK_REFINE && lr->k; step++ ) {
+        double r[n], d[n];
+        mult_matvec( r, lr->a, x );
+        for( size_t i =0; i < n; i++ ) r[i] =b[i] - r[i];
+        smw_solve( d, lr, r );
+        for( size_t i =0; i < n; i++ ) x[i] += d[i];
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef LOWRANK_H
+#define LOWRANK_H
+
+#include "lup.h"
+
+#define LOWRANK_MAX_UPDATES 32  // Rank of the correction at which the matrix is refactored
+#define LOWRANK_MIN_PIVOT 1e-8  // Relative pivot of the capacitance matrix below which it is refactored
+#define LOWRANK_REFINE 1        // Refinement steps of each solve with a non-empty correction
+
+/* Factorisation of A = A_0 + U V^T, where A_0 is the matrix at the last
+ * (re)factorisation and U V^T the sum of the rank-1 changes since then. 
+ * Solves use the Sherman-Morrison-Woodbury formula
+ *   A^-1 b = y - W (I + V^T W)^-1 V^T y,  y = A_0^-1 b,  W = A_0^-1 U.
+ * Each row or column replacement costs one solve with A_0; the matrix is 
+ * refactored when the rank reaches its maximum or the capacitance matrix 
+ * I + V^T W becomes ill-conditioned. Solves are refined with the current A.
+ */
+typedef struct {
+    matrix_t* a;                // Current matrix, changed in place
+    matrix_t* lu;               // Factors of A_0
+    size_t    n;
+    size_t    k;                // Rank of the correction
+    size_t    max_k;
+    size_t    top;              // First unused element of @a->values
+    size_t    n_updates;
+    size_t    n_refactor;
+    double*   v;                // Rows of V^T, by column (max_k x n)
+    double*   w;                // Columns of W, in natural order (max_k x n)
+    double*   s;                // I + V^T W (max_k x max_k)
+    double*   s_lu;             // Factors of the leading k x k block of @s
+    indx_t*   s_perm;
+    double*   s_row;            // Row and column scaling of the factored block
+    double*   s_col;
+    double*   tmp;              // Workspace (3 x n)
+} lowrank_t;
+
+void lowrank_init( lowrank_t* lr, matrix_t* a, matrix_t* lu, size_t max_k );
+int lowrank_replace_row( lowrank_t* lr, indx_t row, const double values[], const indx_t col_ind[], size_t len );
+int lowrank_replace_col( lowrank_t* lr, indx_t col, const double values[], const indx_t row_ind[], size_t len );
+void lowrank_solve( double x[], lowrank_t* lr, const double b[] );
+void lowrank_free( lowrank_t* lr );
+
+#endif
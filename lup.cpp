@@ -1,12 +1,38 @@
 
 #include "lup.h"
 #include "heap.h"
+#include "dense.h"
+#include "ooc.h"
+#include "etree.h"
+#include "sched.h"
+#include "sym.h"
+#include "simd.h"
+#include "ckpt.h"
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <queue>
+#include <atomic>
+#include <pthread.h>
+#include <omp.h>
+
+#define DEFER_PIVOT_THRESHOLD 0.1 // Relative pivot size from which deferred rows are avoided
+#define SUB_RUN_RETRY 8 // Columns merged one by one after a run of common columns cancelled at once
 
 static region_desc_t HEAP_REGIONS[HEAP_SIZE];
+static size_t COMPACT_BUDGET =COMPACT_DEFAULT_BUDGET; // See lup_set_compaction()
+static pthread_rwlock_t ROW_LOCK; // Guards the row storage during concurrent elimination
+static pthread_mutex_t HEAP_MUTEX =PTHREAD_MUTEX_INITIALIZER; // Guards the heap metadata while rows are stored under a read lock
+static double DENSE_ROWS =DENSE_ROW_DEFAULT_THRESHOLD; // See lup_set_dense_rows()
+static sindx_t DENSE_COL[MAX_N_ROWS]; // First column of the dense segment of each row, -1 for CRS rows
+static indx_t DENSE_OFF[MAX_N_ROWS];  // Offset of the dense segment in the row
+static bool ROW_ALLOC_MAY_FAIL =false; // Set by lup_ooc(): rows that do not fit are recorded instead of aborting
+static size_t ROW_ALLOC_FAILED =0; // Length of the first row that did not fit, 0 if all did
 
 void
 print_dense( matrix_t* m ) {
@@ -58,47 +84,153 @@ crs_memmove( matrix_t* m, region_desc_t region, heapptr_t dest ) {
     return 0;
 }
 
-static inline ssize_t
-replace_row( matrix_t* m, 
-            double new_values[],
-            indx_t new_col_ind[],
-            indx_t new_length,
-            size_t row,
-            heap_t* heap ) {
-    size_t old_length = 1 + m->row_ptr_end[row] - m->row_ptr_begin[row];
-    ssize_t delta = new_length - old_length;
-
-    if( heap_free( heap, m->row_ptr_begin[row] ) != 0 ) abort();
-    heapsptr_t start = heap_alloc( heap, new_length, row );
+/** Allocates @length elements for row @row, running heap_defrag() if they
+ *  do not fit. Aborts if they do not fit after defragmentation either, unless
+ *  ROW_ALLOC_MAY_FAIL is set: then -1 is returned and the first such @length
+ *  is kept in ROW_ALLOC_FAILED.
+ */
+static heapptr_t
+alloc_row( matrix_t* m, heap_t* heap, size_t length, size_t row ) {
+    heapsptr_t start = heap_alloc( heap, length, row );
     if( start == -1 ) { 
         // Run garbage collection and try again
         printf( "(i) Out of memory, running heap_defrag()\n" );
         heap_defrag( heap, (heap_movefunc_t)crs_memmove, (void*)m );
-        start = heap_alloc( heap, new_length, row );
-        if( start == -1 ) {
-            fprintf( stderr, "(e) replace_row(): insufficient free space to allocate %ld elements.\n", new_length );
+        start = heap_alloc( heap, length, row );
+        if( start == -1 && ROW_ALLOC_MAY_FAIL ) {
+            if( !ROW_ALLOC_FAILED ) ROW_ALLOC_FAILED =length;
+        } else if( start == -1 ) {
+            fprintf( stderr, "(e) replace_row(): insufficient free space to allocate %ld elements.\n", length );
             abort();
         }
     }
+    return start;
+}
 
+/** Copies the row @row to @start, of which only the first @n_indexed 
+ *  elements have column indices.
+ */
+static inline void
+place_row( matrix_t* m, 
+           const double new_values[],
+           const indx_t new_col_ind[],
+           indx_t new_length,
+           size_t row,
+           heapptr_t start,
+           size_t n_indexed =(size_t)-1 ) {
     m->row_ptr_begin[row] = start;
     m->row_ptr_end[row]   = start + (new_length - 1);
 
     memcpy( &m->values[start], new_values, new_length * sizeof( double ) );
-    memcpy( &m->col_ind[start], new_col_ind, new_length * sizeof( indx_t ) );
+    memcpy( &m->col_ind[start], new_col_ind, std::min( (size_t)new_length, n_indexed ) * sizeof( indx_t ) );
+}
+
+/** Returns true if the free space of @heap is fragmented enough to be 
+ *  merged by heap_compact_step().
+ */
+static inline bool
+compaction_due( const heap_t* heap ) {
+    return heap->compact_budget && heap->largest_free < (1.0 - COMPACT_MAX_FRAGMENTATION) * heap->free_total;
+}
+
+/** Stores the row @row anew, of which only the first @n_indexed elements have
+ *  column indices. If alloc_row() fails, the row is left without storage.
+ */
+static inline ssize_t
+replace_row( matrix_t* m, 
+            double new_values[],
+            indx_t new_col_ind[],
+            indx_t new_length,
+            size_t row,
+            heap_t* heap,
+            size_t n_indexed =(size_t)-1 ) {
+    size_t old_length = 1 + m->row_ptr_end[row] - m->row_ptr_begin[row];
+    ssize_t delta = new_length - old_length;
+
+    if( heap_free( heap, m->row_ptr_begin[row] ) != 0 ) abort();
+    const heapsptr_t start =alloc_row( m, heap, new_length, row );
+    if( start == -1 ) return -(ssize_t)old_length;
+    place_row( m, new_values, new_col_ind, new_length, row, start, n_indexed );
+
+    // Merge the free space ahead of demand once it becomes fragmented, by a 
+    // bounded amount per allocation
+    if( compaction_due( heap ) )
+        heap_compact_step( heap, heap->compact_budget, (heap_movefunc_t)crs_memmove, (void*)m );
 
     return delta; 
 }
 
+/** Initialises ROW_LOCK for concurrent elimination.
+ */
+static void
+init_row_lock() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init( &attr );
+    // Defragmentation must not be starved by the readers
+    pthread_rwlockattr_setkind_np( &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP );
+    pthread_rwlock_init( &ROW_LOCK, &attr );
+    pthread_rwlockattr_destroy( &attr );
+}
+
+/** Calls replace_row() and updates the element count of @m. If @concurrent is
+ *  set, the caller holds a read lock on the row storage. The row is then 
+ *  allocated under HEAP_MUTEX and copied under the read lock, as other rows 
+ *  stay in place. Only if the row does not fit, or if the heap is due for
+ *  compaction, the read lock is upgraded to a write lock, because 
+ *  heap_defrag() and heap_compact_step() may move any row.
+ */
+static inline void
+store_row( matrix_t* m,
+           double new_values[],
+           indx_t new_col_ind[],
+           indx_t new_length,
+           size_t row,
+           heap_t* heap,
+           bool concurrent ) {
+    if( !concurrent ) {
+        m->count += replace_row( m, new_values, new_col_ind, new_length, row, heap );
+        return;
+    }
+    pthread_mutex_lock( &HEAP_MUTEX );
+    m->count += new_length - (1 + m->row_ptr_end[row] - m->row_ptr_begin[row]);
+    if( heap_free( heap, m->row_ptr_begin[row] ) != 0 ) abort();
+    const heapsptr_t start =heap_alloc( heap, new_length, row );
+    const bool compact =start != -1 && compaction_due( heap );
+    pthread_mutex_unlock( &HEAP_MUTEX );
+
+    if( start != -1 ) {
+        place_row( m, new_values, new_col_ind, new_length, row, start );
+        if( !compact ) return;
+    }
+    pthread_rwlock_unlock( &ROW_LOCK );
+    pthread_rwlock_wrlock( &ROW_LOCK );
+    if( start == -1 )
+        place_row( m, new_values, new_col_ind, new_length, row, alloc_row( m, heap, new_length, row ) );
+    // Another thread may have compacted the heap in the meantime
+    if( compaction_due( heap ) )
+        heap_compact_step( heap, heap->compact_budget, (heap_movefunc_t)crs_memmove, (void*)m );
+    pthread_rwlock_unlock( &ROW_LOCK );
+    pthread_rwlock_rdlock( &ROW_LOCK );
+}
+
+/** Prints the progress indicator for step @step of @n, if its percentage
+ *  differs from *@last, the last one printed.
+ */
+static inline void
+print_progress( size_t step, size_t n, int* last ) {
+    const int percent =(int)((step * 100) / n);
+    if( percent == *last ) return;
+    printf( "\b\b\b\b%3d%%", percent );
+    *last =percent;
+}
+
 /** Reads at most @n elements from @col_ind until @col is encountered.
  *  Returns the offset of @col in @col_ind or -1 if no such value is found.
  */
 static inline ssize_t
 column_offset( const indx_t col_ind[], size_t n, indx_t col ) {
-    for( size_t k =0; k < n; k++ )
-        if( col_ind[k] == col ) return k;
-        else if( col_ind[k] > col ) return -1;
-    return -1;
+    const size_t k =SIMD.lower_bound( col_ind, n, col );
+    return k < n && col_ind[k] == col ? (ssize_t)k : -1;
 }
 
 /** Interchanges the values of array elements @i and @k in @m->row_order 
@@ -112,140 +244,1522 @@ swap_rows( indx_t row_order[], size_t i, size_t k ) {
 
 
 
-/** Computes the LU-factorisation with partial pivotting.
- *  The input matrix is provided in CRS form in the five arrays,
- *  these arrays are modified to contain both the L and U matrix on return.
- *  This function is not reentrant.
+/** Parameters of the incomplete factorisation, see ilut()
  */
-int
-lup( matrix_t* m ) {
+typedef struct {
+    double        tau;          // Relative drop tolerance
+    size_t        fill;         // Additional elements allowed per row in L and U
+    const double* row_norm;     // 2-norm of each original row
+    const size_t* row_nnz;      // Number of non-zeroes in each original row
+} drop_t;
 
-    double values_tmp[m->n];
-    indx_t col_ind_tmp[m->n];
-    
-    // We prepare m->mory m->nagem->nt using the meta array functions defined in heap.h
-    heap_t heap;
-    heap.regions = HEAP_REGIONS;
-    heap.capacity =HEAP_SIZE;
-    heap_clear( &heap, MAX_N_ELEMENTS );
+/** Drops the elements of the U-part @values[@begin..@end) that are smaller
+ *  than the threshold and keeps at most @cap of the remaining, largest
+ *  elements. Returns the new end of the row.
+ */
+static size_t
+drop_elements( double values[], indx_t col_ind[], size_t begin, size_t end, double threshold, size_t cap ) {
+    size_t o =begin;
+    for( size_t j =begin; j < end; j++ ) {
+        if( fabs( values[j] ) < threshold ) continue;
+        values[o] =values[j];
+        col_ind[o++] =col_ind[j];
+    }
+    if( o - begin <= cap ) return o;
+
+    // Find the magnitude of the cap'th largest element and keep those above it
+    double mag[o - begin];
+    for( size_t j =begin; j < o; j++ ) mag[j-begin] =fabs( values[j] );
+    std::nth_element( mag, mag + cap - 1, mag + (o - begin), std::greater<double>() );
+    const double min_mag =mag[cap-1];
+    size_t kept =begin;
+    for( size_t j =begin; j < o && kept - begin < cap; j++ ) {
+        if( fabs( values[j] ) < min_mag ) continue;
+        values[kept] =values[j];
+        col_ind[kept++] =col_ind[j];
+    }
+    return kept;
+}
+
+/** Inserts an artificial pivot @value in column @ii of the row at position @ii.
+ *  Used by the incomplete factorisation when a pivot column became empty.
+ */
+static void
+insert_pivot( matrix_t* m, heap_t* heap, size_t ii, double value, bool concurrent ) {
+    const indx_t k =m->row_order[ii];
+    const size_t len =1 + m->row_ptr_end[k] - m->row_ptr_begin[k];
+    double values_tmp[len+1];
+    indx_t col_ind_tmp[len+1];
+    size_t o =0;
+    for( indx_t j =m->row_ptr_begin[k]; j <= m->row_ptr_end[k]; j++ ) {
+        if( m->col_ind[j] > ii && o == j - m->row_ptr_begin[k] ) {
+            values_tmp[o] =value;
+            col_ind_tmp[o++] =ii;
+        }
+        values_tmp[o] =m->values[j];
+        col_ind_tmp[o++] =m->col_ind[j];
+    }
+    if( o == len ) {
+        values_tmp[o] =value;
+        col_ind_tmp[o++] =ii;
+    }
+    store_row( m, values_tmp, col_ind_tmp, o, k, heap, concurrent );
+}
+
+/** Prepares the heap that manages the free space in @m->values and @m->col_ind.
+ *  Only the first @total_size elements of the arrays are used.
+ *  The rows of @m are expected to be stored contiguously, in order.
+ */
+static void
+prepare_heap( matrix_t* m, heap_t* heap, size_t total_size =MAX_N_ELEMENTS ) {
+    heap->regions = HEAP_REGIONS;
+    heap->capacity =HEAP_SIZE;
+    heap_clear( heap, total_size );
+    heap->compact_budget =COMPACT_BUDGET;
     // Add the row pointers to the `heap'
     for( size_t i =0; i < m->m; i++ ) {
-        heapptr_t ptr =heap_alloc( &heap, 1+m->row_ptr_end[i]-m->row_ptr_begin[i], i );
+        heapptr_t ptr =heap_alloc( heap, 1+m->row_ptr_end[i]-m->row_ptr_begin[i], i );
         assert( ptr == m->row_ptr_begin[i] );
+        (void)ptr;
     }
+}
 
-//    heap_debugPrint( &heap );
+/** Sets the number of elements moved per row allocation by the incremental
+ *  compaction of the row storage, 0 leaves the defragmentation to the moment
+ *  an allocation fails. Applies to the factorisations started afterwards.
+ */
+void
+lup_set_compaction( size_t budget ) {
+    COMPACT_BUDGET =budget;
+}
 
-    // Iterate all rows except the last
-    for( size_t pivot =0; pivot < m->m-1; pivot++ ) {
+/** Sets the fraction of the remaining columns a row of lup() must fill to be
+ *  stored as a dense segment, 0 keeps all rows in CRS form. A dense segment
+ *  keeps its index slots in the heap, so it saves index loads and compares
+ *  but no memory. Applies to the factorisations started afterwards.
+ */
+void
+lup_set_dense_rows( double threshold ) {
+    DENSE_ROWS =threshold;
+}
+
+/** Options of eliminate()
+ */
+typedef struct {
+    size_t        row_end;      // Only rows at positions below row_end are searched and updated
+    size_t        search_end;   // Rows from here to row_end are only searched if no pivot was found before
+    const drop_t* drop;         // Dropping rules of the incomplete factorisation, or NULL
+    bool          concurrent;   // Other threads eliminate disjoint row ranges at the same time
+    double        perturb;      // Static pivotting: minimum pivot magnitude, or 0 for partial pivotting
+    size_t        n_perturbed;  // Number of perturbed pivots (out)
+    ooc_t*        ooc;          // Finished rows are moved here, or NULL to keep them in @m
+    bool          lookahead;    // Defer updates that the next step does not depend on
+    heap_trace_t* trace;        // Samples the heap every trace->interval steps, or NULL
+    double        dense_rows;   // Rows are stored dense from this fraction of the remaining columns, or 0
+    ckpt_t*       ckpt;         // Receives periodic checkpoints, or NULL
+} elim_t;
+
+/** Appends the finished row at position @ii to @o and releases its storage.
+ *  The row pointers of the row are left dangling. Returns -1 if the row could
+ *  not be written or released.
+ */
+static int
+offload_row( matrix_t* m, heap_t* heap, ooc_t* o, size_t ii ) {
+    const indx_t i =m->row_order[ii];
+    const indx_t begin =m->row_ptr_begin[i];
+    if( ooc_append( o, i, &m->values[begin], &m->col_ind[begin], 1 + m->row_ptr_end[i] - begin ) != 0 ) return -1;
+    if( heap_free( heap, begin ) != 0 ) {
+        fprintf( stderr, "(e) offload_row(): the storage of row %ld could not be released.\n", i );
+        return -1;
+    }
+    return 0;
+}
+
+/** Eliminates column @pivot of row @k using the pivot row @i, in which the
+ *  pivot is at offset @pivot_off. The element of row @k in column @pivot is at
+ *  offset @o. The temporary arrays must hold @m->n elements.
+ */
+static void
+update_row( matrix_t* m, heap_t* heap, indx_t i, int pivot_off, size_t pivot, indx_t k, ssize_t o,
+            const drop_t* drop, bool concurrent, double values_tmp[], indx_t col_ind_tmp[] ) {
+
+    indx_t i_off = m->row_ptr_begin[i] + pivot_off, k_off = m->row_ptr_begin[k];
+    const indx_t i_end =m->row_ptr_end[i], k_end =m->row_ptr_end[k];
+    double mult;
+
+    memcpy( values_tmp, &m->values[k_off], o * sizeof(double) );
+    memcpy( col_ind_tmp, &m->col_ind[k_off], o * sizeof(indx_t) );
+
+    k_off += o;
+    mult = m->values[k_off] / m->values[i_off]; // Calculate the multiplication factor
+
+    // The multiplier is dropped if the update it makes is small compared to
+    // the original row. If the L-part is full, the smallest multiplier is
+    // dropped, which may be the new one; updates it already made are kept
+    bool drop_mult =false;
+    if( drop && o + (k_end - k_off) > 0 ) {
+        double update_norm =0.0;
+        for( indx_t j =i_off; j <= i_end; j++ ) update_norm += m->values[j] * m->values[j];
+        drop_mult =fabs( mult ) * sqrt( update_norm ) < drop->tau * drop->row_norm[k];
+        if( !drop_mult && (size_t)o >= drop->row_nnz[k] + drop->fill ) {
+            ssize_t min_j =0;
+            for( ssize_t j =1; j < o; j++ )
+                if( fabs( values_tmp[j] ) < fabs( values_tmp[min_j] ) ) min_j =j;
+            drop_mult =fabs( mult ) <= fabs( values_tmp[min_j] );
+            if( !drop_mult ) {
+                memmove( &values_tmp[min_j], &values_tmp[min_j+1], (o - min_j - 1) * sizeof(double) );
+                memmove( &col_ind_tmp[min_j], &col_ind_tmp[min_j+1], (o - min_j - 1) * sizeof(indx_t) );
+                o--;
+            }
+        }
+    }
+    if( drop_mult ) {
+        // Drop the multiplier, row k is not updated in this step
+        size_t rest =k_end - k_off;
+        memcpy( &values_tmp[o], &m->values[k_off+1], rest * sizeof(double) );
+        memcpy( &col_ind_tmp[o], &m->col_ind[k_off+1], rest * sizeof(indx_t) );
+        store_row( m, values_tmp, col_ind_tmp, o + rest, k, heap, concurrent );
+        return;
+    }
+
+    values_tmp[o] = mult; // Store the multiplier; it is part of the L matrix
+    col_ind_tmp[o] = pivot;
+
+    i_off++; k_off++; o++;// Skip the pivot element
+    const size_t u_begin =o;
+
+    // Substract mult*i from row k using the intermediate buffer array,
+    // merging the remaining (sorted) columns of both rows
+    indx_t next_run =0; // Runs of common columns are tried again from here
+    while( i_off <= i_end || k_off <= k_end ) {
+        indx_t jj;
+        double val;
+
+        if( k_off >= next_run && k_off <= k_end && i_off <= i_end && m->col_ind[k_off] == m->col_ind[i_off] ) {
+            const size_t n =std::min( i_end - i_off, k_end - k_off ) + 1;
+            const size_t r =SIMD.sub_run( &m->col_ind[i_off], &m->values[i_off], &m->col_ind[k_off], &m->values[k_off],
+                                          n, mult, &col_ind_tmp[o], &values_tmp[o] );
+            i_off += r; k_off += r; o += r;
+            if( r != 0 ) continue;
+            next_run =k_off + SUB_RUN_RETRY; // Cancelled right away, merge a few first
+        }
+        if( k_off > k_end || (i_off <= i_end && m->col_ind[i_off] < m->col_ind[k_off]) ) {
+            jj =m->col_ind[i_off];
+            val =0.0 - m->values[i_off++] * mult;
+        } else if( i_off > i_end || m->col_ind[k_off] < m->col_ind[i_off] ) {
+            jj =m->col_ind[k_off];
+            val =m->values[k_off++];
+        } else {
+            jj =m->col_ind[k_off];
+            val =m->values[k_off++] - m->values[i_off++] * mult;
+        }
+
+        if( val != 0.0 ) {
+            values_tmp[o] = val;
+            col_ind_tmp[o] = jj;
+            o++;
+        }
+    }
+
+    if( drop )
+        o =drop_elements( values_tmp, col_ind_tmp, u_begin, o,
+                          drop->tau * drop->row_norm[k], drop->row_nnz[k] + drop->fill );
+
+    store_row( m,
+               values_tmp,
+               col_ind_tmp,
+               o,     // Number of non-zeroes in the dest row
+               k,     // Row number of the dest row
+               heap,
+               concurrent );
+}
+
+/** Returns the offset of column @col in row @k, or -1 if the row has no
+ *  non-zero element there. Rows stored as a dense segment are indexed
+ *  directly, @col is expected to be past their L-part.
+ */
+static inline ssize_t
+find_column( const matrix_t* m, indx_t k, indx_t col ) {
+    const indx_t begin =m->row_ptr_begin[k];
+    if( DENSE_COL[k] == -1 )
+        return column_offset( &m->col_ind[begin], (m->row_ptr_end[k] - begin) + 1, col );
+    if( (sindx_t)col < DENSE_COL[k] ) return -1;
+    const ssize_t o =DENSE_OFF[k] + (col - DENSE_COL[k]);
+    return m->values[begin + o] != 0.0 ? o : -1;
+}
+
+/** As update_row(), for rows that may be stored as a dense segment: the
+ *  L-part in CRS form, followed by the values of the columns DENSE_COL..n-1
+ *  without column indices. There is a kernel for each combination of dense
+ *  and CRS pivot and destination rows. The U-part of the result is stored 
+ *  dense if it fills at least @threshold of the columns after the pivot, and
+ *  is returned to CRS form below half of that. The results are the same as
+ *  those of update_row(); explicit zeroes in dense segments count as absent.
+ */
+static void
+update_hybrid( matrix_t* m, heap_t* heap, indx_t i, int pivot_off, size_t pivot, indx_t k, ssize_t o,
+               double threshold, double values_tmp[], indx_t col_ind_tmp[] ) {
+
+    const indx_t i_off =m->row_ptr_begin[i] + pivot_off, k_off =m->row_ptr_begin[k] + o;
+    const bool i_dense =DENSE_COL[i] != -1, k_dense =DENSE_COL[k] != -1;
+    const size_t n_rest =m->n - 1 - pivot; // Columns after the pivot
+    const size_t i_len =i_dense ? n_rest : m->row_ptr_end[i] - i_off;
+    const size_t k_len =k_dense ? n_rest : m->row_ptr_end[k] - k_off;
+    const double* i_val =&m->values[i_off+1], *k_val =&m->values[k_off+1];
+    const indx_t* i_col =&m->col_ind[i_off+1], *k_col =&m->col_ind[k_off+1];
+
+    // Keep the L-part, zeroes in front of the pivot column of a dense row are dropped
+    const size_t l_len =k_dense ? DENSE_OFF[k] : o;
+    memcpy( values_tmp, &m->values[m->row_ptr_begin[k]], l_len * sizeof(double) );
+    memcpy( col_ind_tmp, &m->col_ind[m->row_ptr_begin[k]], l_len * sizeof(indx_t) );
+    const double mult =m->values[k_off] / m->values[i_off];
+    values_tmp[l_len] =mult;
+    col_ind_tmp[l_len] =pivot;
+
+    const size_t u =l_len + 1;
+    double* rest =&values_tmp[u];
+    bool dense =true;
+    size_t nnz =0;
+    if( k_dense && i_dense ) {
+        memcpy( rest, k_val, n_rest * sizeof(double) );
+        SIMD.axpy( rest, mult, i_val, n_rest );
+    } else if( k_dense ) {
+        memcpy( rest, k_val, n_rest * sizeof(double) );
+        for( size_t j =0; j < i_len; j++ ) rest[i_col[j] - (pivot+1)] -= mult * i_val[j];
+    } else if( i_dense ) {
+        memset( rest, 0, n_rest * sizeof(double) );
+        SIMD.axpy( rest, mult, i_val, n_rest );
+        for( size_t j =0; j < k_len; j++ ) rest[k_col[j] - (pivot+1)] += k_val[j];
+    } else {
+        // Merge the remaining (sorted) columns of both rows, as update_row()
+        size_t a =0, b =0;
+        while( a < i_len || b < k_len ) {
+            indx_t jj;
+            double val;
+            if( b >= k_len || (a < i_len && i_col[a] < k_col[b]) ) {
+                jj =i_col[a];
+                val =0.0 - i_val[a++] * mult;
+            } else if( a >= i_len || k_col[b] < i_col[a] ) {
+                jj =k_col[b];
+                val =k_val[b++];
+            } else {
+                jj =k_col[b];
+                val =k_val[b++] - i_val[a++] * mult;
+            }
+            if( val != 0.0 ) {
+                rest[nnz] =val;
+                col_ind_tmp[u + nnz++] =jj;
+            }
+        }
+        dense =false;
+    }
+    if( dense )
+        for( size_t j =0; j < n_rest; j++ ) nnz += rest[j] != 0.0;
+
+    const bool store_dense =n_rest > 0 && nnz >= (dense ? 0.5 : 1.0) * threshold * n_rest;
+    if( store_dense && !dense ) {
+        // Scatter the CRS elements to their columns, back to front since
+        // the column of each element is at least its offset
+        size_t next =n_rest;
+        for( size_t j =nnz; j-- > 0; ) {
+            const size_t c =col_ind_tmp[u + j] - (pivot+1);
+            rest[c] =rest[j];
+            std::fill( &rest[c+1], &rest[next], 0.0 );
+            next =c;
+        }
+        std::fill( rest, &rest[next], 0.0 );
+    } else if( !store_dense && dense ) {
+        size_t c =0;
+        for( size_t j =0; j < n_rest; j++ ) {
+            if( rest[j] == 0.0 ) continue;
+            rest[c] =rest[j];
+            col_ind_tmp[u + c++] =pivot + 1 + j;
+        }
+    }
+
+    const size_t length =u + (store_dense ? n_rest : nnz);
+    m->count += replace_row( m, values_tmp, col_ind_tmp, length, k, heap, store_dense ? u : length );
+    DENSE_COL[k] =store_dense ? (sindx_t)pivot + 1 : -1;
+    DENSE_OFF[k] =u;
+}
+
+/** Returns the rows at positions @begin..@end-1 that are stored as a dense
+ *  segment to CRS form, in place. The heap regions of the rows keep their size.
+ */
+static void
+sparsify_rows( matrix_t* m, size_t begin, size_t end ) {
+    for( size_t kk =begin; kk < end; kk++ ) {
+        const indx_t k =m->row_order[kk];
+        if( DENSE_COL[k] == -1 ) continue;
+        const indx_t seg =m->row_ptr_begin[k] + DENSE_OFF[k];
+        indx_t o =seg;
+        for( indx_t j =seg; j <= m->row_ptr_end[k]; j++ ) {
+            if( m->values[j] == 0.0 ) continue;
+            m->values[o] =m->values[j];
+            m->col_ind[o++] =DENSE_COL[k] + (j - seg);
+        }
+        m->count -= m->row_ptr_end[k] + 1 - o;
+        m->row_ptr_end[k] =o - 1;
+        DENSE_COL[k] =-1;
+    }
+}
+
+/** Writes a checkpoint of @m before the elimination step @step to @c: the row
+ *  order and the rows modified since the previous checkpoint, or all rows if
+ *  ckpt_begin() asks for a full record. Dense segments are written in CRS
+ *  form, as sparsify_rows() leaves them. The temporary arrays must hold 
+ *  @m->n elements. Returns -1 if the checkpoint could not be written.
+ */
+static int
+write_checkpoint( matrix_t* m, ckpt_t* c, size_t step, double values_tmp[], indx_t col_ind_tmp[] ) {
+    const int full =ckpt_begin( c, m, step );
+    if( full == -1 ) return -1;
+    for( size_t i =0; i < m->m; i++ ) {
+        if( !full && !c->dirty[i] ) continue;
+        const indx_t begin =m->row_ptr_begin[i];
+        const double* values =&m->values[begin];
+        const indx_t* col_ind =&m->col_ind[begin];
+        size_t len =1 + m->row_ptr_end[i] - begin;
+        if( DENSE_COL[i] != -1 ) {
+            len =DENSE_OFF[i];
+            memcpy( values_tmp, values, len * sizeof(double) );
+            memcpy( col_ind_tmp, col_ind, len * sizeof(indx_t) );
+            for( indx_t j =begin + DENSE_OFF[i]; j <= m->row_ptr_end[i]; j++ ) {
+                if( m->values[j] == 0.0 ) continue;
+                values_tmp[len] =m->values[j];
+                col_ind_tmp[len++] =DENSE_COL[i] + (j - begin - DENSE_OFF[i]);
+            }
+            values =values_tmp;
+            col_ind =col_ind_tmp;
+        }
+        if( ckpt_append_row( c, i, values, col_ind, len ) != 0 ) return -1;
+    }
+    return ckpt_commit( c );
+}
+
+/** Row updates of one elimination step that are deferred by the lookahead */
+typedef struct {
+    std::vector<std::pair<indx_t, ssize_t>> rows; // Row and offset of the pivot column
+    char                                    dep;  // Dependence object of the update tasks
+} deferred_t;
+
+/** Runs the updates in @d with pivot row @i as OpenMP tasks. The caller holds
+ *  a read lock on ROW_LOCK, which is released while the tasks are created 
+ *  since the creating thread may execute them right away.
+ */
+static void
+spawn_updates( matrix_t* m, heap_t* heap, indx_t i, int pivot_off, size_t pivot, deferred_t* d ) {
+    pthread_rwlock_unlock( &ROW_LOCK );
+    for( const std::pair<indx_t, ssize_t>& r : d->rows ) {
+        const indx_t k =r.first;
+        const ssize_t o =r.second;
+#pragma omp task firstprivate(k, o) depend(in: d->dep)
+        {
+            double values_tmp[m->n];
+            indx_t col_ind_tmp[m->n];
+            pthread_rwlock_rdlock( &ROW_LOCK );
+            update_row( m, heap, i, pivot_off, pivot, k, o, NULL, true, values_tmp, col_ind_tmp );
+            pthread_rwlock_unlock( &ROW_LOCK );
+        }
+    }
+    d->rows.clear();
+    pthread_rwlock_rdlock( &ROW_LOCK );
+}
+
+/** Waits for (and helps with) the updates spawned from @d, see spawn_updates().
+ */
+static void
+wait_updates( deferred_t* d ) {
+    pthread_rwlock_unlock( &ROW_LOCK );
+#pragma omp taskwait depend(inout: d->dep)
+    pthread_rwlock_rdlock( &ROW_LOCK );
+}
+
+/** Performs the elimination steps @begin..@end-1 on @m using partial pivotting.
+ *  Only the rows at positions below @e->row_end are searched and updated.
+ *  The rows from @e->search_end on are deferred: they are only chosen as pivot
+ *  row if the best pivot among the other rows is smaller than 
+ *  DEFER_PIVOT_THRESHOLD times theirs.
+ *  If @e->drop is not NULL, small elements are dropped and the number of
+ *  elements per row is capped as described by ilut().
+ *  If @e->perturb is positive, the row at position ii is always used as
+ *  pivot row at step ii, and pivots smaller than @e->perturb are replaced.
+ *  If @e->concurrent is set, other threads may eliminate disjoint row ranges 
+ *  at the same time and the caller must hold a read lock on ROW_LOCK.
+ *  If @e->ooc is not NULL, the pivot row is offloaded after each step. The
+ *  elimination then stops with -1 if a row cannot be offloaded or does not
+ *  fit in the heap (see lup_ooc()); otherwise 0 is returned.
+ *  If @e->lookahead is set, the caller is the single thread of an OpenMP 
+ *  parallel region and holds a read lock on ROW_LOCK. Rows that neither have 
+ *  nor obtain an element in the next pivot column are then updated by tasks,
+ *  while the next pivot is searched and its rows are updated. The tasks of 
+ *  step ii are completed before step ii+2 starts, since the next step neither
+ *  reads nor writes their rows.
+ *  If @e->dense_rows is positive, the updated rows may be stored as dense
+ *  segments (see update_hybrid()); they are returned to CRS form at the end.
+ *  This is not combined with the other options.
+ *  If @e->ckpt is not NULL, a checkpoint is written before each step once its
+ *  interval has passed; it is reset to NULL if writing fails.
+ */
+static int
+eliminate( matrix_t* m, heap_t* heap, size_t begin, size_t end, elim_t* e ) {
+
+    double values_tmp[m->n];
+    indx_t col_ind_tmp[m->n];
+    const drop_t* drop =e->drop;
+    const bool concurrent =e->concurrent;
+    deferred_t* deferred =e->lookahead ? new deferred_t[2] : NULL;
+    // One more than the step in which each row was last deferred, -1 if it
+    // never was. The rows deferred in the previous step may be stored by a
+    // task at any moment and are skipped; they cannot hold the pivot column
+    std::vector<size_t> deferred_in( deferred ? m->m : 0, (size_t)-1 );
+    int percent =-1;
+    for( size_t kk =begin; kk < e->row_end; kk++ ) DENSE_COL[m->row_order[kk]] =-1;
+
+    for( size_t pivot =begin; pivot < end; pivot++ ) {
         const size_t ii =pivot; // For readability;
 
         // Print a progress indicator
-        printf( "\b\b\b\b%3d%%", (pivot * 100) / m->m );
+        if( !concurrent || deferred ) print_progress( pivot, m->m, &percent );
+
+        if( deferred ) wait_updates( &deferred[pivot % 2] );
+        if( e->trace && pivot % e->trace->interval == 0 ) heap_trace_sample( e->trace, heap, pivot );
+        if( e->ckpt && pivot > begin && ckpt_due( e->ckpt )
+         && write_checkpoint( m, e->ckpt, pivot, values_tmp, col_ind_tmp ) != 0 ) {
+            fprintf( stderr, "(e) Checkpoints are disabled for the rest of the factorisation.\n" );
+            e->ckpt =NULL;
+        }
 
         int pivot_off =-1; // Location of the pivot in the source row
         int best_row =-1;
-        int best_length =-1;
         double abs_max =-1.0;
-        // Iterate over all remaining rows (partial pivotting)
-        for( size_t kk =pivot; kk < m->m; kk++ ) {
-            const indx_t k =m->row_order[kk];
-            double x;
-            
-            // Find the pivot column in the source row
-            ssize_t j = column_offset( &m->col_ind[m->row_ptr_begin[k]],
-                                       (m->row_ptr_end[k] - m->row_ptr_begin[k]) + 1,
+
+        if( e->perturb > 0.0 ) {
+            // Static pivotting, the diagonal element is perturbed if it is too small
+            const indx_t i =m->row_order[ii];
+            ssize_t j = column_offset( &m->col_ind[m->row_ptr_begin[i]],
+                                       (m->row_ptr_end[i] - m->row_ptr_begin[i]) + 1,
                                        pivot );
-            if( j == -1 ) continue;
-            j += m->row_ptr_begin[k];
+            if( j == -1 ) {
+                insert_pivot( m, heap, ii, e->perturb, concurrent );
+                j = column_offset( &m->col_ind[m->row_ptr_begin[i]],
+                                   (m->row_ptr_end[i] - m->row_ptr_begin[i]) + 1,
+                                   pivot );
+                e->n_perturbed++;
+            } else if( fabs( m->values[m->row_ptr_begin[i] + j] ) < e->perturb ) {
+                double* p =&m->values[m->row_ptr_begin[i] + j];
+                *p =copysign( e->perturb, *p );
+                e->n_perturbed++;
+            }
+            pivot_off =j;
+            best_row =ii;
+        } else {
+            // Iterate over all remaining rows (partial pivotting)
+            const size_t search_end =std::max( std::min( e->search_end, e->row_end ), pivot );
+            for( size_t kk =pivot; kk < search_end; kk++ ) {
+                const indx_t k =m->row_order[kk];
+                if( deferred && deferred_in[k] == pivot ) continue;
+                double x;
+            
+                // Find the pivot column in the source row
+                ssize_t j = find_column( m, k, pivot );
+                if( j == -1 ) continue;
+                j += m->row_ptr_begin[k];
 
-            x =fabs( m->values[j] );
-            abs_max = fmax( abs_max, x );
+                x =fabs( m->values[j] );
+                abs_max = fmax( abs_max, x );
 
-            if( x >= abs_max ) {
-                pivot_off =j - m->row_ptr_begin[k];
-                best_row =kk;
-                best_length =m->row_ptr_end[k] - m->row_ptr_begin[k] + 1;
+                if( x >= abs_max ) {
+                    pivot_off =j - m->row_ptr_begin[k];
+                    best_row =kk;
+                }
+            }
+
+            // Deferred (long) rows are binary searched, and only used as pivot
+            // row if the best pivot of the other rows is too small in comparison
+            for( size_t kk =search_end; kk < e->row_end; kk++ ) {
+                const indx_t k =m->row_order[kk];
+                if( deferred && deferred_in[k] == pivot ) continue;
+                const indx_t* begin =&m->col_ind[m->row_ptr_begin[k]];
+                const indx_t* end =&m->col_ind[m->row_ptr_end[k]] + 1;
+                const indx_t* col =std::lower_bound( begin, end, (indx_t)pivot );
+                if( col == end || *col != pivot ) continue;
+
+                const double x =fabs( m->values[m->row_ptr_begin[k] + (col - begin)] );
+                if( x * DEFER_PIVOT_THRESHOLD > abs_max ) {
+                    abs_max =x / DEFER_PIVOT_THRESHOLD;
+                    pivot_off =col - begin;
+                    best_row =kk;
+                }
             }
         }
-        if( pivot_off == -1 ) continue; // Complete column is empty
+        if( pivot_off == -1 ) { // Complete column is empty
+            if( drop ) insert_pivot( m, heap, ii, drop->row_norm[m->row_order[ii]], concurrent );
+            if( e->ooc && offload_row( m, heap, e->ooc, ii ) != 0 ) return -1;
+            continue; 
+        }
         
         swap_rows( m->row_order, ii, best_row );
         const indx_t i =m->row_order[ii];
 
-        // Iterate over rows ii+1..m
-        for( size_t kk =ii+1; kk < m->m; kk++ ) {
+        if( drop ) {
+            // Replace pivots that became too small by dropping 
+            double* p =&m->values[m->row_ptr_begin[i] + pivot_off];
+            const double min_pivot =drop->tau * drop->row_norm[i];
+            if( fabs( *p ) < min_pivot ) *p =copysign( min_pivot, *p );
+        }
+
+        // Iterate over rows ii+1..m. With lookahead, only the rows that will hold 
+        // the next pivot column are updated right away
+        const bool next_in_pivot_row =m->row_ptr_begin[i] + pivot_off < m->row_ptr_end[i]
+                                   && m->col_ind[m->row_ptr_begin[i] + pivot_off + 1] == pivot + 1;
+        for( size_t kk =ii+1; kk < e->row_end; kk++ ) {
             const indx_t k =m->row_order[kk];
+            if( deferred && deferred_in[k] == pivot ) continue;
 
             // Find the pivot column in the dest row
-            indx_t i_off = m->row_ptr_begin[i] + pivot_off, k_off = m->row_ptr_begin[k];
-            double mult;
-            
-            // Find the pivot column in the dest row
-            ssize_t o = column_offset( &m->col_ind[m->row_ptr_begin[k]],
-                                       (m->row_ptr_end[k] - m->row_ptr_begin[k]) + 1,
-                                       pivot );
+            ssize_t o = find_column( m, k, pivot );
             if( o == -1 ) continue; // Pivot column is empty
 
-            memcpy( values_tmp, &m->values[k_off], o * sizeof(double) );
-            memcpy( col_ind_tmp, &m->col_ind[k_off], o * sizeof(indx_t) );
+            if( deferred && !next_in_pivot_row ) {
+                const indx_t next =m->row_ptr_begin[k] + o + 1;
+                if( next > m->row_ptr_end[k] || m->col_ind[next] != pivot + 1 ) {
+                    deferred[pivot % 2].rows.push_back( std::make_pair( k, o ) );
+                    deferred_in[k] =pivot + 1;
+                    continue;
+                }
+            }
+
+            if( e->ckpt ) e->ckpt->dirty[k] =1;
+            if( e->dense_rows > 0.0 )
+                update_hybrid( m, heap, i, pivot_off, pivot, k, o, e->dense_rows, values_tmp, col_ind_tmp );
+            else
+                update_row( m, heap, i, pivot_off, pivot, k, o, drop, concurrent, values_tmp, col_ind_tmp );
+            if( e->ooc && ROW_ALLOC_FAILED ) return -1;
+        }
+        if( deferred ) spawn_updates( m, heap, i, pivot_off, pivot, &deferred[pivot % 2] );
+
+        if( e->ooc && offload_row( m, heap, e->ooc, ii ) != 0 ) return -1;
+    }
+
+    if( deferred ) {
+        wait_updates( &deferred[0] );
+        wait_updates( &deferred[1] );
+        delete[] deferred;
+    }
+    if( e->trace ) heap_trace_sample( e->trace, heap, end );
+    if( e->dense_rows > 0.0 ) sparsify_rows( m, begin, e->row_end );
+    return 0;
+}
+
+/** Computes the LU-factorisation with partial pivotting.
+ *  The input matrix is provided in CRS form in the five arrays,
+ *  these arrays are modified to contain both the L and U matrix on return.
+ *  If @trace is not NULL, the state of the heap is appended to it every
+ *  @trace->interval steps and after the last step. Rows that fill up are
+ *  stored as dense segments during the elimination, see lup_set_dense_rows().
+ *  If @checkpoint is not NULL, a checkpoint is written to @checkpoint->path
+ *  every @checkpoint->interval seconds and after the last step, and with
+ *  @checkpoint->resume the factorisation continues from the checkpoint in
+ *  that file if it holds one of the same input.
+ *  This function is not reentrant.
+ */
+int
+lup( matrix_t* m, heap_trace_t* trace, const lup_checkpoint_t* checkpoint ) {
+
+    ckpt_t ckpt;
+    size_t begin =0;
+    if( checkpoint ) {
+        if( ckpt_open( &ckpt, checkpoint->path, checkpoint->interval, m ) != 0 ) return -1;
+        if( checkpoint->resume ) {
+            const int ret =ckpt_restore( &ckpt, m, &begin );
+            if( ret == -1 ) {
+                ckpt_close( &ckpt );
+                return -1;
+            }
+            // The restored rows are in CRS form
+            if( ret == 0 ) std::fill( DENSE_COL, DENSE_COL + m->m, -1 );
+        }
+    }
+    
+    // We prepare memory management using the meta array functions defined in heap.h
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+//    heap_debugPrint( &heap );
 
-            k_off += o;
-            mult = m->values[k_off] / m->values[i_off]; // Calculate the multiplication factor
-            values_tmp[o] = mult; // Store the multiplier; it is part of the L matrix
-            col_ind_tmp[o] = pivot;
+    // Iterate all rows except the last
+    elim_t e ={ m->m, m->m, NULL, false, 0.0, 0 };
+    e.trace =trace;
+    e.dense_rows =DENSE_ROWS;
+    e.ckpt =checkpoint ? &ckpt : NULL;
+    eliminate( m, &heap, begin, m->m-1, &e );
+    if( checkpoint ) {
+        // The factors themselves, a resumed run has nothing left to eliminate
+        double values_tmp[m->n];
+        indx_t col_ind_tmp[m->n];
+        if( e.ckpt && write_checkpoint( m, e.ckpt, m->m-1, values_tmp, col_ind_tmp ) != 0 )
+            fprintf( stderr, "(e) lup(): the final checkpoint could not be written to '%s'.\n",
+                     checkpoint->path );
+        ckpt_close( &ckpt );
+    }
+    return 0;
+}
 
-            i_off++; k_off++; o++;// Skip the pivot element
+/** Computes the LU-factorisation like lup(), but appends each finished row of
+ *  L and U to the file-backed store @o instead of keeping it in @m. Only the
+ *  first @mem_cap elements of @m->values and @m->col_ind are used, so the
+ *  active submatrix has to fit in them. The factors are solved with 
+ *  ooc_l_subst() and ooc_u_subst() after ooc_finish(); the rows of @m are
+ *  invalid on return, @m->row_order and @m->count remain valid.
+ *  Returns -1 if the active submatrix outgrows @mem_cap or a row cannot be
+ *  written to @o.
+ *  This function is not reentrant.
+ */
+int
+lup_ooc( matrix_t* m, ooc_t* o, size_t mem_cap ) {
 
-            // Substract mult*i from row k using the intermediate buffer array
-            for( indx_t jj =pivot+1; jj < m->n; jj++ ) { // Iterate over columns pivot+1..n
-                double i_val =0.0, k_val =0.0;
+    mem_cap =std::min( mem_cap, (size_t)MAX_N_ELEMENTS );
+    if( m->count > mem_cap ) {
+        fprintf( stderr, "(e) lup_ooc(): the matrix (%ld elements) does not fit in the memory cap (%ld elements).\n",
+                 m->count, mem_cap );
+        return -1;
+    }
+    heap_t heap;
+    prepare_heap( m, &heap, mem_cap );
 
-                if( m->col_ind[i_off] == jj && i_off <= m->row_ptr_end[i] ) {
-                    i_val =m->values[i_off++];
-                }
-                if( m->col_ind[k_off] == jj && k_off <= m->row_ptr_end[k] ) {
-                    k_val =m->values[k_off++];
-                }
+    // The last step only offloads the last row
+    elim_t e ={ m->m, m->m, NULL, false, 0.0, 0, o };
+    ROW_ALLOC_MAY_FAIL =true;
+    ROW_ALLOC_FAILED =0;
+    const int ret =eliminate( m, &heap, 0, m->m, &e );
+    ROW_ALLOC_MAY_FAIL =false;
+    if( ret != 0 ) {
+        if( ROW_ALLOC_FAILED ) {
+            heap_stats_t s;
+            heap_stats( &heap, &s );
+            fprintf( stderr, "(e) lup_ooc(): the active submatrix needs at least %ld elements, more than the memory cap (%ld elements).\n",
+                     s.live + ROW_ALLOC_FAILED, mem_cap );
+        }
+        return -1;
+    }
+    return ooc_finish( o );
+}
+
+/** Computes the same factorisation as lup(), but pipelines the elimination
+ *  steps: the rows that hold the next pivot column are updated first, so the
+ *  next pivot can be selected while the other rows of the current step are 
+ *  updated by other threads, see eliminate().
+ *  This function is not reentrant.
+ */
+int
+lup_lookahead( matrix_t* m ) {
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+    init_row_lock();
+
+    elim_t e ={ m->m, m->m, NULL, true, 0.0, 0, NULL, true };
+#pragma omp parallel
+#pragma omp single
+    {
+        pthread_rwlock_rdlock( &ROW_LOCK );
+        eliminate( m, &heap, 0, m->m-1, &e );
+        pthread_rwlock_unlock( &ROW_LOCK );
+    }
+
+    pthread_rwlock_destroy( &ROW_LOCK );
+    return 0;
+}
+
+/** Returns the largest magnitude of the elements of @m.
+ */
+static double
+norm_max( const matrix_t* m ) {
+    double norm =0.0;
+    for( size_t i =0; i < m->m; i++ )
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            norm =fmax( norm, fabs( m->values[j] ) );
+    return norm;
+}
+
+/** Computes the LU-factorisation without row interchanges, the pivot of step 
+ *  ii is the element in column ii of the row at position ii. This requires 
+ *  the large elements to be permuted onto the diagonal beforehand, see mc64.h.
+ *  Pivots smaller than @perturb times the largest element of @m (absent ones
+ *  included) are replaced by that value, with their sign. Returns the number
+ *  of perturbed pivots.
+ *  This function is not reentrant.
+ */
+size_t
+lup_static( matrix_t* m, double perturb ) {
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    // The last row has to be checked for a small pivot as well
+    elim_t e ={ m->m, m->m, NULL, false, perturb * norm_max( m ), 0 };
+    eliminate( m, &heap, 0, m->m, &e );
+    return e.n_perturbed;
+}
+
+/** Shared state of the row tasks of lup_tree() */
+typedef struct {
+    matrix_t*           m;
+    heap_t*             heap;
+    double              perturb;
+    bool                concurrent;
+    std::atomic<size_t> n_perturbed;
+} row_task_t;
+
+/** Computes the row at position @ii of L and U from the finished rows above it
+ *  (left-looking): the columns jj < ii of the row are eliminated in increasing
+ *  order using the U part of the row at position jj. Only descendants of ii in
+ *  the elimination tree are read, and only row ii is written.
+ */
+static void
+factor_row( size_t ii, void* user ) {
+    row_task_t* t =(row_task_t*)user;
+    matrix_t* m =t->m;
+    const indx_t i =m->row_order[ii];
+
+    // Dense accumulator of the row, the pattern is tracked separately
+    static thread_local std::vector<double> w;
+    static thread_local std::vector<char> mark;
+    if( w.size() < m->n ) {
+        w.resize( m->n );
+        mark.resize( m->n, 0 );
+    }
+    std::vector<indx_t> pattern;
+    std::priority_queue<indx_t, std::vector<indx_t>, std::greater<indx_t>> lower;
 
-                double val =k_val - i_val * mult;
-                if( val != 0.0 ) {
-                    values_tmp[o] = val;
-                    col_ind_tmp[o] = jj;
-                    o++;
+    if( t->concurrent ) pthread_rwlock_rdlock( &ROW_LOCK );
+
+    for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+        const indx_t jj =m->col_ind[j];
+        w[jj] =m->values[j];
+        mark[jj] =1;
+        pattern.push_back( jj );
+        if( jj < ii ) lower.push( jj );
+    }
+
+    while( !lower.empty() ) {
+        const indx_t kk =lower.top();
+        lower.pop();
+        if( w[kk] == 0.0 ) continue; // Cancelled, nothing to eliminate
+        const indx_t k =m->row_order[kk];
+        const indx_t* begin =&m->col_ind[m->row_ptr_begin[k]];
+        const indx_t* end =&m->col_ind[m->row_ptr_end[k]] + 1;
+        const indx_t d =m->row_ptr_begin[k] + (std::lower_bound( begin, end, kk ) - begin);
+
+        const double mult =w[kk] / m->values[d];
+        w[kk] =mult; // Part of the L matrix
+        for( indx_t j =d+1; j <= m->row_ptr_end[k]; j++ ) {
+            const indx_t jj =m->col_ind[j];
+            if( !mark[jj] ) {
+                w[jj] =0.0;
+                mark[jj] =1;
+                pattern.push_back( jj );
+                if( jj < ii ) lower.push( jj );
+            }
+            w[jj] -= mult * m->values[j];
+        }
+    }
+
+    // Static pivot, perturbed if too small
+    if( !mark[ii] ) {
+        w[ii] =0.0;
+        mark[ii] =1;
+        pattern.push_back( ii );
+    }
+    if( fabs( w[ii] ) < t->perturb ) {
+        w[ii] =copysign( t->perturb, w[ii] );
+        t->n_perturbed++;
+    }
+
+    std::sort( pattern.begin(), pattern.end() );
+    double values_tmp[pattern.size()];
+    indx_t col_ind_tmp[pattern.size()];
+    size_t o =0;
+    for( indx_t jj : pattern ) {
+        if( w[jj] != 0.0 ) {
+            values_tmp[o] =w[jj];
+            col_ind_tmp[o++] =jj;
+        }
+        mark[jj] =0;
+    }
+    store_row( m, values_tmp, col_ind_tmp, o, i, t->heap, t->concurrent );
+
+    if( t->concurrent ) pthread_rwlock_unlock( &ROW_LOCK );
+}
+
+/** Computes the same factorisation as lup_static(), but row by row along the
+ *  elimination tree @tree of @m + @m^T, see etree_compute(): the rows of 
+ *  independent subtrees are factored concurrently by the workers of sched_tree(). 
+ *  Returns the number of perturbed pivots.
+ *  This function is not reentrant.
+ */
+size_t
+lup_tree( matrix_t* m, const etree_t* tree, double perturb ) {
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    const size_t n_threads =omp_get_max_threads();
+    row_task_t t;
+    t.m =m;
+    t.heap =&heap;
+    t.perturb =perturb * norm_max( m );
+    t.concurrent =n_threads > 1;
+    t.n_perturbed =0;
+    if( t.concurrent ) init_row_lock();
+
+    sched_tree( tree->parent, m->m, n_threads, factor_row, &t );
+
+    if( t.concurrent ) pthread_rwlock_destroy( &ROW_LOCK );
+    return t.n_perturbed;
+}
+
+/** Shared state of the row tasks of cholesky() */
+typedef struct {
+    matrix_t*         m;
+    heap_t*           heap;
+    const etree_t*    tree;
+    bool              concurrent;
+    std::atomic<bool> failed;
+} chol_task_t;
+
+/** Computes row @ii of the Cholesky factor L from the finished rows before it
+ *  (up-looking): the pattern of the row is the set of elimination tree paths
+ *  from its elements towards @ii, and element j is the solution of row j of 
+ *  L times the row so far. Only descendants of @ii are read.
+ */
+static void
+cholesky_row( size_t ii, void* user ) {
+    chol_task_t* t =(chol_task_t*)user;
+    matrix_t* m =t->m;
+    if( t->failed ) return;
+
+    static thread_local std::vector<double> w;
+    static thread_local std::vector<char> mark;
+    if( w.size() < m->n ) {
+        w.resize( m->n, 0.0 );
+        mark.resize( m->n, 0 );
+    }
+    std::vector<indx_t> pattern;
+
+    if( t->concurrent ) pthread_rwlock_rdlock( &ROW_LOCK );
+
+    double diag =0.0;
+    for( indx_t j =m->row_ptr_begin[ii]; j <= m->row_ptr_end[ii]; j++ ) {
+        sindx_t jj =m->col_ind[j];
+        if( jj == (sindx_t)ii ) { diag =m->values[j]; continue; }
+        w[jj] =m->values[j];
+        // Climb the tree until a visited node, all paths end in ii
+        for( ; jj != (sindx_t)ii && !mark[jj]; jj =t->tree->parent[jj] ) {
+            mark[jj] =1;
+            pattern.push_back( jj );
+        }
+    }
+    std::sort( pattern.begin(), pattern.end() );
+
+    for( indx_t jj : pattern ) {
+        double sum =w[jj];
+        for( indx_t j =m->row_ptr_begin[jj]; j < m->row_ptr_end[jj]; j++ )
+            sum -= m->values[j] * w[m->col_ind[j]];
+        w[jj] =sum / m->values[m->row_ptr_end[jj]];
+        diag -= w[jj] * w[jj];
+    }
+    if( diag <= 0.0 ) t->failed =true; // Not positive definite
+
+    double values_tmp[pattern.size()+1];
+    indx_t col_ind_tmp[pattern.size()+1];
+    size_t o =0;
+    for( indx_t jj : pattern ) {
+        values_tmp[o] =w[jj];
+        col_ind_tmp[o++] =jj;
+        w[jj] =0.0;
+        mark[jj] =0;
+    }
+    values_tmp[o] =sqrt( fmax( diag, 0.0 ) );
+    col_ind_tmp[o++] =ii;
+    store_row( m, values_tmp, col_ind_tmp, o, ii, t->heap, t->concurrent );
+
+    if( t->concurrent ) pthread_rwlock_unlock( &ROW_LOCK );
+}
+
+/** Computes the Cholesky factorisation A = L L^T of the symmetric matrix of 
+ *  which @m holds the lower triangle in natural order, see sym.h. The rows are
+ *  computed along the elimination tree @tree of @m, see etree_compute(), the
+ *  rows of independent subtrees concurrently. Returns -1 if A turns out not to
+ *  be positive definite, in which case @m is invalid.
+ *  This function is not reentrant.
+ */
+int
+cholesky( matrix_t* m, const etree_t* tree, sym_t* s ) {
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    const size_t n_threads =omp_get_max_threads();
+    chol_task_t t;
+    t.m =m;
+    t.heap =&heap;
+    t.tree =tree;
+    t.concurrent =n_threads > 1;
+    t.failed =false;
+    if( t.concurrent ) init_row_lock();
+
+    sched_tree( tree->parent, m->m, n_threads, cholesky_row, &t );
+
+    if( t.concurrent ) pthread_rwlock_destroy( &ROW_LOCK );
+    s->cholesky =true;
+    return t.failed ? -1 : 0;
+}
+
+/** Computes P A P^T = L D L^T for the symmetric (indefinite) matrix of which 
+ *  @m holds the lower triangle in natural order, see sym.h. The pivots are 
+ *  chosen using the Bunch-Kaufman strategy: the next index in natural order is
+ *  the 1x1 pivot unless its column has a much larger element, in which case 
+ *  that element's diagonal or the 2x2 block of both indices is used. The 
+ *  active submatrix is kept as a lower triangle by original index, such that 
+ *  each update is only applied once. Returns -1 if A is singular.
+ *  This function is not reentrant.
+ */
+int
+ldlt( matrix_t* m, sym_t* s ) {
+    const size_t n =m->m;
+    const double alpha =(1.0 + sqrt( 17.0 )) / 8.0;
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    // Rows i below the diagonal of each column j, i.e. the upper part of row j
+    std::vector<std::vector<indx_t>> below( n );
+    for( size_t i =0; i < n; i++ )
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( m->col_ind[j] < i ) below[m->col_ind[j]].push_back( i );
+
+    std::vector<char> done( n, 0 );
+    // Offset of the first column of each row that is not eliminated yet. All
+    // columns before next are, so a row holds column next at this offset
+    std::vector<indx_t> first_active( n, 0 );
+    double values_tmp[n];
+    indx_t col_ind_tmp[n];
+    size_t next =0;
+
+    // Gathers the active elements (i,p), i != p, of column p sorted by i, and
+    // returns the diagonal element
+    typedef std::vector<std::pair<indx_t,double>> column_t;
+    auto gather_column =[&]( indx_t p, column_t& c ) {
+        double diag =0.0;
+        c.clear();
+        for( indx_t j =m->row_ptr_begin[p]; j <= m->row_ptr_end[p]; j++ ) {
+            const indx_t q =m->col_ind[j];
+            if( q == p ) diag =m->values[j];
+            else if( q < p && !done[q] ) c.push_back( std::make_pair( q, m->values[j] ) );
+        }
+        for( indx_t i : below[p] ) {
+            if( done[i] ) continue;
+            indx_t off =first_active[i];
+            if( p != next ) {
+                // Only the other column of a 2x2 or swapped pivot is searched
+                const indx_t* begin =&m->col_ind[m->row_ptr_begin[i]];
+                const indx_t* end =&m->col_ind[m->row_ptr_end[i]] + 1;
+                off =std::lower_bound( begin + off, end, p ) - begin;
+            }
+            c.push_back( std::make_pair( i, m->values[m->row_ptr_begin[i] + off] ) );
+        }
+        std::sort( c.begin(), c.end() );
+        return diag;
+    };
+    auto max_offdiag =[]( const column_t& c, indx_t* arg ) {
+        double max =0.0;
+        for( auto& e : c )
+            if( fabs( e.second ) > max ) { max =fabs( e.second ); *arg =e.first; }
+        return max;
+    };
+
+    // Column of the pivot block: index, element(s) in the pivot column(s) and multiplier(s)
+    typedef struct { indx_t i; double a[2]; double l[2]; } entry_t;
+    std::vector<entry_t> block;
+    column_t cp, cr;
+    int percent =-1;
+
+    for( size_t ii =0; ii < n; ) {
+        print_progress( ii, n, &percent );
+
+        while( done[next] ) next++;
+        indx_t p =next, r =next;
+        double app =gather_column( p, cp );
+        const double lambda =max_offdiag( cp, &r );
+        double arr =0.0, apr =0.0;
+        int size =1;
+
+        if( lambda == 0.0 && app == 0.0 ) {
+            fprintf( stderr, "(e) ldlt(): matrix is singular in column %ld.\n", p );
+            return -1;
+        }
+        if( fabs( app ) < alpha * lambda ) {
+            arr =gather_column( r, cr );
+            indx_t t;
+            const double sigma =max_offdiag( cr, &t );
+            if( fabs( app ) * sigma >= alpha * lambda * lambda ) {
+                // 1x1 pivot p is good enough
+            } else if( fabs( arr ) >= alpha * sigma ) {
+                p =r; // 1x1 pivot r
+                app =arr;
+                cp.swap( cr );
+            } else {
+                size =2; // 2x2 pivot of p and r
+            }
+        }
+
+        // Multipliers of the rows in the pivot column(s)
+        block.clear();
+        if( size == 1 ) {
+            for( auto& e : cp ) block.push_back( { e.first, { e.second, 0.0 }, { e.second / app, 0.0 } } );
+        } else {
+            // Merge both columns, skipping the block itself
+            size_t a =0, b =0;
+            while( a < cp.size() || b < cr.size() ) {
+                entry_t e ={ 0, { 0.0, 0.0 }, { 0.0, 0.0 } };
+                if( b == cr.size() || ( a < cp.size() && cp[a].first < cr[b].first ) ) {
+                    e.i =cp[a].first; e.a[0] =cp[a++].second;
+                } else if( a == cp.size() || cr[b].first < cp[a].first ) {
+                    e.i =cr[b].first; e.a[1] =cr[b++].second;
+                } else {
+                    e.i =cp[a].first; e.a[0] =cp[a++].second; e.a[1] =cr[b++].second;
                 }
+                if( e.i == r ) { apr =e.a[0]; continue; }
+                if( e.i == p ) continue;
+                block.push_back( e );
+            }
+            const double det =app * arr - apr * apr;
+            for( auto& e : block ) {
+                e.l[0] =( e.a[0] * arr - e.a[1] * apr ) / det;
+                e.l[1] =( e.a[1] * app - e.a[0] * apr ) / det;
+            }
+        }
 
+        // Rank-1 or rank-2 update of the lower triangle of the active submatrix:
+        // each row is merged with the updates of its columns f.i <= i, and its 
+        // elements in the pivot column(s) are replaced by the multipliers
+        const indx_t piv[2] ={ p, r };
+        for( const entry_t& e : block ) {
+            const indx_t i =e.i;
+            const indx_t end =m->row_ptr_end[i];
+            indx_t j =m->row_ptr_begin[i];
+            size_t f =0, b =0, o =0;
+            first_active[i] =-1;
+            while( true ) {
+                const indx_t ca =j <= end ? m->col_ind[j] : n;
+                const indx_t cf =f < block.size() && block[f].i <= i ? block[f].i : n;
+                const indx_t cb =(int)b < size ? piv[b] : n;
+                const indx_t col =std::min( ca, std::min( cf, cb ) );
+                if( col == n ) break;
+                double value =0.0;
+                if( ca == col ) value =m->values[j++];
+                else if( cf == col && col < i ) below[col].push_back( i ); // Fill
+                if( cb == col ) value =e.l[b++];
+                else if( cf == col ) value -= e.l[0] * block[f].a[0] + e.l[1] * block[f].a[1];
+                if( cf == col ) f++;
+                if( first_active[i] == (indx_t)-1 && cb != col && !done[col] ) first_active[i] =o;
+                values_tmp[o] =value;
+                col_ind_tmp[o++] =col;
             }
+            store_row( m, values_tmp, col_ind_tmp, o, i, &heap, false );
+        }
 
-            m->count += replace_row( m,
-                                     values_tmp,
-                                     col_ind_tmp,
-                                     o,     // Number of non-zeroes in the dest row
-                                     k,     // Row number of the dest row
-                                     &heap );
+        // Only the multipliers of earlier pivots and the diagonal of D remain
+        // in the pivot row(s), such that no row becomes empty
+        const double piv_diag[2] ={ app, arr };
+        for( int b =0; b < size; b++ ) {
+            const indx_t k =piv[b];
+            size_t o =0;
+            bool diag =false;
+            for( indx_t j =m->row_ptr_begin[k]; j <= m->row_ptr_end[k]; j++ ) {
+                const indx_t q =m->col_ind[j];
+                if( q > k && !diag ) {
+                    values_tmp[o] =piv_diag[b];
+                    col_ind_tmp[o++] =k;
+                    diag =true;
+                }
+                if( done[q] ) {
+                    values_tmp[o] =m->values[j];
+                    col_ind_tmp[o++] =q;
+                }
+            }
+            if( !diag ) {
+                values_tmp[o] =piv_diag[b];
+                col_ind_tmp[o++] =k;
+            }
+            store_row( m, values_tmp, col_ind_tmp, o, k, &heap, false );
+        }
 
+        s->perm[ii] =p;
+        s->diag[ii] =app;
+        s->off[ii] =0.0;
+        done[p] =1;
+        if( size == 1 ) {
+            if( app < 0.0 ) s->n_negative++;
+        } else {
+            const double det =app * arr - apr * apr;
+            s->perm[ii+1] =r;
+            s->diag[ii+1] =arr;
+            s->off[ii] =apr;
+            s->off[ii+1] =0.0;
+            s->n_2x2++;
+            s->n_negative += det < 0.0 ? 1 : ( app < 0.0 ? 2 : 0 );
+            done[r] =1;
         }
+        ii += size;
     }
+    s->cholesky =false;
+    return 0;
+}
+
+/** Computes the LU-factorisation of a block diagonal matrix, of which block b 
+ *  consists of the rows and columns at positions @block_ptr[b]..@block_ptr[b+1]-1.
+ *  Pivots are only searched within each block, so no fill can occur between 
+ *  blocks. The blocks are factored concurrently, largest first.
+ *  This function is not reentrant.
+ */
+int
+lup_blocks( matrix_t* m, const indx_t block_ptr[], size_t n_blocks ) {
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    // Schedule the largest blocks first, singletons need no elimination
+    size_t n_big =0;
+    indx_t* order =(indx_t*)malloc( n_blocks * sizeof(indx_t) );
+    for( size_t b =0; b < n_blocks; b++ )
+        if( block_ptr[b+1] - block_ptr[b] > 1 ) order[n_big++] =b;
+    std::sort( order, order + n_big, [block_ptr]( indx_t a, indx_t b ) {
+        return block_ptr[a+1] - block_ptr[a] > block_ptr[b+1] - block_ptr[b];
+    } );
+
+    const bool concurrent =omp_get_max_threads() > 1 && n_big > 1;
+    if( concurrent ) init_row_lock();
+
+#pragma omp parallel for schedule(dynamic,1) if(concurrent)
+    for( size_t b =0; b < n_big; b++ ) {
+        const indx_t begin =block_ptr[order[b]], end =block_ptr[order[b]+1];
+        if( concurrent ) pthread_rwlock_rdlock( &ROW_LOCK );
+        elim_t e ={ end, end, NULL, concurrent, 0.0, 0 };
+        eliminate( m, &heap, begin, end-1, &e );
+        if( concurrent ) pthread_rwlock_unlock( &ROW_LOCK );
+    }
+
+    if( concurrent ) pthread_rwlock_destroy( &ROW_LOCK );
+    free( order );
+    return 0;
+}
+
+/** Computes an incomplete LU-factorisation with threshold dropping (ILUT).
+ *  Elements smaller than @tau times the norm of their original row are dropped
+ *  from both L and U, and each row keeps at most @fill elements more than it
+ *  originally had in both its L and its U part. The factors are stored like 
+ *  in lup() and can be applied with l_subst() and u_subst().
+ *  This function is not reentrant.
+ */
+int
+ilut( matrix_t* m, double tau, size_t fill ) {
+
+    double row_norm[m->m];
+    size_t row_nnz[m->m];
+    for( size_t i =0; i < m->m; i++ ) {
+        double sum =0.0;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            sum += m->values[j] * m->values[j];
+        row_norm[i] =sqrt( sum );
+        row_nnz[i] =1 + m->row_ptr_end[i] - m->row_ptr_begin[i];
+    }
+    const drop_t drop ={ tau, fill, row_norm, row_nnz };
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    elim_t e ={ m->m, m->m, &drop, false, 0.0, 0 };
+    eliminate( m, &heap, 0, m->m-1, &e );
+    return 0;
+}
+
+/** Factors the trailing block of rows and columns at positions @s..m-1 with
+ *  the dense kernel dense_lu() and stores the result back into @m. The rows
+ *  of the block must have been updated by all pivots before @s.
+ *  Returns the number of zero pivots; @m is left unchanged if there are any.
+ */
+static size_t
+factor_trailing( matrix_t* m, heap_t* heap, size_t s ) {
+    const size_t t =m->m - s;
+    double* a =(double*)calloc( t * t, sizeof(double) );
+    indx_t* perm =(indx_t*)malloc( t * sizeof(indx_t) );
+    indx_t* order =(indx_t*)malloc( t * sizeof(indx_t) );
+    double* values_tmp =(double*)malloc( m->n * sizeof(double) );
+    indx_t* col_ind_tmp =(indx_t*)malloc( m->n * sizeof(indx_t) );
+
+    for( size_t r =0; r < t; r++ ) {
+        const indx_t i =m->row_order[s+r];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( m->col_ind[j] >= s ) a[r*t + m->col_ind[j]-s] =m->values[j];
+    }
+
+    const size_t n_zero =dense_lu( a, t, perm );
+    if( n_zero ) {
+        free( a ); free( perm ); free( order ); free( values_tmp ); free( col_ind_tmp );
+        return n_zero;
+    }
+
+    memcpy( order, &m->row_order[s], t * sizeof(indx_t) );
+    for( size_t r =0; r < t; r++ ) {
+        const indx_t i =order[perm[r]];
+        m->row_order[s+r] =i;
+
+        // Keep the multipliers of the sparse pivots, append the dense row
+        size_t o =0;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i] && m->col_ind[j] < s; j++ ) {
+            values_tmp[o] =m->values[j];
+            col_ind_tmp[o++] =m->col_ind[j];
+        }
+        for( size_t c =0; c < t; c++ ) {
+            if( a[r*t+c] == 0.0 && c != r ) continue;
+            values_tmp[o] =a[r*t+c];
+            col_ind_tmp[o++] =s+c;
+        }
+        m->count += replace_row( m, values_tmp, col_ind_tmp, o, i, heap );
+    }
+
+    free( a ); free( perm ); free( order ); free( values_tmp ); free( col_ind_tmp );
     return 0;
 }
 
+/** Computes the LU-factorisation with partial pivotting, deferring the last 
+ *  @n_dense_rows rows (in row order) and factoring the trailing @n_trailing 
+ *  rows and columns as a dense block. The deferred rows are only used as 
+ *  pivots in the sparse part if the other rows lack a large enough pivot.
+ *  Returns the number of zero pivots in the trailing block; if there are
+ *  any the matrix is singular and @m does not hold usable factors.
+ *  This function is not reentrant.
+ */
+size_t
+lup_deferred( matrix_t* m, size_t n_dense_rows, size_t n_trailing ) {
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    const size_t s =m->m - n_trailing;
+    elim_t e ={ m->m, m->m - n_dense_rows, NULL, false, 0.0, 0 };
+    eliminate( m, &heap, 0, s, &e );
+    if( n_trailing )
+        return factor_trailing( m, &heap, s );
+    return 0;
+}
+
+/** Performs the first @k elimination steps of lup() and stops. The rows at
+ *  positions @k.. then hold the multipliers of L21 left of column @k and the
+ *  Schur complement from column @k on. These rows are only chosen as pivot
+ *  row if the rows at positions below @k lack a large enough pivot, as the
+ *  deferred rows of lup_deferred().
+ *  This function is not reentrant.
+ */
+int
+lup_partial( matrix_t* m, size_t k ) {
+
+    heap_t heap;
+    prepare_heap( m, &heap );
+
+    elim_t e ={ m->m, k, NULL, false, 0.0, 0 };
+    eliminate( m, &heap, 0, k, &e );
+    return 0;
+}
+
+/** Renumbers the columns of @m such that original column @col_perm[jj] 
+ *  becomes column jj, and sorts the rows accordingly.
+ */
+void
+matrix_permute_columns( matrix_t* m, const indx_t col_perm[] ) {
+    indx_t* qinv =(indx_t*)malloc( m->n * sizeof(indx_t) );
+    for( size_t jj =0; jj < m->n; jj++ ) qinv[col_perm[jj]] =jj;
+
+#pragma omp parallel
+    {
+        std::vector< std::pair<indx_t,double> > row;
+#pragma omp for schedule(dynamic,64)
+        for( size_t i =0; i < m->m; i++ ) {
+            row.clear();
+            for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+                row.push_back( std::make_pair( qinv[m->col_ind[j]], m->values[j] ) );
+            std::sort( row.begin(), row.end() );
+            indx_t j =m->row_ptr_begin[i];
+            for( size_t k =0; k < row.size(); k++, j++ ) {
+                m->col_ind[j] =row[k].first;
+                m->values[j] =row[k].second;
+            }
+        }
+    }
+    free( qinv );
+}
+
+/** Copies @src to @dst, storing the rows contiguously in their physical order.
+ */
+void
+matrix_copy( matrix_t* dst, const matrix_t* src ) {
+    indx_t k =0;
+    for( size_t i =0; i < src->m; i++ ) {
+        const size_t len =1 + src->row_ptr_end[i] - src->row_ptr_begin[i];
+        memcpy( &dst->values[k], &src->values[src->row_ptr_begin[i]], len * sizeof(double) );
+        memcpy( &dst->col_ind[k], &src->col_ind[src->row_ptr_begin[i]], len * sizeof(indx_t) );
+        dst->row_ptr_begin[i] =k;
+        dst->row_ptr_end[i] =k + len - 1;
+        k += len;
+    }
+    memcpy( dst->row_order, src->row_order, src->m * sizeof(indx_t) );
+    dst->m =src->m;
+    dst->n =src->n;
+    dst->count =src->count;
+}
+
+/** Returns a copy of @src in a newly allocated matrix, see matrix_copy(), or
+ *  NULL if it does not fit in memory. Release it with free().
+ */
+matrix_t*
+matrix_dup( const matrix_t* src ) {
+    matrix_t* dst =(matrix_t*)malloc( sizeof( matrix_t ) );
+    if( !dst ) {
+        fprintf( stderr, "(e) matrix_dup(): out of memory.\n" );
+        return NULL;
+    }
+    matrix_copy( dst, src );
+    return dst;
+}
+
 /** Computes b in Ax = b using naive (square) matrix multiplication.
+ *  Rows are distributed over the available threads.
  */
 void 
 mult_matvec( double b[],
              matrix_t* m,
              const double x[] ) {
     assert( m->m==m->n );
-    memset( b, 0, m->n * sizeof( double ) );
+#pragma omp parallel for schedule(static)
     for( size_t ii =0; ii < m->m; ii++ ) {
-        indx_t i = m->row_order[ii];
-        for( indx_t j = m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
-            indx_t col = m->col_ind[j];
-            b[ii] += x[col] * m->values[j];
+        const indx_t i = m->row_order[ii];
+        const size_t len =1 + m->row_ptr_end[i] - m->row_ptr_begin[i];
+        b[ii] =SIMD.dot( &m->values[m->row_ptr_begin[i]], &m->col_ind[m->row_ptr_begin[i]], len, x );
+    }
+}
+
+/** Computes b in A^T x = b. The rows of @m are taken in the order of
+ *  @m->row_order, like mult_matvec().
+ */
+void
+mult_matvec_transposed( double b[],
+                        matrix_t* m,
+                        const double x[] ) {
+    assert( m->m==m->n );
+    memset( b, 0, m->n * sizeof(double) );
+    for( size_t ii =0; ii < m->m; ii++ ) {
+        const indx_t i = m->row_order[ii];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            b[m->col_ind[j]] += m->values[j] * x[ii];
+    }
+}
+
+/** Computes B in AX = B for @k vectors in a single pass over the matrix.
+ *  Vector v of X starts at @x + v*@ldx, vector v of B at @b + v*@ldb.
+ */
+void
+mult_matmat( double b[], size_t ldb,
+             matrix_t* m,
+             const double x[], size_t ldx,
+             size_t k ) {
+    assert( m->m==m->n );
+    for( size_t v0 =0; v0 < k; v0 += SPMM_BLOCK ) {
+        const size_t kb = k - v0 < SPMM_BLOCK ? k - v0 : SPMM_BLOCK;
+#pragma omp parallel for schedule(static)
+        for( size_t ii =0; ii < m->m; ii++ ) {
+            const indx_t i = m->row_order[ii];
+            double sum[SPMM_BLOCK] ={ 0.0 };
+            for( indx_t j = m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+                const indx_t col = m->col_ind[j];
+                const double val = m->values[j];
+                for( size_t v =0; v < kb; v++ )
+                    sum[v] += x[(v0+v)*ldx+col] * val;
+            }
+            for( size_t v =0; v < kb; v++ )
+                b[(v0+v)*ldb+ii] =sum[v];
         }
     }
 }
 
+/** Solves A X = B for @k vectors with the factors of lup(), in one pass over
+ *  L and one over U per SPMM_BLOCK vectors. Vector v of B starts at
+ *  @b + v*@ldb, vector v of X at @x + v*@ldx, both in natural order.
+ */
+void
+lu_solve_block( double x[], size_t ldx,
+                matrix_t* m,
+                const double b[], size_t ldb,
+                size_t k ) {
+    assert( m->m==m->n );
+    const size_t n =m->m;
+    // The vectors of a block are interleaved, w + i*SPMM_BLOCK holds row i
+    double* w =(double*)malloc( n * SPMM_BLOCK * sizeof(double) );
+    for( size_t v0 =0; v0 < k; v0 += SPMM_BLOCK ) {
+        const size_t kb = k - v0 < SPMM_BLOCK ? k - v0 : SPMM_BLOCK;
+        for( size_t i =0; i < n; i++ )
+            for( size_t v =0; v < kb; v++ )
+                w[i*SPMM_BLOCK+v] =b[(v0+v)*ldb+i];
+
+        // L c = b
+        for( size_t ii =0; ii < n; ii++ ) {
+            const indx_t i =m->row_order[ii];
+            double* wi =&w[i*SPMM_BLOCK];
+            for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+                const indx_t jj =m->col_ind[j];
+                if( jj >= ii ) break;
+                const double val =m->values[j];
+                const double* wj =&w[m->row_order[jj]*SPMM_BLOCK];
+                for( size_t v =0; v < kb; v++ )
+                    wi[v] -= val * wj[v];
+            }
+        }
+
+        // U x = c
+        for( ssize_t ii =n-1; ii >= 0; ii-- ) {
+            const indx_t i =m->row_order[ii];
+            double* wi =&w[i*SPMM_BLOCK];
+            double d_value =1.0;
+            for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+                const sindx_t jj =m->col_ind[j];
+                if( jj == ii ) {
+                    d_value =m->values[j];
+                    continue;
+                }
+                else if( jj < ii ) continue;
+                const double val =m->values[j];
+                const double* wj =&w[m->row_order[jj]*SPMM_BLOCK];
+                for( size_t v =0; v < kb; v++ )
+                    wi[v] -= val * wj[v];
+            }
+            for( size_t v =0; v < kb; v++ ) {
+                wi[v] /= d_value;
+                if( !isfinite( wi[v] ) ) {
+                    fprintf( stderr, "(e) lu_solve_block: x_%ld[%ld] is not a number!\n", v0+v, ii );
+                    abort();
+                }
+            }
+        }
+
+        for( size_t ii =0; ii < n; ii++ )
+            for( size_t v =0; v < kb; v++ )
+                x[(v0+v)*ldx+ii] =w[m->row_order[ii]*SPMM_BLOCK+v];
+    }
+    free( w );
+}
+
 /** Computes forward substitution of the lower triangular matrix,
  *  i.e. c in Lc = b
  */
@@ -258,18 +1772,19 @@ l_subst( double c[],
     memset( c, 0, m->m * sizeof(double) );
     for( size_t ii =0; ii < m->m; ii++ ) {
         const indx_t i =m->row_order[ii];
-        c[i] = b[i];
-        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
-            const indx_t jj =m->col_ind[j];
-            if( jj >= ii ) break;
-            if( !isfinite( m->values[j] * c[m->row_order[jj]] ) ) {
-                fprintf( stderr, "(e) l_subst: A[%ld,%ld] * c[%ld] is not a number!\n\t%f * %f\n", 
-                        ii, jj, jj, m->values[j], c[m->row_order[jj]] );
-                abort();
-            }
-            c[i] -= m->values[j] * c[m->row_order[jj]];
-        }
+        const indx_t begin =m->row_ptr_begin[i];
+        // The multipliers are the elements left of column ii
+        const size_t len =SIMD.lower_bound( &m->col_ind[begin], 1 + m->row_ptr_end[i] - begin, ii );
+        c[i] = b[i] - SIMD.dot_perm( &m->values[begin], &m->col_ind[begin], len, m->row_order, c );
         if( !isfinite( c[i] ) ) {
+            for( indx_t j =begin; j < begin + len; j++ ) {
+                const indx_t jj =m->col_ind[j];
+                if( !isfinite( m->values[j] * c[m->row_order[jj]] ) ) {
+                    fprintf( stderr, "(e) l_subst: A[%ld,%ld] * c[%ld] is not a number!\n\t%f * %f\n", 
+                            ii, jj, jj, m->values[j], c[m->row_order[jj]] );
+                    abort();
+                }
+            }
             fprintf( stderr, "(e) l_subst: c[%ld] is not a number!\n", i );
             abort();
         }
@@ -288,17 +1803,12 @@ u_subst( double x[],
     memset( x, 0, m->m * sizeof(double) );
     for( ssize_t ii =m->m-1; ii >= 0;  ii-- ) {
         const indx_t i =m->row_order[ii];
+        const indx_t begin =m->row_ptr_begin[i];
+        const size_t len =1 + m->row_ptr_end[i] - begin;
+        size_t u =SIMD.lower_bound( &m->col_ind[begin], len, ii );
         double d_value =1.0;
-        x[i] = c[i];
-        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
-            const sindx_t jj =m->col_ind[j];
-            if( jj == ii ) {
-                d_value =m->values[j];
-                continue;
-            }
-            else if( jj < ii ) continue;
-            x[i] -= m->values[j] * x[m->row_order[jj]];
-        }
+        if( u < len && m->col_ind[begin + u] == (indx_t)ii ) d_value =m->values[begin + u++];
+        x[i] = c[i] - SIMD.dot_perm( &m->values[begin + u], &m->col_ind[begin + u], len - u, m->row_order, x );
         x[i] /= d_value;
         if( !isfinite( x[i] ) ) {
             fprintf( stderr, "(e) u_subst: x[%ld] is not a number!\n", i );
@@ -307,9 +1817,91 @@ u_subst( double x[],
     }
 }
 
+/** Computes forward substitution of the transposed upper triangular matrix,
+ *  i.e. c in U^T c = b. The element jj of c is stored at @m->row_order[jj]
+ *  like in u_subst(), @b is indexed by column.
+ */
+void
+ut_subst( double c[],
+          matrix_t* m,
+          const double b[] ) {
+    assert( m->m==m->n );
+    for( size_t jj =0; jj < m->m; jj++ ) c[m->row_order[jj]] =b[jj];
+    // Row ii of U is column ii of U^T: once c[ii] is known, it is scattered
+    for( size_t ii =0; ii < m->m; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        indx_t j =m->row_ptr_begin[i];
+        while( j <= m->row_ptr_end[i] && m->col_ind[j] < ii ) j++;
+        if( j <= m->row_ptr_end[i] && m->col_ind[j] == ii ) c[i] /= m->values[j++];
+        if( !isfinite( c[i] ) ) {
+            fprintf( stderr, "(e) ut_subst: c[%ld] is not a number!\n", i );
+            abort();
+        }
+        for( ; j <= m->row_ptr_end[i]; j++ )
+            c[m->row_order[m->col_ind[j]]] -= m->values[j] * c[i];
+    }
+}
+
+/** Computes backward substitution of the transposed lower triangular matrix,
+ *  i.e. x in L^T x = c. Since the rows of the factors are permuted, x is the
+ *  solution of A^T x = b in natural order if c was computed by ut_subst().
+ */
+void
+lt_subst( double x[],
+          matrix_t* m,
+          const double c[] ) {
+    assert( m->m==m->n );
+    memcpy( x, c, m->m * sizeof(double) );
+    for( ssize_t ii =m->m-1; ii >= 0; ii-- ) {
+        const indx_t i =m->row_order[ii];
+        if( !isfinite( x[i] ) ) {
+            fprintf( stderr, "(e) lt_subst: x[%ld] is not a number!\n", i );
+            abort();
+        }
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i] && m->col_ind[j] < (indx_t)ii; j++ )
+            x[m->row_order[m->col_ind[j]]] -= m->values[j] * x[i];
+    }
+}
+
+/** Estimates the stability of the factors in @m as the largest element of
+ *  |(LU)^-1 e| with e = (1, ..., 1). Unlike l_subst() and u_subst() this does
+ *  not abort when the substitution overflows, but returns infinity.
+ */
+double
+lu_condest( matrix_t* m ) {
+    double* c =(double*)malloc( 2 * m->m * sizeof(double) );
+    double* x =c + m->m;
+    double est =0.0;
+    for( size_t ii =0; ii < m->m; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        c[i] =1.0;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const indx_t jj =m->col_ind[j];
+            if( jj >= ii ) break;
+            c[i] -= m->values[j] * c[m->row_order[jj]];
+        }
+    }
+    for( ssize_t ii =m->m-1; ii >= 0; ii-- ) {
+        const indx_t i =m->row_order[ii];
+        double d_value =1.0;
+        x[i] =c[i];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const sindx_t jj =m->col_ind[j];
+            if( jj == ii ) d_value =m->values[j];
+            else if( jj > ii ) x[i] -= m->values[j] * x[m->row_order[jj]];
+        }
+        x[i] /= d_value;
+        if( !isfinite( x[i] ) ) { est =INFINITY; break; }
+        est =fmax( est, fabs( x[i] ) );
+    }
+    free( c );
+    return est;
+}
+
 /* Compute the variancy from @ref to @vec using the Euclidian norm.
  * The order of @ref is assumed to be straight while the additional parameter
  * @m->row_order determ->nes the order of elements in @vec.
+ * If @row_order is NULL, @vec is in straight order as well.
  * @m gives the total number of elements in @ref and @vec 
  */
 double
@@ -320,7 +1912,7 @@ compute_variance( const double vec[],
     // We compute sqrt( sum_i( (ref_i - vec_i)^2 ) ) / sqrt( sum_i( ref_i^2 ) )
     double num =0.0, denom =0.0;
     for( size_t ii =0; ii < m; ii++ ) {
-        const indx_t i =row_order[ii];
+        const indx_t i =row_order ? row_order[ii] : ii;
         num +=  pow( ref[ii] - vec[i], 2 );
         denom +=pow( ref[ii], 2 );
     }
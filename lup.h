@@ -3,10 +3,19 @@
 
 #include "matrix.h"
 
+// The storage limits can be raised at build time, e.g. make DEFINES=-DMAX_N_ROWS=262144
+#ifndef MAX_N_ELEMENTS
 #define MAX_N_ELEMENTS 1024 * 1024 * 15 // 120 MiB worth of doubles //131072
+#endif
+#ifndef MAX_N_ROWS
 #define MAX_N_ROWS (1<<14)
+#endif
 #define N_REF_VECTORS 5
-#define HEAP_SIZE (1<<15)
+#define HEAP_SIZE (2 * (MAX_N_ROWS)) // One region per row and the free regions in between
+#define COMPACT_DEFAULT_BUDGET 0 // Elements moved per row allocation by the incremental compaction
+#define COMPACT_MAX_FRAGMENTATION 0.5 // Compact while the largest free region holds less of the free space
+#define DENSE_ROW_DEFAULT_THRESHOLD 0.0 // Fraction of the remaining columns from which lup() stores a row dense, 0 for off
+#define SPMM_BLOCK 8 // Number of vectors per pass in mult_matmat() and lu_solve_block()
 
 typedef struct {
 
@@ -21,14 +30,42 @@ typedef struct {
 
 } matrix_t;
 
+/* Where and how often lup() writes checkpoints, see ckpt.h */
+typedef struct {
+    const char* path;
+    double      interval;       // Seconds between two checkpoints
+    bool        resume;         // Continue from the checkpoint in path if it holds one of the same input
+} lup_checkpoint_t;
+
 void print_dense( matrix_t* m );
 void print_vec( double values[], size_t m, size_t* order );
 
-int lup( matrix_t* m );
+void lup_set_compaction( size_t budget );
+void lup_set_dense_rows( double threshold );
+int lup( matrix_t* m, struct heap_trace_t* trace =NULL, const lup_checkpoint_t* checkpoint =NULL );
+int lup_lookahead( matrix_t* m );
+size_t lup_static( matrix_t* m, double perturb );
+size_t lup_tree( matrix_t* m, const struct etree_t* tree, double perturb );
+size_t lup_deferred( matrix_t* m, size_t n_dense_rows, size_t n_trailing );
+int lup_partial( matrix_t* m, size_t k );
+int lup_blocks( matrix_t* m, const indx_t block_ptr[], size_t n_blocks );
+int lup_ooc( matrix_t* m, struct ooc_t* o, size_t mem_cap );
+int cholesky( matrix_t* m, const struct etree_t* tree, struct sym_t* s );
+int ldlt( matrix_t* m, struct sym_t* s );
+int ilut( matrix_t* m, double tau, size_t fill );
+void matrix_copy( matrix_t* dst, const matrix_t* src );
+matrix_t* matrix_dup( const matrix_t* src );
+void matrix_permute_columns( matrix_t* m, const indx_t col_perm[] );
 
 void mult_matvec( double b[], matrix_t* m, const double x[] );
+void mult_matvec_transposed( double b[], matrix_t* m, const double x[] );
+void mult_matmat( double b[], size_t ldb, matrix_t* m, const double x[], size_t ldx, size_t k );
+void lu_solve_block( double x[], size_t ldx, matrix_t* m, const double b[], size_t ldb, size_t k );
 void l_subst( double c[], matrix_t* m, const double b[] );
 void u_subst( double x[], matrix_t* m, const double c[] );
+void ut_subst( double c[], matrix_t* m, const double b[] );
+void lt_subst( double x[], matrix_t* m, const double c[] );
+double lu_condest( matrix_t* m );
 double compute_variance( const double vec[], const double ref[], const indx_t row_order[], size_t m );
 
 #endif
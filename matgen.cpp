@@ -0,0 +1,319 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <math.h>
+#include <getopt.h>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <omp.h>
+
+#include "matrix.h"
+
+extern "C" {
+#include "mmio.h"
+}
+
+/* Generator of synthetic test matrices, written as Matrix Market (.mtx) or
+ * binary CRS (.crs, see matrix.h). All random choices are derived from the
+ * seed and the row (and column) index, so the output does not depend on the
+ * number of threads.
+ */
+
+typedef std::vector< std::pair<indx_t,double> > row_t;
+
+/* Generator options */
+static struct {
+    size_t   size;              // Rows, or grid points per dimension for the Poisson stencils
+    uint64_t seed;
+    size_t   per_row;           // Random elements per row (random, blockdiag)
+    size_t   width;             // Half bandwidth (banded)
+    double   density;           // Fraction of the band or block that is non-zero
+    double   dominance;         // Diagonal is dominance times the off-diagonal row sum, 0 for random
+    size_t   block;             // Block size (blockdiag)
+    size_t   coupling;          // Elements per row outside the diagonal block (blockdiag)
+    size_t   dense_rows;        // Dense rows and columns (arrowhead)
+    bool     symmetric;         // Write the lower triangle of a symmetric family
+} OPT = { 1000, 1, 10, 5, 1.0, 1.1, 64, 1, 1, false };
+
+/** SplitMix64, used to hash indices into random numbers */
+static inline uint64_t
+mix( uint64_t x ) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x =(x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x =(x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/** Uniform number in [0,1) from the stream @state */
+static inline double
+uniform( uint64_t* state ) {
+    *state =mix( *state );
+    return (*state >> 11) * 0x1.0p-53;
+}
+
+/** Value in [-1,1) of element (i,j), the same for (j,i) */
+static inline double
+element_value( indx_t i, indx_t j ) {
+    uint64_t state =mix( OPT.seed ^ mix( std::min( i, j ) * 0x100000001b3ULL + std::max( i, j ) ) );
+    return 2.0 * uniform( &state ) - 1.0;
+}
+
+/** Random stream of row @i */
+static inline uint64_t
+row_state( indx_t i ) {
+    return mix( OPT.seed * 0x2545f4914f6cdd1dULL + i );
+}
+
+/** Sets the diagonal of @row, see OPT.dominance */
+static void
+set_diagonal( row_t& row, indx_t i ) {
+    double sum =0.0;
+    for( auto& e : row ) sum += fabs( e.second );
+    const double diag =OPT.dominance > 0.0 ? fmax( OPT.dominance * sum, 1.0 ) : element_value( i, i );
+    row.push_back( std::make_pair( i, diag ) );
+}
+
+static void
+poisson2d( row_t& row, indx_t i, size_t n ) {
+    const size_t k =OPT.size;
+    const size_t x =i % k, y =i / k;
+    if( y > 0 )     row.push_back( std::make_pair( i - k, -1.0 ) );
+    if( x > 0 )     row.push_back( std::make_pair( i - 1, -1.0 ) );
+    row.push_back( std::make_pair( i, 4.0 ) );
+    if( x < k - 1 ) row.push_back( std::make_pair( i + 1, -1.0 ) );
+    if( y < k - 1 ) row.push_back( std::make_pair( i + k, -1.0 ) );
+}
+
+static void
+poisson3d( row_t& row, indx_t i, size_t n ) {
+    const size_t k =OPT.size;
+    const size_t x =i % k, y =(i / k) % k, z =i / (k * k);
+    if( z > 0 )     row.push_back( std::make_pair( i - k * k, -1.0 ) );
+    if( y > 0 )     row.push_back( std::make_pair( i - k, -1.0 ) );
+    if( x > 0 )     row.push_back( std::make_pair( i - 1, -1.0 ) );
+    row.push_back( std::make_pair( i, 6.0 ) );
+    if( x < k - 1 ) row.push_back( std::make_pair( i + 1, -1.0 ) );
+    if( y < k - 1 ) row.push_back( std::make_pair( i + k, -1.0 ) );
+    if( z < k - 1 ) row.push_back( std::make_pair( i + k * k, -1.0 ) );
+}
+
+static void
+random_sparse( row_t& row, indx_t i, size_t n ) {
+    uint64_t state =row_state( i );
+    if( n > 1 ) {
+        for( size_t e =0; e < OPT.per_row; e++ ) {
+            const indx_t j =(i + 1 + (indx_t)( uniform( &state ) * (n - 1) )) % n;
+            row.push_back( std::make_pair( j, 2.0 * uniform( &state ) - 1.0 ) );
+        }
+    }
+    set_diagonal( row, i );
+}
+
+static void
+banded( row_t& row, indx_t i, size_t n ) {
+    uint64_t state =row_state( i );
+    const indx_t first =i > OPT.width ? i - OPT.width : 0;
+    const indx_t last =std::min( i + OPT.width, (indx_t)n - 1 );
+    for( indx_t j =first; j <= last; j++ )
+        if( j != i && uniform( &state ) < OPT.density )
+            row.push_back( std::make_pair( j, 2.0 * uniform( &state ) - 1.0 ) );
+    set_diagonal( row, i );
+}
+
+static void
+arrowhead( row_t& row, indx_t i, size_t n ) {
+    const size_t k =std::min( OPT.dense_rows, n );
+    if( i >= n - k ) {
+        for( indx_t j =0; j < n; j++ )
+            if( j != i ) row.push_back( std::make_pair( j, element_value( i, j ) ) );
+    } else {
+        for( indx_t j =n - k; j < n; j++ )
+            row.push_back( std::make_pair( j, element_value( i, j ) ) );
+    }
+    set_diagonal( row, i );
+}
+
+static void
+blockdiag( row_t& row, indx_t i, size_t n ) {
+    uint64_t state =row_state( i );
+    const indx_t first =(i / OPT.block) * OPT.block;
+    const indx_t last =std::min( first + OPT.block, (indx_t)n ) - 1;
+    for( indx_t j =first; j <= last; j++ )
+        if( j != i && uniform( &state ) < OPT.density )
+            row.push_back( std::make_pair( j, 2.0 * uniform( &state ) - 1.0 ) );
+    // Weak coupling to random columns of the other blocks
+    const size_t outside =n - (last - first + 1);
+    if( outside > 0 ) {
+        for( size_t e =0; e < OPT.coupling; e++ ) {
+            indx_t j =(indx_t)( uniform( &state ) * outside );
+            if( j >= first ) j += last - first + 1;
+            row.push_back( std::make_pair( j, 0.01 * (2.0 * uniform( &state ) - 1.0) ) );
+        }
+    }
+    set_diagonal( row, i );
+}
+
+typedef void (*family_func_t)( row_t&, indx_t, size_t );
+
+static const struct {
+    const char*   name;
+    family_func_t func;
+    int           dims;         // Rows are size^dims
+    bool          symmetric;
+} FAMILIES[] = {
+    { "poisson2d", poisson2d,     2, true },
+    { "poisson3d", poisson3d,     3, true },
+    { "random",    random_sparse, 1, false },
+    { "banded",    banded,        1, false },
+    { "arrowhead", arrowhead,     1, true },
+    { "blockdiag", blockdiag,     1, false },
+};
+
+static bool
+write_matrix_market( const char* filename, size_t n, const std::vector<indx_t>& row_ptr,
+                     const std::vector<indx_t>& col_ind, const std::vector<double>& values ) {
+    FILE* fh =fopen( filename, "w" );
+    if( !fh ) {
+        perror( "fopen" );
+        return false;
+    }
+    MM_typecode matcode;
+    mm_initialize_typecode( &matcode );
+    mm_set_matrix( &matcode );
+    mm_set_coordinate( &matcode );
+    mm_set_real( &matcode );
+    if( OPT.symmetric ) mm_set_symmetric( &matcode );
+    else mm_set_general( &matcode );
+    mm_write_banner( fh, matcode );
+    fprintf( fh, "%% Generated by matgen, seed %lu\n", OPT.seed );
+    fprintf( fh, "%ld %ld %ld\n", n, n, col_ind.size() );
+    for( size_t i =0; i < n; i++ )
+        for( indx_t j =row_ptr[i]; j < row_ptr[i+1]; j++ )
+            fprintf( fh, "%ld %ld %.17g\n", i + 1, col_ind[j] + 1, values[j] );
+    if( fclose( fh ) != 0 ) {
+        perror( "fclose" );
+        return false;
+    }
+    return true;
+}
+
+static void
+usage( const char* name ) {
+    fprintf( stderr, "(i) Usage: %s [options] <family> <output.mtx|output.crs>\n"
+                     "    families: poisson2d, poisson3d, random, banded, arrowhead, blockdiag\n"
+                     "    --size N           rows, grid points per dimension for poisson2d/3d (1000)\n"
+                     "    --seed S           random seed (1)\n"
+                     "    --per-row P        random elements per row for random (10)\n"
+                     "    --width W          half bandwidth for banded (5)\n"
+                     "    --density D        non-zero fraction of the band or block (1.0)\n"
+                     "    --dominance F      diagonal is F times the row sum, 0 for random (1.1)\n"
+                     "    --block B          block size for blockdiag (64)\n"
+                     "    --coupling C       elements per row outside the block for blockdiag (1)\n"
+                     "    --dense-rows K     dense rows and columns for arrowhead (1)\n"
+                     "    --symmetric        write the lower triangle (poisson2d/3d, arrowhead)\n",
+                     name );
+}
+
+int
+main( int argc, char **argv ) {
+    static const struct option long_options[] = {
+        { "size",       required_argument, 0, 'n' },
+        { "seed",       required_argument, 0, 's' },
+        { "per-row",    required_argument, 0, 'p' },
+        { "width",      required_argument, 0, 'w' },
+        { "density",    required_argument, 0, 'd' },
+        { "dominance",  required_argument, 0, 'D' },
+        { "block",      required_argument, 0, 'b' },
+        { "coupling",   required_argument, 0, 'c' },
+        { "dense-rows", required_argument, 0, 'k' },
+        { "symmetric",  no_argument,       0, 'Y' },
+        { "help",       no_argument,       0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+    int c;
+    while( (c =getopt_long( argc, argv, "n:s:h", long_options, NULL )) != -1 ) {
+        switch( c ) {
+            case 'n': OPT.size =atol( optarg ); break;
+            case 's': OPT.seed =strtoull( optarg, NULL, 10 ); break;
+            case 'p': OPT.per_row =atol( optarg ); break;
+            case 'w': OPT.width =atol( optarg ); break;
+            case 'd': OPT.density =atof( optarg ); break;
+            case 'D': OPT.dominance =atof( optarg ); break;
+            case 'b': OPT.block =std::max( atol( optarg ), 1L ); break;
+            case 'c': OPT.coupling =atol( optarg ); break;
+            case 'k': OPT.dense_rows =atol( optarg ); break;
+            case 'Y': OPT.symmetric =true; break;
+            default:
+                usage( argv[0] );
+                return -1;
+        }
+    }
+    if( optind != argc-2 || OPT.size == 0 ) {
+        usage( argv[0] );
+        return -1;
+    }
+
+    size_t f;
+    const size_t n_families =sizeof( FAMILIES ) / sizeof( FAMILIES[0] );
+    for( f =0; f < n_families && strcmp( FAMILIES[f].name, argv[optind] ) != 0; f++ );
+    if( f == n_families ) {
+        fprintf( stderr, "(e) Unknown family '%s'\n", argv[optind] );
+        return -1;
+    }
+    if( OPT.symmetric && !FAMILIES[f].symmetric ) {
+        fprintf( stderr, "(e) Family '%s' is not symmetric\n", FAMILIES[f].name );
+        return -1;
+    }
+    const char* filename =argv[optind+1];
+    const size_t len =strlen( filename );
+    const bool binary =len > 4 && strcmp( filename + len - 4, ".crs" ) == 0;
+    if( binary && OPT.symmetric ) {
+        fprintf( stderr, "(e) Binary CRS files hold the full matrix, --symmetric is not supported\n" );
+        return -1;
+    }
+
+    size_t n =1;
+    for( int d =0; d < FAMILIES[f].dims; d++ ) n *= OPT.size;
+
+    // The rows are generated independently, then concatenated
+    std::vector<row_t> rows( n );
+#pragma omp parallel for schedule(dynamic,1024)
+    for( size_t i =0; i < n; i++ ) {
+        row_t& row =rows[i];
+        FAMILIES[f].func( row, i, n );
+        std::sort( row.begin(), row.end() );
+        // Duplicate columns of the random families are merged
+        size_t o =0;
+        for( size_t k =0; k < row.size(); k++ ) {
+            if( OPT.symmetric && row[k].first > i ) break;
+            if( o > 0 && row[o-1].first == row[k].first ) row[o-1].second += row[k].second;
+            else row[o++] =row[k];
+        }
+        row.resize( o );
+    }
+
+    std::vector<indx_t> row_ptr( n + 1, 0 );
+    for( size_t i =0; i < n; i++ ) row_ptr[i+1] =row_ptr[i] + rows[i].size();
+    std::vector<indx_t> col_ind( row_ptr[n] );
+    std::vector<double> values( row_ptr[n] );
+#pragma omp parallel for schedule(dynamic,1024)
+    for( size_t i =0; i < n; i++ ) {
+        for( size_t k =0; k < rows[i].size(); k++ ) {
+            col_ind[row_ptr[i] + k] =rows[i][k].first;
+            values[row_ptr[i] + k] =rows[i][k].second;
+        }
+        row_t().swap( rows[i] );
+    }
+
+    printf( "(i) %s: %ld x %ld matrix, %ld non-zeroes, seed %lu\n",
+            FAMILIES[f].name, n, n, row_ptr[n], OPT.seed );
+    const bool ok =binary ? save_binary_crs( filename, row_ptr[n], n, n, values.data(), col_ind.data(), row_ptr.data() )
+                          : write_matrix_market( filename, n, row_ptr, col_ind, values );
+    if( !ok ) {
+        fprintf( stderr, "(e) Failed to write '%s'\n", filename );
+        return -1;
+    }
+    printf( "(i) Written to '%s'\n", filename );
+    return 0;
+}
@@ -1,9 +1,18 @@
 #include <vector>
+#include <deque>
+#include <string>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
+
+#include <zlib.h>
+#include <omp.h>
 
 #include "matrix.h"
 
@@ -46,62 +55,268 @@ inline bool operator<(const struct Element &a, const struct Element &b)
 
 
 
+/*
+ * Decompression pipeline: one thread reads (and inflates, for gzip files)
+ * the input in chunks that end at a line boundary, while the OpenMP threads
+ * parse the chunks concurrently. At most MM_N_CHUNKS chunks are in memory.
+ */
+
+#define MM_CHUNK_SIZE (1 << 20)
+#define MM_N_CHUNKS 16
+
+struct Chunk
+{
+  char *text;
+  size_t length;
+};
+
+struct ChunkQueue
+{
+  std::mutex lock;
+  std::condition_variable cond;
+  std::vector<Chunk *> free;
+  std::deque<Chunk *> full;
+  bool done;
+  bool error;
+};
+
+static void
+inflate_chunks(gzFile gz, ChunkQueue *q)
+{
+  std::string carry; /* Partial line at the end of the previous chunk */
+  while (true)
+    {
+      Chunk *c;
+      {
+        std::unique_lock<std::mutex> guard(q->lock);
+        q->cond.wait(guard, [q] { return !q->free.empty(); });
+        c = q->free.back();
+        q->free.pop_back();
+      }
+
+      memcpy(c->text, carry.data(), carry.size());
+      const int n = gzread(gz, c->text + carry.size(), MM_CHUNK_SIZE - carry.size());
+      const size_t length = carry.size() + std::max(n, 0);
+      carry.clear();
+
+      /* Cut after the last complete line, unless this is the end */
+      size_t end = length;
+      if (n > 0)
+        {
+          while (end > 0 && c->text[end - 1] != '\n')
+            end--;
+          if (end == 0)
+            end = length; /* Line longer than a chunk, cannot happen in Matrix Market */
+          carry.assign(c->text + end, length - end);
+        }
+      c->text[end] = '\0';
+      c->length = end;
+
+      std::lock_guard<std::mutex> guard(q->lock);
+      q->full.push_back(c);
+      if (n <= 0)
+        {
+          q->error = n < 0;
+          q->done = true;
+          q->cond.notify_all();
+          return;
+        }
+      q->cond.notify_all();
+    }
+}
+
+/* Appends the element(s) of one entry of the file */
+static inline void
+add_element(std::vector<Element> &elements, int row, int col, double val,
+            const MM_typecode matcode, bool triangle)
+{
+  row--; /* adjust from 1-based to 0-based */
+  col--;
+
+  if (triangle)
+    {
+      elements.push_back(Element(std::max(row, col), std::min(row, col), val));
+      return;
+    }
+  elements.push_back(Element(row, col, val));
+  if (mm_is_symmetric(matcode) && row != col)
+    elements.push_back(Element(col, row, val));
+}
+
+/* Parses the entries in the lines of @text, returns the number of entries */
+static size_t
+parse_chunk(const char *text, std::vector<Element> &elements,
+            const MM_typecode matcode, bool triangle)
+{
+  size_t n_entries = 0;
+  char *p = (char *)text;
+  while (*p)
+    {
+      char *end;
+      const long row = strtol(p, &end, 10);
+      if (end == p)
+        {
+          /* Empty or unparsable line */
+          p = strchr(p, '\n');
+          if (!p)
+            break;
+          p++;
+          continue;
+        }
+      p = end;
+      const long col = strtol(p, &p, 10);
+      const double val = mm_is_pattern(matcode) ? 1.0 : strtod(p, &p);
+      add_element(elements, row, col, val, matcode, triangle);
+      n_entries++;
+
+      p = strchr(p, '\n');
+      if (!p)
+        break;
+      p++;
+    }
+  return n_entries;
+}
+
+/* Reads the banner, the comments and the size line of @gz. The size line
+ * holds the number of entries @nz for the coordinate format only, @nz is set
+ * to M*N for arrays.
+ */
+static bool
+read_header(gzFile gz, MM_typecode *matcode, int *M, int *N, int *nz)
+{
+  /* The header is passed to mmio in memory */
+  std::string header;
+  char line[MM_MAX_LINE_LENGTH + 2];
+  while (gzgets(gz, line, sizeof(line)))
+    {
+      /* Blank lines are left out, mmio would not skip a comment after one */
+      if (line[strspn(line, " \t\r\n")] == '\0')
+        continue;
+      header += line;
+      if (line[0] != '%')
+        break;
+    }
+  FILE *fh = fmemopen((void *)header.data(), header.size(), "r");
+
+  if (!fh || mm_read_banner(fh, matcode) != 0)
+    {
+      fprintf(stderr, "(e) mm_read_banner failed\n");
+      if (fh)
+        fclose(fh);
+      return false;
+    }
+
+  int ret_code;
+  if (mm_is_array(*matcode))
+    {
+      ret_code = mm_read_mtx_array_size(fh, M, N);
+      *nz = *M * *N;
+    }
+  else
+    ret_code = mm_read_mtx_crd_size(fh, M, N, nz);
+  fclose(fh);
+  if (ret_code != 0)
+    {
+      fprintf(stderr, "(e) Reading the size of the matrix failed\n");
+      return false;
+    }
+  return true;
+}
+
 static bool
 read_matrix_market(const char *filename,
                    std::vector<Element> &elements,
-                   size_t &n_rows, size_t &n_cols)
+                   size_t &n_rows, size_t &n_cols,
+                   bool *symmetric)
 {
-  FILE *fh = fopen(filename, "r");
-  if (!fh)
+  /* gzopen() reads uncompressed files transparently */
+  gzFile gz = gzopen(filename, "rb");
+  if (!gz)
     {
-      perror("fopen");
+      perror("gzopen");
       return false;
     }
+  gzbuffer(gz, MM_CHUNK_SIZE);
 
   printf("Reading matrix '%s'...\n", filename);
 
   MM_typecode matcode;
-  if (mm_read_banner(fh, &matcode) != 0)
+  int M, N, nz;
+  if (!read_header(gz, &matcode, &M, &N, &nz))
     {
-      fprintf(stderr, "(e) mm_read_banner failed\n");
+      gzclose(gz);
       return false;
     }
-
-  int M, N, nz;
-  int ret_code;
-  ret_code = mm_read_mtx_crd_size(fh, &M, &N, &nz);
-  if (ret_code != 0)
+  if (!mm_is_coordinate(matcode) || mm_is_complex(matcode))
     {
-      fprintf(stderr, "(e) mm_read_mtx_crd_size failed\n");
+      fprintf(stderr, "(e) Only real coordinate matrices are supported\n");
+      gzclose(gz);
       return false;
     }
 
   n_rows = M;
   n_cols = N;
 
-  for (int i = 0; i < nz; i++)
-    {
-      int row, col;
-      double val;
+  /* Symmetric matrices are only kept as their lower triangle on request */
+  const bool triangle = symmetric && mm_is_symmetric(matcode);
+  if (symmetric)
+    *symmetric = triangle;
 
-      if (mm_is_pattern(matcode))
+  ChunkQueue q;
+  q.done = q.error = false;
+  std::vector<Chunk> chunks(MM_N_CHUNKS);
+  for (Chunk &c : chunks)
+    {
+      c.text = (char *)malloc(MM_CHUNK_SIZE + 1);
+      q.free.push_back(&c);
+    }
+  std::thread reader(inflate_chunks, gz, &q);
+
+  std::vector< std::vector<Element> > parsed(omp_get_max_threads());
+  size_t n_entries = 0;
+#pragma omp parallel reduction(+:n_entries)
+  {
+    std::vector<Element> &local = parsed[omp_get_thread_num()];
+    while (true)
+      {
+        Chunk *c;
         {
-          fscanf(fh, "%d %d\n", &row, &col);
-          val = 1.0;
+          std::unique_lock<std::mutex> guard(q.lock);
+          q.cond.wait(guard, [&q] { return !q.full.empty() || q.done; });
+          if (q.full.empty())
+            break;
+          c = q.full.front();
+          q.full.pop_front();
         }
-      else
-        fscanf(fh, "%d %d %lg\n", &row, &col, &val);
-
-      row--; /* adjust from 1-based to 0-based */
-      col--;
+        n_entries += parse_chunk(c->text, local, matcode, triangle);
+
+        std::lock_guard<std::mutex> guard(q.lock);
+        q.free.push_back(c);
+        q.cond.notify_all();
+      }
+  }
+  reader.join();
+  gzclose(gz);
+  for (Chunk &c : chunks)
+    free(c.text);
+
+  if (q.error || n_entries != (size_t)nz)
+    {
+      fprintf(stderr, "(e) Read %ld of %d entries\n", n_entries, nz);
+      return false;
+    }
 
-      elements.push_back(Element(row, col, val));
-      if (mm_is_symmetric(matcode) && row != col)
-        elements.push_back(Element(col, row, val));
+  size_t count = 0;
+  for (auto &v : parsed)
+    count += v.size();
+  elements.reserve(count);
+  for (auto &v : parsed)
+    {
+      elements.insert(elements.end(), v.begin(), v.end());
+      std::vector<Element>().swap(v);
     }
 
   std::sort(elements.begin(), elements.end());
-  fclose(fh);
 
   return true;
 }
@@ -167,15 +382,19 @@ load_matrix_market(const char *filename,
                    size_t &nnz, size_t &n_rows, size_t &n_cols,
                    double values[],
                    indx_t col_ind[],
-                   indx_t row_ptr_begin[], indx_t row_ptr_end[])
+                   indx_t row_ptr_begin[], indx_t row_ptr_end[],
+                   bool *symmetric)
 {
   std::vector<Element> elements;
 
-  if (!read_matrix_market(filename, elements, n_rows, n_cols))
+  if (!read_matrix_market(filename, elements, n_rows, n_cols, symmetric))
     return false;
 
   if (elements.size() >= (size_t)max_n_elements || n_rows >= max_n_rows)
-    return false;
+    {
+      fprintf(stderr, "(e) Matrix exceeds MAX_N_ELEMENTS or MAX_N_ROWS\n");
+      return false;
+    }
 
   nnz = elements.size();
   load_elements(elements, values, col_ind, row_ptr_begin, row_ptr_end);
@@ -185,3 +404,252 @@ load_matrix_market(const char *filename,
 
   return true;
 }
+
+/*
+ * Binary CRS files, see matrix.h
+ */
+
+bool
+load_binary_crs(const char *filename,
+                const size_t max_n_elements,
+                const size_t max_n_rows,
+                size_t &nnz, size_t &n_rows, size_t &n_cols,
+                double values[],
+                indx_t col_ind[],
+                indx_t row_ptr_begin[], indx_t row_ptr_end[])
+{
+  FILE *fh = fopen(filename, "rb");
+  if (!fh)
+    {
+      perror("fopen");
+      return false;
+    }
+
+  printf("Reading matrix '%s'...\n", filename);
+
+  char magic[sizeof(CRS_MAGIC) - 1];
+  uint64_t header[3];
+  if (fread(magic, sizeof(magic), 1, fh) != 1
+      || memcmp(magic, CRS_MAGIC, sizeof(magic)) != 0
+      || fread(header, sizeof(header), 1, fh) != 1)
+    {
+      fprintf(stderr, "(e) Not a binary CRS file\n");
+      fclose(fh);
+      return false;
+    }
+  n_rows = header[0];
+  n_cols = header[1];
+  nnz = header[2];
+
+  if (nnz >= max_n_elements || n_rows >= max_n_rows)
+    {
+      fprintf(stderr, "(e) Matrix exceeds MAX_N_ELEMENTS or MAX_N_ROWS\n");
+      fclose(fh);
+      return false;
+    }
+
+  std::vector<uint64_t> row_ptr(n_rows + 1);
+  std::vector<uint64_t> cols(nnz);
+  bool ok = fread(row_ptr.data(), sizeof(uint64_t), n_rows + 1, fh) == n_rows + 1
+            && fread(cols.data(), sizeof(uint64_t), nnz, fh) == nnz
+            && fread(values, sizeof(double), nnz, fh) == nnz;
+  fclose(fh);
+  if (!ok)
+    {
+      fprintf(stderr, "(e) Binary CRS file is truncated\n");
+      return false;
+    }
+
+  for (size_t i = 0; i < nnz; i++)
+    col_ind[i] = cols[i];
+  for (size_t row = 0; row < n_rows; row++)
+    {
+      if (row_ptr[row] == row_ptr[row + 1])
+        {
+          fprintf(stderr, "(e) Row skipping not implemented.\n");
+          return false;
+        }
+      row_ptr_begin[row] = row_ptr[row];
+      row_ptr_end[row] = row_ptr[row + 1] - 1;
+    }
+
+  printf("(i) Import ok: %ld x %ld matrix, %ld non-zeroes\n",
+         n_rows, n_cols, nnz);
+
+  return true;
+}
+
+bool
+save_binary_crs(const char *filename,
+                const size_t nnz, const size_t n_rows, const size_t n_cols,
+                const double values[],
+                const indx_t col_ind[],
+                const indx_t row_ptr[])
+{
+  FILE *fh = fopen(filename, "wb");
+  if (!fh)
+    {
+      perror("fopen");
+      return false;
+    }
+
+  const uint64_t header[3] = { n_rows, n_cols, nnz };
+  std::vector<uint64_t> buffer(row_ptr, row_ptr + n_rows + 1);
+  bool ok = fwrite(CRS_MAGIC, sizeof(CRS_MAGIC) - 1, 1, fh) == 1
+            && fwrite(header, sizeof(header), 1, fh) == 1
+            && fwrite(buffer.data(), sizeof(uint64_t), n_rows + 1, fh) == n_rows + 1;
+  buffer.assign(col_ind, col_ind + nnz);
+  ok = ok && fwrite(buffer.data(), sizeof(uint64_t), nnz, fh) == nnz
+          && fwrite(values, sizeof(double), nnz, fh) == nnz;
+  if (fclose(fh) != 0 || !ok)
+    {
+      perror("fwrite");
+      return false;
+    }
+  return true;
+}
+
+/*
+ * Read and write dense matrices a block of columns at a time
+ */
+
+bool
+rhs_open(rhs_reader_t *r, const char *filename)
+{
+  gzFile gz = gzopen(filename, "rb");
+  if (!gz)
+    {
+      perror("gzopen");
+      return false;
+    }
+
+  MM_typecode matcode;
+  int M, N, nz;
+  if (!read_header(gz, &matcode, &M, &N, &nz))
+    {
+      gzclose(gz);
+      return false;
+    }
+  if (mm_is_complex(matcode) || mm_is_pattern(matcode) || !mm_is_general(matcode))
+    {
+      fprintf(stderr, "(e) Right-hand sides must be real and general\n");
+      gzclose(gz);
+      return false;
+    }
+
+  r->gz = gz;
+  r->coordinate = mm_is_coordinate(matcode);
+  r->n_rows = M;
+  r->n_cols = N;
+  r->next_col = 0;
+  r->n_entries = nz;
+  r->col = 0;
+  return true;
+}
+
+/* Reads the next coordinate entry into @r->row, @r->col and @r->val */
+static bool
+read_entry(rhs_reader_t *r)
+{
+  char line[MM_MAX_LINE_LENGTH + 2];
+  const long prev = r->col;
+  r->col = 0;
+  if (r->n_entries == 0)
+    return true;
+  if (!gzgets((gzFile)r->gz, line, sizeof(line))
+      || sscanf(line, "%ld %ld %lg", &r->row, &r->col, &r->val) != 3)
+    {
+      fprintf(stderr, "(e) Right-hand side file is truncated\n");
+      return false;
+    }
+  r->n_entries--;
+  if (r->col < prev || r->col < 1 || r->col > (long)r->n_cols
+      || r->row < 1 || r->row > (long)r->n_rows)
+    {
+      fprintf(stderr, "(e) Right-hand side entries must be ordered by column\n");
+      return false;
+    }
+  return true;
+}
+
+/* Reads at most @max_cols columns into @block, column v starts at
+ * @block + v*@ld. @n_read is set to the number of columns read, 0 after the
+ * last one.
+ */
+bool
+rhs_read(rhs_reader_t *r, double block[], size_t ld, size_t max_cols,
+         size_t &n_read)
+{
+  n_read = std::min(max_cols, r->n_cols - r->next_col);
+  if (!r->coordinate)
+    {
+      char line[MM_MAX_LINE_LENGTH + 2];
+      for (size_t v = 0; v < n_read; v++)
+        for (size_t i = 0; i < r->n_rows; i++)
+          {
+            if (!gzgets((gzFile)r->gz, line, sizeof(line)))
+              {
+                fprintf(stderr, "(e) Right-hand side file is truncated\n");
+                return false;
+              }
+            block[v * ld + i] = strtod(line, NULL);
+          }
+      r->next_col += n_read;
+      return true;
+    }
+
+  for (size_t v = 0; v < n_read; v++)
+    memset(&block[v * ld], 0, r->n_rows * sizeof(double));
+  if (r->next_col == 0 && !read_entry(r))
+    return false;
+  r->next_col += n_read;
+  while (r->col != 0 && (size_t)r->col <= r->next_col)
+    {
+      block[(r->col - 1 - (r->next_col - n_read)) * ld + r->row - 1] += r->val;
+      if (!read_entry(r))
+        return false;
+    }
+  return true;
+}
+
+void
+rhs_close(rhs_reader_t *r)
+{
+  gzclose((gzFile)r->gz);
+  r->gz = NULL;
+}
+
+FILE *
+create_array_file(const char *filename, const size_t n_rows, const size_t n_cols)
+{
+  FILE *fh = fopen(filename, "w");
+  if (!fh)
+    {
+      perror("fopen");
+      return NULL;
+    }
+
+  MM_typecode matcode;
+  mm_initialize_typecode(&matcode);
+  mm_set_matrix(&matcode);
+  mm_set_array(&matcode);
+  mm_set_real(&matcode);
+  mm_set_general(&matcode);
+  mm_write_banner(fh, matcode);
+  mm_write_mtx_array_size(fh, n_rows, n_cols);
+  return fh;
+}
+
+bool
+write_array_columns(FILE *f, const double block[], const size_t ld,
+                    const size_t n_rows, const size_t n_cols)
+{
+  for (size_t v = 0; v < n_cols; v++)
+    for (size_t i = 0; i < n_rows; i++)
+      if (fprintf(f, "%.17g\n", block[v * ld + i]) < 0)
+        {
+          perror("fprintf");
+          return false;
+        }
+  return true;
+}
@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <cstdio>
 #ifndef __MATRIX_H__
 #define __MATRIX_H__
 
@@ -20,6 +21,70 @@ bool load_matrix_market(const char *filename,
                         double        values[],
                         indx_t        col_ind[],
                         indx_t        row_ptr_begin[],
-                        indx_t        row_ptr_end[]);
+                        indx_t        row_ptr_end[],
+                        bool         *symmetric = NULL);
+
+/* Binary CRS file: the magic string, then n_rows, n_cols and nnz, the
+ * n_rows+1 row pointers and nnz column indices as 64-bit integers, and
+ * finally the nnz values as doubles, all in host byte order.
+ */
+#define CRS_MAGIC "VKDCRS01"
+
+bool load_binary_crs(const char *filename,
+                     const size_t   max_n_elements,
+                     const size_t   max_n_rows,
+                     size_t        &nnz,
+                     size_t        &n_rows,
+                     size_t        &n_cols,
+                     double        values[],
+                     indx_t        col_ind[],
+                     indx_t        row_ptr_begin[],
+                     indx_t        row_ptr_end[]);
+
+bool save_binary_crs(const char *filename,
+                     const size_t   nnz,
+                     const size_t   n_rows,
+                     const size_t   n_cols,
+                     const double   values[],
+                     const indx_t   col_ind[],
+                     const indx_t   row_ptr[]);
+
+/* Reader of the columns of a dense matrix, e.g. a set of right-hand sides,
+ * one block of columns at a time. The file is in Matrix Market array format
+ * or in coordinate format with the entries ordered by column, and may be
+ * gzip-compressed.
+ */
+typedef struct
+{
+  void   *gz;
+  bool    coordinate;
+  size_t  n_rows, n_cols;
+  size_t  next_col;       // First column not returned yet
+  size_t  n_entries;      // Coordinate entries not read yet
+  long    row, col;       // Coordinate entry read ahead, col is 0 if none
+  double  val;
+} rhs_reader_t;
+
+bool rhs_open(rhs_reader_t  *r,
+              const char    *filename);
+
+bool rhs_read(rhs_reader_t  *r,
+              double         block[],
+              size_t         ld,
+              size_t         max_cols,
+              size_t        &n_read);
+
+void rhs_close(rhs_reader_t *r);
+
+/* Matrix Market array files written one block of columns at a time */
+FILE *create_array_file(const char  *filename,
+                        const size_t n_rows,
+                        const size_t n_cols);
+
+bool write_array_columns(FILE          *f,
+                         const double   block[],
+                         const size_t   ld,
+                         const size_t   n_rows,
+                         const size_t   n_cols);
 
 #endif /* __MATRIX_H__ */
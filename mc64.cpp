@@ -0,0 +1,168 @@
+#include "mc64.h"
+#include <queue>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+typedef std::pair<double,indx_t> dist_t;
+
+/** Computes the matching and the scaling factors of @m, using successive 
+ *  shortest augmenting paths (Dijkstra) on the costs
+ *      c_ij = log max_k |a_ik| - log |a_ij|.
+ *  Returns 0 on success and -1 if @m is structurally singular.
+ */
+int
+mc64_analyse( mc64_t* s, const matrix_t* m ) {
+    const size_t n =m->m;
+    memset( s, 0, sizeof( mc64_t ) );
+    s->n =n;
+
+    std::vector<double> cost( m->count );
+    std::vector<double> u( n ), v( n, 0.0 ), rowmax( n, 0.0 ), dist( n, INFINITY );
+    std::vector<sindx_t> jmatch( n, -1 ), imatch( n, -1 ), pred( n, -1 );
+    std::vector<indx_t> touched;
+    std::vector<bool> done( n, false );
+
+    // Costs are stored in the element order of m; explicit zeros are no edges
+    for( size_t i =0; i < n; i++ ) {
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            rowmax[i] =fmax( rowmax[i], fabs( m->values[j] ) );
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            cost[j] =m->values[j] != 0.0 ? log( rowmax[i] ) - log( fabs( m->values[j] ) ) : INFINITY;
+    }
+
+    // Row reduction and cheap assignment of the cheapest free column
+    for( size_t i =0; i < n; i++ ) {
+        u[i] =INFINITY;
+        sindx_t best =-1;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( cost[j] < u[i] || (cost[j] == u[i] && best != -1 && imatch[m->col_ind[best]] != -1) ) {
+                u[i] =cost[j];
+                best =j;
+            }
+        if( best != -1 && imatch[m->col_ind[best]] == -1 ) {
+            jmatch[i] =m->col_ind[best];
+            imatch[m->col_ind[best]] =i;
+        }
+        if( !isfinite( u[i] ) ) u[i] =0.0;
+    }
+
+    for( size_t k =0; k < n; k++ ) {
+        if( jmatch[k] != -1 ) continue;
+
+        // Dijkstra over the columns, starting at row k
+        std::priority_queue<dist_t, std::vector<dist_t>, std::greater<dist_t> > queue;
+        for( indx_t j =m->row_ptr_begin[k]; j <= m->row_ptr_end[k]; j++ ) {
+            const indx_t col =m->col_ind[j];
+            const double d =cost[j] - u[k] - v[col];
+            if( !isfinite( cost[j] ) || d >= dist[col] ) continue;
+            if( dist[col] == INFINITY ) touched.push_back( col );
+            dist[col] =d;
+            pred[col] =k;
+            queue.push( dist_t( d, col ) );
+        }
+
+        sindx_t end =-1;
+        double lsp =INFINITY;
+        while( !queue.empty() ) {
+            const dist_t top =queue.top();
+            queue.pop();
+            const indx_t col =top.second;
+            if( done[col] || top.first > dist[col] ) continue;
+            done[col] =true;
+            if( imatch[col] == -1 ) {
+                end =col;
+                lsp =dist[col];
+                break;
+            }
+            const indx_t r =imatch[col];
+            for( indx_t j =m->row_ptr_begin[r]; j <= m->row_ptr_end[r]; j++ ) {
+                const indx_t l =m->col_ind[j];
+                if( done[l] || !isfinite( cost[j] ) ) continue;
+                const double d =dist[col] + cost[j] - u[r] - v[l];
+                if( d >= dist[l] ) continue;
+                if( dist[l] == INFINITY ) touched.push_back( l );
+                dist[l] =d;
+                pred[l] =r;
+                queue.push( dist_t( d, l ) );
+            }
+        }
+
+        if( end == -1 ) {
+            fprintf( stderr, "(e) mc64_analyse(): matrix is structurally singular.\n" );
+            return -1;
+        }
+
+        // Update the dual variables of the scanned columns and their rows
+        u[k] += lsp;
+        for( indx_t col : touched ) {
+            if( !done[col] ) continue;
+            const double delta =lsp - dist[col];
+            if( imatch[col] != -1 ) u[imatch[col]] += delta;
+            v[col] -= delta;
+        }
+
+        // Augment along the shortest path
+        for( sindx_t col =end; col != -1; ) {
+            const indx_t r =pred[col];
+            const sindx_t next =jmatch[r];
+            jmatch[r] =col;
+            imatch[col] =r;
+            col =r == k ? -1 : next;
+        }
+
+        for( indx_t col : touched ) {
+            dist[col] =INFINITY;
+            done[col] =false;
+        }
+        touched.clear();
+    }
+
+    s->row_perm  =(indx_t*)malloc( n * sizeof(indx_t) );
+    s->row_scale =(double*)malloc( n * sizeof(double) );
+    s->col_scale =(double*)malloc( n * sizeof(double) );
+    for( size_t j =0; j < n; j++ ) {
+        s->row_perm[j] =imatch[j];
+        s->col_scale[j] =exp( v[j] );
+    }
+    for( size_t i =0; i < n; i++ )
+        s->row_scale[i] =rowmax[i] > 0.0 ? exp( u[i] ) / rowmax[i] : 1.0;
+    return 0;
+}
+
+/** Scales @m and sets its row order such that the matched elements are on 
+ *  the diagonal.
+ */
+void
+mc64_apply( const mc64_t* s, matrix_t* m ) {
+#pragma omp parallel for schedule(static)
+    for( size_t i =0; i < m->m; i++ )
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            m->values[j] *= s->row_scale[i] * s->col_scale[m->col_ind[j]];
+    memcpy( m->row_order, s->row_perm, m->m * sizeof(indx_t) );
+}
+
+/** Solves Ax = b using the factors @m of the scaled matrix computed by lup()
+ *  or lup_static(). @x is returned in the original (unpermuted) order.
+ */
+void
+mc64_solve( double x[], const mc64_t* s, matrix_t* m, const double b[] ) {
+    double* tmp =(double*)malloc( 2 * s->n * sizeof(double) );
+    double* c =tmp + s->n;
+    for( size_t i =0; i < s->n; i++ ) tmp[i] =s->row_scale[i] * b[i];
+    l_subst( c, m, tmp );
+    u_subst( tmp, m, c );
+    for( size_t jj =0; jj < s->n; jj++ ) x[jj] =s->col_scale[jj] * tmp[m->row_order[jj]];
+    free( tmp );
+}
+
+void
+mc64_free( mc64_t* s ) {
+    free( s->row_perm );
+    free( s->row_scale );
+    free( s->col_scale );
+    memset( s, 0, sizeof( mc64_t ) );
+}
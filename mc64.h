@@ -0,0 +1,24 @@
+#ifndef MC64_H
+#define MC64_H
+
+#include "lup.h"
+
+/* Maximum product matching with scaling, in the spirit of MC64 (job 5).
+ * The matching permutes the rows such that the product of the magnitudes of
+ * the diagonal elements is maximal. The dual variables give row and column
+ * scaling factors after which the diagonal elements have magnitude 1 and all
+ * other elements have magnitude at most 1.
+ */
+typedef struct {
+    size_t  n;
+    indx_t* row_perm;           // Position -> original row, matched to column `position'
+    double* row_scale;
+    double* col_scale;
+} mc64_t;
+
+int mc64_analyse( mc64_t* s, const matrix_t* m );
+void mc64_apply( const mc64_t* s, matrix_t* m );
+void mc64_solve( double x[], const mc64_t* s, matrix_t* m, const double b[] );
+void mc64_free( mc64_t* s );
+
+#endif
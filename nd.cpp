@@ -0,0 +1,380 @@
+#include "nd.h"
+#include "band.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <queue>
+#include <utility>
+
+#define ND_LEAF_SIZE 64       // Subgraphs up to this size are ordered as they are
+#define ND_COARSE_SIZE 100    // Coarsening stops at this number of vertices
+#define ND_MIN_REDUCTION 0.95 // Coarsening stops if a level keeps more of the vertices
+#define ND_N_TRIES 8          // Initial partitions grown from different vertices
+#define ND_IMBALANCE 1.05     // Largest weight of a half relative to half the total weight
+#define ND_FM_PASSES 8        // Refinement passes per level at most
+#define ND_FM_LIMIT 64        // Moves without improvement after which a pass stops
+#define ND_TASK_SIZE 2048     // Smallest graph that is contracted or dissected by tasks
+
+/* Graph with vertex and edge weights, the neighbours of vertex v are
+ * adj[xadj[v]..xadj[v+1]-1] */
+typedef struct {
+    size_t              n;
+    std::vector<indx_t> xadj, adj;
+    std::vector<int>    vwgt, ewgt;
+} graph_t;
+
+/** Returns the next number of the xorshift generator with state @s. */
+static inline uint64_t
+next_random( uint64_t* s ) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/** Contracts a heavy-edge matching of @g into @c: the vertices are visited
+ *  in random order and matched with the unmatched neighbour they share the
+ *  heaviest edge with. @cmap receives the vertex of @c of each vertex of @g.
+ *  The adjacency lists of the coarse vertices are merged by parallel tasks.
+ */
+static void
+coarsen( const graph_t& g, graph_t& c, std::vector<indx_t>& cmap, uint64_t* seed ) {
+    const size_t n =g.n;
+    const indx_t none =(indx_t)-1;
+    std::vector<indx_t> order( n ), match( n, none );
+    for( size_t v =0; v < n; v++ ) order[v] =v;
+    for( size_t v =n; v > 1; v-- ) std::swap( order[v-1], order[next_random( seed ) % v] );
+
+    cmap.resize( n );
+    std::vector<indx_t> first; // Fine vertex with the smallest number of each coarse vertex
+    for( size_t k =0; k < n; k++ ) {
+        const indx_t v =order[k];
+        if( match[v] != none ) continue;
+        indx_t best =v;
+        int best_weight =-1;
+        for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ ) {
+            const indx_t u =g.adj[j];
+            if( match[u] == none && g.ewgt[j] > best_weight ) {
+                best =u;
+                best_weight =g.ewgt[j];
+            }
+        }
+        match[v] =best;
+        match[best] =v;
+        cmap[v] =cmap[best] =first.size();
+        first.push_back( std::min( v, best ) );
+    }
+
+    // Room for the neighbours of both fine vertices, merged in place
+    const size_t nc =first.size();
+    std::vector<indx_t> ptr( nc + 1 ), len( nc );
+    c.n =nc;
+    c.vwgt.resize( nc );
+    ptr[0] =0;
+    for( size_t cv =0; cv < nc; cv++ ) {
+        const indx_t v =first[cv], u =match[v];
+        ptr[cv+1] =ptr[cv] + g.xadj[v+1] - g.xadj[v];
+        c.vwgt[cv] =g.vwgt[v];
+        if( u != v ) {
+            ptr[cv+1] += g.xadj[u+1] - g.xadj[u];
+            c.vwgt[cv] += g.vwgt[u];
+        }
+    }
+    std::vector<indx_t> adj( ptr[nc] );
+    std::vector<int> ewgt( ptr[nc] );
+#pragma omp taskloop grainsize(1024) if(n >= ND_TASK_SIZE) shared(g, cmap, first, match, ptr, len, adj, ewgt)
+    for( size_t cv =0; cv < nc; cv++ ) {
+        std::vector< std::pair<indx_t,int> > edges;
+        const indx_t v =first[cv], u =match[v];
+        for( indx_t w : { v, u } ) {
+            for( indx_t j =g.xadj[w]; j < g.xadj[w+1]; j++ )
+                if( cmap[g.adj[j]] != cv ) edges.push_back( std::make_pair( cmap[g.adj[j]], g.ewgt[j] ) );
+            if( u == v ) break;
+        }
+        std::sort( edges.begin(), edges.end() );
+        indx_t o =ptr[cv];
+        for( size_t e =0; e < edges.size(); e++ ) {
+            if( o > ptr[cv] && adj[o-1] == edges[e].first ) {
+                ewgt[o-1] += edges[e].second;
+                continue;
+            }
+            adj[o] =edges[e].first;
+            ewgt[o++] =edges[e].second;
+        }
+        len[cv] =o - ptr[cv];
+    }
+
+    c.xadj.resize( nc + 1 );
+    c.xadj[0] =0;
+    for( size_t cv =0; cv < nc; cv++ ) c.xadj[cv+1] =c.xadj[cv] + len[cv];
+    c.adj.resize( c.xadj[nc] );
+    c.ewgt.resize( c.xadj[nc] );
+    for( size_t cv =0; cv < nc; cv++ ) {
+        std::copy( &adj[ptr[cv]], &adj[ptr[cv]] + len[cv], &c.adj[c.xadj[cv]] );
+        std::copy( &ewgt[ptr[cv]], &ewgt[ptr[cv]] + len[cv], &c.ewgt[c.xadj[cv]] );
+    }
+}
+
+/** Returns the weight of the edges between the two halves of @part. */
+static long
+cut_weight( const graph_t& g, const std::vector<char>& part ) {
+    long cut =0;
+    for( size_t v =0; v < g.n; v++ )
+        for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ )
+            if( part[v] != part[g.adj[j]] ) cut += g.ewgt[j];
+    return cut / 2;
+}
+
+/** Greedy graph growing: starting from @seed, adds the vertex that increases
+ *  the cut least to half 0 until it holds half of the vertex weight. Other
+ *  components are entered when the current one is exhausted.
+ */
+static void
+grow_partition( const graph_t& g, indx_t seed, std::vector<char>& part ) {
+    const size_t n =g.n;
+    long total =0;
+    for( size_t v =0; v < n; v++ ) total += g.vwgt[v];
+    part.assign( n, 1 );
+
+    // Decrease of the cut if the vertex joins half 0
+    std::vector<long> gain( n, 0 );
+    for( size_t v =0; v < n; v++ )
+        for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ ) gain[v] -= g.ewgt[j];
+
+    std::priority_queue< std::pair<long,indx_t> > queue;
+    queue.push( std::make_pair( gain[seed], seed ) );
+    long weight =0;
+    size_t next =0;
+    while( 2 * weight < total ) {
+        indx_t v;
+        if( queue.empty() ) {
+            while( part[next] == 0 ) next++;
+            v =next;
+        } else {
+            const std::pair<long,indx_t> top =queue.top();
+            queue.pop();
+            v =top.second;
+            if( part[v] == 0 || top.first != gain[v] ) continue; // Outdated entry
+        }
+        part[v] =0;
+        weight += g.vwgt[v];
+        for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ ) {
+            const indx_t u =g.adj[j];
+            if( part[u] == 0 ) continue;
+            gain[u] += 2 * g.ewgt[j];
+            queue.push( std::make_pair( gain[u], u ) );
+        }
+    }
+}
+
+/** Fiduccia-Mattheyses refinement of @part: each pass moves the vertex with
+ *  the largest gain to the other half, each vertex at most once, as long as
+ *  that half stays within @max_weight, and keeps the moves up to the
+ *  smallest cut seen. Stops when a pass finds no improvement.
+ */
+static void
+fm_refine( const graph_t& g, std::vector<char>& part, long max_weight ) {
+    const size_t n =g.n;
+    std::vector<long> gain( n );
+    std::vector<char> locked( n );
+    std::vector<indx_t> moves;
+    long weight[2] ={ 0, 0 };
+    for( size_t v =0; v < n; v++ ) weight[(int)part[v]] += g.vwgt[v];
+
+    for( int pass =0; pass < ND_FM_PASSES; pass++ ) {
+        std::priority_queue< std::pair<long,indx_t> > queue;
+        for( size_t v =0; v < n; v++ ) {
+            gain[v] =0;
+            bool boundary =false;
+            for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ ) {
+                const bool cut =part[g.adj[j]] != part[v];
+                gain[v] += cut ? g.ewgt[j] : -g.ewgt[j];
+                boundary |= cut;
+            }
+            if( boundary ) queue.push( std::make_pair( gain[v], (indx_t)v ) );
+        }
+        std::fill( locked.begin(), locked.end(), 0 );
+        moves.clear();
+
+        long change =0, best_change =0, best_imbalance =labs( weight[0] - weight[1] );
+        size_t best_moves =0;
+        while( !queue.empty() && moves.size() - best_moves < ND_FM_LIMIT ) {
+            const std::pair<long,indx_t> top =queue.top();
+            queue.pop();
+            const indx_t v =top.second;
+            if( locked[v] || top.first != gain[v] ) continue;
+            const int from =part[v], to =1 - from;
+            if( weight[to] + g.vwgt[v] > max_weight ) continue;
+
+            locked[v] =1;
+            part[v] =to;
+            weight[from] -= g.vwgt[v];
+            weight[to] += g.vwgt[v];
+            change -= gain[v];
+            moves.push_back( v );
+            for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ ) {
+                const indx_t u =g.adj[j];
+                if( locked[u] ) continue;
+                gain[u] += part[u] == to ? -2 * g.ewgt[j] : 2 * g.ewgt[j];
+                queue.push( std::make_pair( gain[u], u ) );
+            }
+            const long imbalance =labs( weight[0] - weight[1] );
+            if( change < best_change || (change == best_change && imbalance < best_imbalance) ) {
+                best_change =change;
+                best_imbalance =imbalance;
+                best_moves =moves.size();
+            }
+        }
+
+        // Undo the moves after the best point
+        for( size_t k =moves.size(); k-- > best_moves; ) {
+            const indx_t v =moves[k];
+            weight[(int)part[v]] -= g.vwgt[v];
+            part[v] ^= 1;
+            weight[(int)part[v]] += g.vwgt[v];
+        }
+        if( best_moves == 0 ) break;
+    }
+}
+
+/** Splits @g in two halves of about equal vertex weight with a small cut,
+ *  @part receives the half of each vertex. The graph is coarsened until it is
+ *  small, partitioned by growing from several vertices concurrently, and
+ *  refined on every level on the way back.
+ */
+static void
+bisect( const graph_t& g, std::vector<char>& part, uint64_t* seed ) {
+    long total =0;
+    for( size_t v =0; v < g.n; v++ ) total += g.vwgt[v];
+    const long max_weight =(long)(ND_IMBALANCE * total / 2) + 1;
+
+    graph_t c;
+    std::vector<indx_t> cmap;
+    if( g.n > ND_COARSE_SIZE ) coarsen( g, c, cmap, seed );
+    if( g.n <= ND_COARSE_SIZE || c.n > ND_MIN_REDUCTION * g.n ) {
+        std::vector<char> tries[ND_N_TRIES];
+        long cut[ND_N_TRIES];
+        indx_t start[ND_N_TRIES];
+        for( int t =0; t < ND_N_TRIES; t++ ) start[t] =next_random( seed ) % g.n;
+#pragma omp taskloop grainsize(1) shared(g, tries, cut, start)
+        for( int t =0; t < ND_N_TRIES; t++ ) {
+            grow_partition( g, start[t], tries[t] );
+            fm_refine( g, tries[t], max_weight );
+            cut[t] =cut_weight( g, tries[t] );
+        }
+        int best =0;
+        for( int t =1; t < ND_N_TRIES; t++ )
+            if( cut[t] < cut[best] ) best =t;
+        part.swap( tries[best] );
+        return;
+    }
+
+    std::vector<char> coarse_part;
+    bisect( c, coarse_part, seed );
+    part.resize( g.n );
+    for( size_t v =0; v < g.n; v++ ) part[v] =coarse_part[cmap[v]];
+    fm_refine( g, part, max_weight );
+}
+
+/** Orders the vertices of @g, with original numbers @ids, into @perm: the
+ *  two halves of a bisection are dissected recursively by separate tasks and
+ *  followed by the separator, the vertices of the half with the smaller
+ *  boundary that are adjacent to the other half.
+ */
+static void
+dissect( const graph_t& g, const indx_t ids[], indx_t perm[], uint64_t seed, nd_stats_t* stats, bool top ) {
+    const size_t n =g.n;
+    if( n <= ND_LEAF_SIZE ) {
+        memcpy( perm, ids, n * sizeof(indx_t) );
+        return;
+    }
+    std::vector<char> part;
+    bisect( g, part, &seed );
+
+    std::vector<char> boundary( n, 0 );
+    size_t n_boundary[2] ={ 0, 0 };
+    for( size_t v =0; v < n; v++ )
+        for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ )
+            if( part[g.adj[j]] != part[v] ) {
+                boundary[v] =1;
+                n_boundary[(int)part[v]]++;
+                break;
+            }
+    const int sep_half =n_boundary[0] <= n_boundary[1] ? 0 : 1;
+
+    // Side 2 is the separator
+    std::vector<char> side( n );
+    std::vector<indx_t> local( n );
+    size_t size[3] ={ 0, 0, 0 };
+    for( size_t v =0; v < n; v++ ) {
+        side[v] =boundary[v] && part[v] == sep_half ? 2 : part[v];
+        local[v] =size[(int)side[v]]++;
+    }
+    if( size[0] == n || size[1] == n ) {
+        memcpy( perm, ids, n * sizeof(indx_t) );
+        return;
+    }
+
+    graph_t sub[2];
+    std::vector<indx_t> sub_ids[2];
+    for( int h =0; h < 2; h++ ) {
+        sub[h].n =size[h];
+        sub[h].xadj.push_back( 0 );
+    }
+    for( size_t v =0; v < n; v++ ) {
+        const int h =side[v];
+        if( h == 2 ) {
+            perm[size[0] + size[1] + local[v]] =ids[v];
+            continue;
+        }
+        sub_ids[h].push_back( ids[v] );
+        sub[h].vwgt.push_back( g.vwgt[v] );
+        for( indx_t j =g.xadj[v]; j < g.xadj[v+1]; j++ )
+            if( side[g.adj[j]] == h ) {
+                sub[h].adj.push_back( local[g.adj[j]] );
+                sub[h].ewgt.push_back( g.ewgt[j] );
+            }
+        sub[h].xadj.push_back( sub[h].adj.size() );
+    }
+
+#pragma omp atomic
+    stats->n_separators++;
+#pragma omp atomic
+    stats->separator_size += size[2];
+    if( top ) stats->top_separator =size[2];
+
+    const uint64_t seed0 =next_random( &seed ), seed1 =next_random( &seed );
+#pragma omp task shared(sub, sub_ids) if(size[0] >= ND_TASK_SIZE)
+    dissect( sub[0], sub_ids[0].data(), perm, seed0, stats, false );
+#pragma omp task shared(sub, sub_ids) if(size[1] >= ND_TASK_SIZE)
+    dissect( sub[1], sub_ids[1].data(), perm + size[0], seed1, stats, false );
+#pragma omp taskwait
+}
+
+/** Computes the nested dissection ordering of the pattern of @m + @m^T:
+ *  original row and column @perm[ii] become row and column ii. The result
+ *  does not depend on the number of threads.
+ */
+void
+nd_order( indx_t perm[], const matrix_t* m, nd_stats_t* stats ) {
+    const size_t n =m->m;
+    indx_t *adj_ptr, *adj;
+    build_adjacency( m, &adj_ptr, &adj );
+    graph_t g;
+    g.n =n;
+    g.xadj.assign( adj_ptr, adj_ptr + n + 1 );
+    g.adj.assign( adj, adj + adj_ptr[n] );
+    g.vwgt.assign( n, 1 );
+    g.ewgt.assign( adj_ptr[n], 1 );
+    free( adj_ptr );
+    free( adj );
+
+    std::vector<indx_t> ids( n );
+    for( size_t i =0; i < n; i++ ) ids[i] =i;
+    memset( stats, 0, sizeof(nd_stats_t) );
+#pragma omp parallel
+#pragma omp single
+    dissect( g, ids.data(), perm, 0x9E3779B97F4A7C15ull, stats, true );
+}
@@ -0,0 +1,21 @@
+#ifndef ND_H
+#define ND_H
+
+#include "lup.h"
+
+/* Nested dissection ordering of the pattern of A+A^T. Each (sub)graph is
+ * split in two halves by a multilevel bisection: the graph is coarsened by
+ * heavy-edge matching, the coarsest graph is partitioned by greedy graph
+ * growing and the partition is refined by Fiduccia-Mattheyses passes while
+ * it is projected back. The vertices on one side of the cut form the
+ * separator, which is ordered after both halves.
+ */
+typedef struct {
+    size_t n_separators;        // Number of dissected subgraphs
+    size_t top_separator;       // Size of the first separator
+    size_t separator_size;      // Vertices in all separators
+} nd_stats_t;
+
+void nd_order( indx_t perm[], const matrix_t* m, nd_stats_t* stats );
+
+#endif
@@ -0,0 +1,157 @@
+#include "ooc.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <omp.h>
+
+/** Creates (or truncates) the file @path to hold the factors of an @n x @n matrix.
+ */
+int
+ooc_open( ooc_t* o, const char* path, size_t n ) {
+    memset( o, 0, sizeof( ooc_t ) );
+    o->fd =open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if( o->fd == -1 ) {
+        fprintf( stderr, "(e) ooc_open(): cannot open '%s': %s\n", path, strerror( errno ) );
+        return -1;
+    }
+    o->n =n;
+    o->row_off =(size_t*)calloc( n, sizeof(size_t) );
+    o->row_len =(indx_t*)calloc( n, sizeof(indx_t) );
+    o->buffer  =(char*)malloc( OOC_BUFFER_SIZE );
+    return 0;
+}
+
+static int
+flush( ooc_t* o ) {
+    const double start =omp_get_wtime();
+    size_t done =0;
+    while( done < o->buffered ) {
+        ssize_t ret =write( o->fd, o->buffer + done, o->buffered - done );
+        if( ret == -1 ) {
+            if( errno == EINTR ) continue;
+            fprintf( stderr, "(e) ooc: write failed: %s\n", strerror( errno ) );
+            return -1;
+        }
+        done += ret;
+    }
+    o->buffered =0;
+    o->write_time += omp_get_wtime() - start;
+    return 0;
+}
+
+static int
+append_bytes( ooc_t* o, const void* data, size_t size ) {
+    const char* src =(const char*)data;
+    while( size ) {
+        size_t chunk =OOC_BUFFER_SIZE - o->buffered;
+        if( chunk > size ) chunk =size;
+        memcpy( o->buffer + o->buffered, src, chunk );
+        o->buffered += chunk;
+        o->size += chunk;
+        src += chunk;
+        size -= chunk;
+        if( o->buffered == OOC_BUFFER_SIZE && flush( o ) != 0 ) return -1;
+    }
+    return 0;
+}
+
+/** Appends the finished row @row: @len values followed by their column indices.
+ */
+int
+ooc_append( ooc_t* o, indx_t row, const double values[], const indx_t col_ind[], size_t len ) {
+    o->row_off[row] =o->size;
+    o->row_len[row] =len;
+    o->count += len;
+    if( append_bytes( o, values, len * sizeof(double) ) != 0 ) return -1;
+    return append_bytes( o, col_ind, len * sizeof(indx_t) );
+}
+
+/** Writes the remaining buffered rows and maps the file for reading.
+ */
+int
+ooc_finish( ooc_t* o ) {
+    if( flush( o ) != 0 ) return -1;
+    free( o->buffer );
+    o->buffer =NULL;
+    if( o->size == 0 ) return 0;
+    o->map =(char*)mmap( NULL, o->size, PROT_READ, MAP_SHARED, o->fd, 0 );
+    if( o->map == MAP_FAILED ) {
+        o->map =NULL;
+        fprintf( stderr, "(e) ooc_finish(): mmap failed: %s\n", strerror( errno ) );
+        return -1;
+    }
+    // The substitutions sweep the rows in (reverse) factorisation order
+    madvise( o->map, o->size, MADV_SEQUENTIAL );
+    return 0;
+}
+
+void
+ooc_close( ooc_t* o ) {
+    if( o->map ) munmap( o->map, o->size );
+    if( o->fd != -1 ) close( o->fd );
+    free( o->row_off );
+    free( o->row_len );
+    free( o->buffer );
+    memset( o, 0, sizeof( ooc_t ) );
+    o->fd =-1;
+}
+
+static inline const double*
+row_values( const ooc_t* o, indx_t row ) {
+    return (const double*)(o->map + o->row_off[row]);
+}
+
+static inline const indx_t*
+row_col_ind( const ooc_t* o, indx_t row ) {
+    return (const indx_t*)(o->map + o->row_off[row] + o->row_len[row] * sizeof(double));
+}
+
+/** Computes forward substitution with the stored lower triangular matrix,
+ *  see l_subst().
+ */
+void
+ooc_l_subst( double c[], const ooc_t* o, const indx_t row_order[], const double b[] ) {
+    for( size_t ii =0; ii < o->n; ii++ ) {
+        const indx_t i =row_order[ii];
+        const double* values =row_values( o, i );
+        const indx_t* col_ind =row_col_ind( o, i );
+        c[i] = b[i];
+        for( indx_t j =0; j < o->row_len[i]; j++ ) {
+            const indx_t jj =col_ind[j];
+            if( jj >= ii ) break;
+            c[i] -= values[j] * c[row_order[jj]];
+        }
+        if( !isfinite( c[i] ) ) {
+            fprintf( stderr, "(e) ooc_l_subst: c[%ld] is not a number!\n", i );
+            abort();
+        }
+    }
+}
+
+/** Computes backward substitution with the stored upper triangular matrix,
+ *  see u_subst().
+ */
+void
+ooc_u_subst( double x[], const ooc_t* o, const indx_t row_order[], const double c[] ) {
+    for( ssize_t ii =o->n-1; ii >= 0; ii-- ) {
+        const indx_t i =row_order[ii];
+        const double* values =row_values( o, i );
+        const indx_t* col_ind =row_col_ind( o, i );
+        double d_value =1.0;
+        x[i] = c[i];
+        for( indx_t j =0; j < o->row_len[i]; j++ ) {
+            const sindx_t jj =col_ind[j];
+            if( jj == ii ) d_value =values[j];
+            else if( jj > ii ) x[i] -= values[j] * x[row_order[jj]];
+        }
+        x[i] /= d_value;
+        if( !isfinite( x[i] ) ) {
+            fprintf( stderr, "(e) ooc_u_subst: x[%ld] is not a number!\n", i );
+            abort();
+        }
+    }
+}
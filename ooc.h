@@ -0,0 +1,34 @@
+#ifndef OOC_H
+#define OOC_H
+
+#include "lup.h"
+
+#define OOC_BUFFER_SIZE (1<<22) // Bytes buffered before each sequential write
+
+/* File-backed store of finished rows of the L and U factors.
+ * Rows are appended sequentially while the factorisation runs and are
+ * memory-mapped for the substitutions once it has finished. The writes are
+ * buffered, so a row costs a memcpy; the elimination is that of lup().
+ */
+typedef struct ooc_t {
+    int     fd;
+    size_t  n;
+    size_t  size;               // Bytes appended so far
+    size_t  count;              // Elements appended so far
+    size_t* row_off;            // Byte offset of each row in the file, by physical row
+    indx_t* row_len;            // Number of elements of each row
+    char*   buffer;
+    size_t  buffered;
+    double  write_time;         // Seconds spent writing the buffer to the file
+    char*   map;                // Mapping of the file after ooc_finish()
+} ooc_t;
+
+int ooc_open( ooc_t* o, const char* path, size_t n );
+int ooc_append( ooc_t* o, indx_t row, const double values[], const indx_t col_ind[], size_t len );
+int ooc_finish( ooc_t* o );
+void ooc_close( ooc_t* o );
+
+void ooc_l_subst( double c[], const ooc_t* o, const indx_t row_order[], const double b[] );
+void ooc_u_subst( double x[], const ooc_t* o, const indx_t row_order[], const double c[] );
+
+#endif
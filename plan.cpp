@@ -0,0 +1,341 @@
+#include "plan.h"
+#include "band.h"
+#include "nd.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+/* Built-in rule table, measured with batch_train_plan.sh on the benchmark
+ * matrices. The format is that of plan_table_load(). */
+static const char DEFAULT_TABLE[] =
+    "# name n nnz symmetry bandwidth row_max row_cv zero_diag fill fill_rcm plan\n"
+    "mcfe 765 24382 0.699 187 81 0.531 0 4.94 3.90 ordering=natural,engine=lookahead,pivoting=partial,threads=0\n"
+    "c-21 3509 32157 1.000 3284 451 1.470 0 42.00 34.23 ordering=nd,engine=lup,pivoting=partial,threads=0\n"
+    "flowmeter5 9669 67391 1.000 844 11 0.056 0 16.53 61.67 ordering=nd,engine=lup,pivoting=partial,threads=0\n"
+    "epb1 14734 95053 0.729 140 7 0.090 0 43.07 34.07 ordering=nd,engine=lup,pivoting=partial,threads=0\n"
+    "meg4 5860 46842 1.000 5775 1194 2.382 54 37.66 131.96 ordering=nd,engine=lup,pivoting=partial,threads=0\n"
+    "cell1 7055 34855 0.997 85 5 0.058 0 23.26 27.19 ordering=nd,engine=lup,pivoting=partial,threads=0\n"
+    "mhd4800b 4800 27520 1.000 18 10 0.342 0 1.09 1.00 ordering=rcm,engine=band,pivoting=partial,threads=0\n"
+    "ex10 2410 54840 1.000 113 50 0.505 0 3.40 2.63 ordering=rcm,engine=band,pivoting=partial,threads=0\n"
+    "aft01 8205 125567 1.000 154 21 0.255 0 13.61 11.59 ordering=nd,engine=lup,pivoting=partial,threads=0\n"
+    ;
+
+static const char* ORDERING_NAME[] ={ "natural", "rcm", "nd" };
+static const char* ENGINE_NAME[] ={ "lup", "lookahead", "band" };
+static const char* PIVOTING_NAME[] ={ "partial", "static" };
+
+/** Estimates nnz(L+U) of the factorisation without pivotting of the pattern
+ *  given by @adj_ptr and @adj, with vertex @perm[ii] eliminated in step ii.
+ *  The elimination tree is built as by Liu, then the structure of
+ *  PLAN_N_SAMPLES rows of L, spread evenly, is counted by marking the paths
+ *  from the elements of each row up the tree.
+ */
+static double
+estimate_factor_size( const indx_t adj_ptr[], const indx_t adj[], size_t n, const indx_t perm[] ) {
+    std::vector<indx_t> pos( n ), parent( n, (indx_t)-1 ), ancestor( n, (indx_t)-1 );
+    for( size_t ii =0; ii < n; ii++ ) pos[perm[ii]] =ii;
+
+    for( size_t ii =0; ii < n; ii++ ) {
+        const indx_t v =perm[ii];
+        for( indx_t k =adj_ptr[v]; k < adj_ptr[v+1]; k++ ) {
+            indx_t r =pos[adj[k]];
+            if( r >= ii ) continue;
+            // Path compression towards the current root of r
+            while( ancestor[r] != (indx_t)-1 && ancestor[r] != ii ) {
+                const indx_t next =ancestor[r];
+                ancestor[r] =ii;
+                r =next;
+            }
+            if( ancestor[r] == (indx_t)-1 ) {
+                ancestor[r] =ii;
+                parent[r] =ii;
+            }
+        }
+    }
+
+    const size_t n_samples =std::min( n, (size_t)PLAN_N_SAMPLES );
+    std::vector<indx_t> mark( n, (indx_t)-1 );
+    double l_count =0.0;
+    for( size_t s =0; s < n_samples; s++ ) {
+        const indx_t ii =(indx_t)((s * n + n / 2) / n_samples);
+        const indx_t v =perm[ii];
+        mark[ii] =ii;
+        l_count += 1.0;
+        for( indx_t k =adj_ptr[v]; k < adj_ptr[v+1]; k++ ) {
+            // ii is an ancestor of every r < ii of the row
+            for( indx_t r =pos[adj[k]]; r < ii && mark[r] != ii; r =parent[r] ) {
+                mark[r] =ii;
+                l_count += 1.0;
+            }
+        }
+    }
+    if( n_samples == 0 ) return 0.0;
+    const double l_size =l_count * n / n_samples;
+    return 2.0 * l_size - n;
+}
+
+/** Computes the structural statistics @s of @m, including the fill estimated
+ *  by estimate_factor_size() in the natural and in the RCM ordering.
+ */
+void
+plan_analyse( plan_stats_t* s, const matrix_t* m ) {
+    const size_t n =m->m;
+    memset( s, 0, sizeof( plan_stats_t ) );
+    s->n =n;
+    s->nnz =m->count;
+
+    size_t off_diag =0;
+    double sum =0.0, sum_sq =0.0;
+    for( size_t i =0; i < n; i++ ) {
+        const size_t len =1 + m->row_ptr_end[i] - m->row_ptr_begin[i];
+        bool diag =false;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const size_t k =m->col_ind[j];
+            if( k == i ) { diag =true; continue; }
+            off_diag++;
+            s->bandwidth =std::max( s->bandwidth, k > i ? k - i : i - k );
+        }
+        if( !diag ) s->zero_diag++;
+        s->row_max =std::max( s->row_max, len );
+        sum += len;
+        sum_sq += (double)len * len;
+    }
+    if( n ) {
+        const double mean =sum / n;
+        s->row_cv =mean > 0.0 ? sqrt( std::max( 0.0, sum_sq / n - mean * mean ) ) / mean : 0.0;
+    }
+
+    indx_t *adj_ptr, *adj;
+    build_adjacency( m, &adj_ptr, &adj );
+    // Each edge of A+A^T stems from one or two off-diagonal elements of A
+    const size_t edges =adj_ptr[n] / 2;
+    s->symmetry =off_diag ? 2.0 * (off_diag - edges) / off_diag : 1.0;
+
+    std::vector<indx_t> perm( n );
+    for( size_t i =0; i < n; i++ ) perm[i] =i;
+    const double nnz =std::max( (size_t)1, s->nnz );
+    s->fill =estimate_factor_size( adj_ptr, adj, n, perm.data() ) / nnz;
+    free( adj_ptr );
+    free( adj );
+
+    // rcm_order() builds the adjacency itself, it is needed again afterwards
+    rcm_order( perm.data(), m );
+    build_adjacency( m, &adj_ptr, &adj );
+    s->fill_rcm =estimate_factor_size( adj_ptr, adj, n, perm.data() ) / nnz;
+    free( adj_ptr );
+    free( adj );
+}
+
+/** Estimates the fill of @m after nested dissection, as plan_analyse() does
+ *  for the natural and the RCM order, if @p orders by nested dissection. The
+ *  rules only match the structure, so if the estimate is not below both
+ *  others, @p falls back to the better of those orders that @filter allows,
+ *  with lup(). The ordering of nd_order() is left in @perm (@m->m entries)
+ *  and @nd, so it can be used without being computed again.
+ *  Returns the estimate, or 0 if @p does not order by nested dissection; 
+ *  @perm and @nd are then left untouched.
+ */
+double
+plan_check_nd( plan_t* p, const plan_stats_t* s, const matrix_t* m, plan_filter_t filter,
+               indx_t perm[], nd_stats_t* nd ) {
+    if( p->ordering != PLAN_ND ) return 0.0;
+    const size_t n =m->m;
+    nd_order( perm, m, nd );
+    indx_t *adj_ptr, *adj;
+    build_adjacency( m, &adj_ptr, &adj );
+    const double fill_nd =estimate_factor_size( adj_ptr, adj, n, perm ) / std::max( (size_t)1, s->nnz );
+    free( adj_ptr );
+    free( adj );
+    if( fill_nd >= std::min( s->fill, s->fill_rcm ) ) {
+        const plan_t rcm ={ PLAN_RCM, PLAN_LUP, p->pivoting, p->threads };
+        p->ordering =s->fill_rcm < s->fill && (!filter || filter( &rcm )) ? PLAN_RCM : PLAN_NATURAL;
+        p->engine =PLAN_LUP;
+    }
+    return fill_nd;
+}
+
+/** Returns -1 and prints why if @p is not a combination the solver supports. */
+static int
+check_plan( const plan_t* p ) {
+    const char* why =NULL;
+    if( p->engine == PLAN_BAND && p->ordering != PLAN_RCM )
+        why ="the band engine requires ordering=rcm";
+    else if( p->engine == PLAN_LOOKAHEAD && p->ordering != PLAN_NATURAL )
+        why ="the lookahead engine requires ordering=natural";
+    else if( p->pivoting == PLAN_STATIC && (p->ordering != PLAN_NATURAL || p->engine != PLAN_LUP) )
+        why ="static pivotting requires ordering=natural and engine=lup";
+    else if( p->threads < 0 )
+        why ="the number of threads cannot be negative";
+    if( !why ) return 0;
+    fprintf( stderr, "(e) Invalid plan: %s.\n", why );
+    return -1;
+}
+
+/** Looks up @value in the @count @names. Returns its index or -1. */
+static int
+lookup( const char* names[], int count, const char* value, size_t len ) {
+    for( int k =0; k < count; k++ )
+        if( strlen( names[k] ) == len && strncmp( names[k], value, len ) == 0 ) return k;
+    return -1;
+}
+
+/** Sets the fields of @p given by @spec, a comma separated list of
+ *  field=value with the fields ordering, engine, pivoting and threads, as
+ *  printed by plan_format(). Fields that are not given keep their value.
+ *  Returns -1 if @spec is malformed or the result is not a valid plan.
+ */
+int
+plan_parse( plan_t* p, const char* spec ) {
+    plan_t q =*p;
+    const char* c =spec;
+    while( *c ) {
+        const char* eq =strchr( c, '=' );
+        const char* end =c + strcspn( c, "," );
+        if( !eq || eq > end ) {
+            fprintf( stderr, "(e) Invalid plan field '%.*s', expected field=value.\n", (int)(end - c), c );
+            return -1;
+        }
+        const size_t key_len =eq - c, value_len =end - eq - 1;
+        const char* value =eq + 1;
+        int k =-1;
+        if( key_len == 8 && strncmp( c, "ordering", 8 ) == 0 ) {
+            if( (k =lookup( ORDERING_NAME, 3, value, value_len )) >= 0 ) q.ordering =(plan_ordering_t)k;
+        } else if( key_len == 6 && strncmp( c, "engine", 6 ) == 0 ) {
+            if( (k =lookup( ENGINE_NAME, 3, value, value_len )) >= 0 ) q.engine =(plan_engine_t)k;
+        } else if( key_len == 8 && strncmp( c, "pivoting", 8 ) == 0 ) {
+            if( (k =lookup( PIVOTING_NAME, 2, value, value_len )) >= 0 ) q.pivoting =(plan_pivoting_t)k;
+        } else if( key_len == 7 && strncmp( c, "threads", 7 ) == 0 ) {
+            char* num_end;
+            const long t =strtol( value, &num_end, 10 );
+            if( num_end == end && value_len > 0 ) { q.threads =(int)t; k =0; }
+        } else {
+            fprintf( stderr, "(e) Unknown plan field '%.*s'.\n", (int)key_len, c );
+            return -1;
+        }
+        if( k < 0 ) {
+            fprintf( stderr, "(e) Invalid value '%.*s' of plan field '%.*s'.\n", (int)value_len, value, (int)key_len, c );
+            return -1;
+        }
+        c =*end ? end + 1 : end;
+    }
+    if( check_plan( &q ) ) return -1;
+    *p =q;
+    return 0;
+}
+
+/** Writes @p to @buf in the syntax of plan_parse(). */
+void
+plan_format( char* buf, size_t len, const plan_t* p ) {
+    snprintf( buf, len, "ordering=%s,engine=%s,pivoting=%s,threads=%d",
+              ORDERING_NAME[p->ordering], ENGINE_NAME[p->engine], PIVOTING_NAME[p->pivoting], p->threads );
+}
+
+/** Writes @s to @buf as the statistics columns of a rule, see plan_table_load(). */
+void
+plan_format_stats( char* buf, size_t len, const plan_stats_t* s ) {
+    snprintf( buf, len, "%ld %ld %.3f %ld %ld %.3f %ld %.2f %.2f",
+              s->n, s->nnz, s->symmetry, s->bandwidth, s->row_max, s->row_cv, s->zero_diag, s->fill, s->fill_rcm );
+}
+
+/** Appends the rules read from @fh to @t. Each line holds a rule as
+ *      name n nnz symmetry bandwidth row_max row_cv zero_diag fill fill_rcm plan
+ *  where plan is in the syntax of plan_parse(); empty lines and lines
+ *  starting with # are skipped. Returns -1 on a malformed line.
+ */
+static int
+read_table( plan_table_t* t, FILE* fh, const char* filename ) {
+    char line[512];
+    size_t line_no =0;
+    while( fgets( line, sizeof( line ), fh ) ) {
+        line_no++;
+        const char* c =line + strspn( line, " \t" );
+        if( *c == '#' || *c == '\n' || *c == '\0' ) continue;
+
+        plan_rule_t r;
+        memset( &r, 0, sizeof( plan_rule_t ) );
+        char spec[128];
+        if( sscanf( c, "%31s %ld %ld %lf %ld %ld %lf %ld %lf %lf %127s", r.name, &r.stats.n, &r.stats.nnz,
+                    &r.stats.symmetry, &r.stats.bandwidth, &r.stats.row_max, &r.stats.row_cv,
+                    &r.stats.zero_diag, &r.stats.fill, &r.stats.fill_rcm, spec ) != 11
+         || plan_parse( &r.plan, spec ) ) {
+            fprintf( stderr, "(e) %s:%ld: malformed rule.\n", filename, line_no );
+            return -1;
+        }
+        t->rules =(plan_rule_t*)realloc( t->rules, (t->n_rules + 1) * sizeof(plan_rule_t) );
+        t->rules[t->n_rules++] =r;
+    }
+    return 0;
+}
+
+/** Loads the rule table @t from @filename, or the built-in table if
+ *  @filename is NULL. Returns -1 on error.
+ */
+int
+plan_table_load( plan_table_t* t, const char* filename ) {
+    t->n_rules =0;
+    t->rules =NULL;
+    FILE* fh =filename ? fopen( filename, "r" )
+                       : fmemopen( (void*)DEFAULT_TABLE, sizeof( DEFAULT_TABLE ) - 1, "r" );
+    if( !fh ) {
+        perror( "fopen" );
+        return -1;
+    }
+    const int err =read_table( t, fh, filename ? filename : "built-in table" );
+    fclose( fh );
+    return err;
+}
+
+void
+plan_table_free( plan_table_t* t ) {
+    free( t->rules );
+    t->rules =NULL;
+    t->n_rules =0;
+}
+
+/** Returns the squared distance between the statistics @a and @b. Sizes and
+ *  ratios are compared by their logarithms, fractions as they are.
+ */
+static double
+distance( const plan_stats_t* a, const plan_stats_t* b ) {
+    auto log_diff =[]( double x, double y ) {
+        const double d =log( std::max( x, 1e-3 ) ) - log( std::max( y, 1e-3 ) );
+        return d * d;
+    };
+    auto diff =[]( double x, double y ) { return (x - y) * (x - y); };
+    const double an =std::max( (size_t)1, a->n ), bn =std::max( (size_t)1, b->n );
+    return log_diff( an, bn )
+         + log_diff( a->nnz / an, b->nnz / bn )
+         + log_diff( (a->bandwidth + 1) / an, (b->bandwidth + 1) / bn )
+         + log_diff( a->row_max * an / std::max( (size_t)1, a->nnz ), b->row_max * bn / std::max( (size_t)1, b->nnz ) )
+         + log_diff( a->fill, b->fill )
+         + log_diff( a->fill_rcm, b->fill_rcm )
+         + diff( a->symmetry, b->symmetry )
+         + diff( a->row_cv, b->row_cv )
+         + diff( a->zero_diag / an, b->zero_diag / bn );
+}
+
+/** Sets @p to the plan of the rule of @t whose statistics are closest to
+ *  @s, see distance(), and returns that rule. Only rules whose plan @filter
+ *  allows are considered. If there are none, @p is set to plain lup() and
+ *  NULL is returned.
+ */
+const plan_rule_t*
+plan_select( plan_t* p, const plan_table_t* t, const plan_stats_t* s, plan_filter_t filter ) {
+    const plan_t fallback ={ PLAN_NATURAL, PLAN_LUP, PLAN_PARTIAL, 0 };
+    *p =fallback;
+    const plan_rule_t* best =NULL;
+    double best_d =INFINITY;
+    for( size_t k =0; k < t->n_rules; k++ ) {
+        if( filter && !filter( &t->rules[k].plan ) ) continue;
+        const double d =distance( s, &t->rules[k].stats );
+        if( d < best_d ) {
+            best_d =d;
+            best =&t->rules[k];
+        }
+    }
+    if( best ) *p =best->plan;
+    return best;
+}
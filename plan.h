@@ -0,0 +1,62 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include "lup.h"
+#include "nd.h"
+
+#define PLAN_N_SAMPLES 256 // Rows of L whose structure is counted to estimate the fill
+#define PLAN_NAME_LEN 32
+
+/* Structural statistics of A, computed by plan_analyse() */
+typedef struct {
+    size_t n, nnz;
+    double symmetry;            // Fraction of the off-diagonal elements whose transposed element exists
+    size_t bandwidth;           // Largest |i-j| of an element
+    size_t row_max;             // Longest row
+    double row_cv;              // Coefficient of variation of the row lengths
+    size_t zero_diag;           // Rows without a diagonal element
+    double fill;                // Estimated nnz(L+U)/nnz(A) of A+A^T without pivotting
+    double fill_rcm;            // The same after RCM ordering
+} plan_stats_t;
+
+typedef enum { PLAN_NATURAL, PLAN_RCM, PLAN_ND } plan_ordering_t;
+typedef enum { PLAN_LUP, PLAN_LOOKAHEAD, PLAN_BAND } plan_engine_t;
+typedef enum { PLAN_PARTIAL, PLAN_STATIC } plan_pivoting_t;
+
+/* How the direct solver factors A */
+typedef struct {
+    plan_ordering_t ordering;
+    plan_engine_t   engine;     // lup(), lup_lookahead() or the band LU of --rcm
+    plan_pivoting_t pivoting;   // Partial pivotting, or static pivots after mc64
+    int             threads;    // 0 for the default number of threads
+} plan_t;
+
+/* Rule table: each rule holds the statistics of a benchmark matrix and the
+ * fastest plan measured for it. plan_select() takes the plan of the rule
+ * with the closest statistics.
+ */
+typedef struct {
+    char         name[PLAN_NAME_LEN];
+    plan_stats_t stats;
+    plan_t       plan;
+} plan_rule_t;
+
+typedef struct {
+    size_t       n_rules;
+    plan_rule_t* rules;
+} plan_table_t;
+
+/* Plans the caller can carry out, NULL for all */
+typedef bool (*plan_filter_t)( const plan_t* );
+
+void plan_analyse( plan_stats_t* s, const matrix_t* m );
+int plan_table_load( plan_table_t* t, const char* filename );
+void plan_table_free( plan_table_t* t );
+const plan_rule_t* plan_select( plan_t* p, const plan_table_t* t, const plan_stats_t* s, plan_filter_t filter );
+double plan_check_nd( plan_t* p, const plan_stats_t* s, const matrix_t* m, plan_filter_t filter,
+                      indx_t perm[], nd_stats_t* nd );
+int plan_parse( plan_t* p, const char* spec );
+void plan_format( char* buf, size_t len, const plan_t* p );
+void plan_format_stats( char* buf, size_t len, const plan_stats_t* s );
+
+#endif
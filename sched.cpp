@@ -0,0 +1,82 @@
+#include "sched.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+/* Task queue of a worker. The owner pushes and pops at the back, so it 
+ * continues with the parent of the subtree it just finished; idle workers
+ * steal from the front, which holds the oldest (largest) pending subtrees.
+ */
+typedef struct {
+    std::mutex         lock;
+    std::deque<size_t> tasks;
+} worker_t;
+
+static bool
+pop_task( worker_t* w, size_t* task, bool back ) {
+    std::lock_guard<std::mutex> guard( w->lock );
+    if( w->tasks.empty() ) return false;
+    if( back ) {
+        *task =w->tasks.back();
+        w->tasks.pop_back();
+    } else {
+        *task =w->tasks.front();
+        w->tasks.pop_front();
+    }
+    return true;
+}
+
+/** Executes the tasks 0..@n-1 using @n_threads threads, such that each task
+ *  runs after all of its children in the forest given by @parent (-1 for roots).
+ *  Independent subtrees are executed concurrently; each worker has its own
+ *  deque of ready tasks and steals from the others when it runs dry.
+ */
+void
+sched_tree( const sindx_t parent[], size_t n, size_t n_threads, task_func_t func, void* user ) {
+    if( n_threads < 2 ) {
+        // Positions are a topological order of the tree
+        for( size_t t =0; t < n; t++ ) func( t, user );
+        return;
+    }
+
+    std::vector<std::atomic<size_t>> pending( n );
+    for( size_t t =0; t < n; t++ ) pending[t] =0;
+    for( size_t t =0; t < n; t++ )
+        if( parent[t] != -1 ) pending[parent[t]]++;
+
+    // Distribute the leaves round robin
+    std::vector<worker_t> workers( n_threads );
+    size_t n_leaves =0;
+    for( size_t t =0; t < n; t++ )
+        if( pending[t] == 0 ) workers[n_leaves++ % n_threads].tasks.push_back( t );
+
+    std::atomic<size_t> n_done( 0 );
+    auto run =[&]( size_t id ) {
+        worker_t* self =&workers[id];
+        size_t task;
+        while( n_done < n ) {
+            bool found =pop_task( self, &task, true );
+            for( size_t v =1; !found && v < n_threads; v++ )
+                found =pop_task( &workers[(id + v) % n_threads], &task, false );
+            if( !found ) {
+                std::this_thread::yield();
+                continue;
+            }
+            func( task, user );
+            // The last finished child makes the parent ready
+            if( parent[task] != -1 && --pending[parent[task]] == 0 ) {
+                std::lock_guard<std::mutex> guard( self->lock );
+                self->tasks.push_back( parent[task] );
+            }
+            n_done++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for( size_t id =1; id < n_threads; id++ )
+        threads.emplace_back( run, id );
+    run( 0 );
+    for( auto& t : threads ) t.join();
+}
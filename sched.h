@@ -0,0 +1,11 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "matrix.h"
+
+/* Function that executes @task, see sched_tree() */
+typedef void (*task_func_t)( size_t task, void* user );
+
+void sched_tree( const sindx_t parent[], size_t n, size_t n_threads, task_func_t func, void* user );
+
+#endif
@@ -0,0 +1,130 @@
+#include "schur.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "simd.h"
+
+/** Eliminates the @k unknowns (columns) @unknowns of the square matrix @m and
+ *  stores the Schur complement on the remaining unknowns in @s. The columns
+ *  of @m are renumbered so that the eliminated unknowns come first, in the
+ *  order given, and the rows with the same numbers are preferred as pivot
+ *  rows; the other rows are only used if the preferred ones lack a large
+ *  enough pivot, see lup_partial(). On return @m holds the partial factors
+ *  L11, L21, U11 and U12 in the format of lup(), as well as S.
+ *  Returns -1 if @unknowns is not a set of valid unknowns.
+ */
+int
+schur_factor( schur_t* s, matrix_t* m, const indx_t unknowns[], size_t k ) {
+    const size_t n =m->m;
+    if( m->m != m->n || k > n ) {
+        fprintf( stderr, "(e) schur_factor(): cannot eliminate %ld unknowns of a %ldx%ld matrix.\n", k, m->m, m->n );
+        return -1;
+    }
+    char* selected =(char*)calloc( n, 1 );
+    for( size_t j =0; j < k; j++ ) {
+        if( unknowns[j] >= n || selected[unknowns[j]] ) {
+            fprintf( stderr, "(e) schur_factor(): invalid or repeated unknown %ld.\n", unknowns[j] );
+            free( selected );
+            return -1;
+        }
+        selected[unknowns[j]] =1;
+    }
+
+    s->k =k;
+    s->n =n - k;
+    s->col_perm =(indx_t*)malloc( n * sizeof(indx_t) );
+    memcpy( s->col_perm, unknowns, k * sizeof(indx_t) );
+    for( size_t j =0, jj =k; j < n; j++ )
+        if( !selected[j] ) s->col_perm[jj++] =j;
+    free( selected );
+
+    matrix_permute_columns( m, s->col_perm );
+    memcpy( m->row_order, s->col_perm, n * sizeof(indx_t) );
+    lup_partial( m, k );
+
+    // Copy the trailing block, column k of the factors is column 0 of S
+    s->row =(indx_t*)malloc( s->n * sizeof(indx_t) );
+    s->row_ptr =(indx_t*)malloc( (s->n + 1) * sizeof(indx_t) );
+    size_t count =0;
+    for( size_t r =0; r < s->n; r++ ) {
+        const indx_t i =m->row_order[k + r];
+        count += 1 + m->row_ptr_end[i] - m->row_ptr_begin[i];
+    }
+    s->col_ind =(indx_t*)malloc( count * sizeof(indx_t) );
+    s->values =(double*)malloc( count * sizeof(double) );
+    indx_t o =0;
+    for( size_t r =0; r < s->n; r++ ) {
+        const indx_t i =m->row_order[k + r];
+        s->row[r] =i;
+        s->row_ptr[r] =o;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            if( m->col_ind[j] < k ) continue; // Multiplier of L21
+            s->col_ind[o] =m->col_ind[j] - k;
+            s->values[o++] =m->values[j];
+        }
+    }
+    s->row_ptr[s->n] =o;
+    return 0;
+}
+
+/** Stores the Schur complement of @s as a dense, row-major @s->n x @s->n
+ *  matrix in @a.
+ */
+void
+schur_to_dense( const schur_t* s, double a[] ) {
+    memset( a, 0, s->n * s->n * sizeof(double) );
+    for( size_t r =0; r < s->n; r++ )
+        for( indx_t j =s->row_ptr[r]; j < s->row_ptr[r+1]; j++ )
+            a[r * s->n + s->col_ind[j]] =s->values[j];
+}
+
+/** Forward substitution with the partial factors: computes c1 in L11 c1 = b1
+ *  and the right-hand side g = b2 - L21 c1 of the Schur complement system.
+ *  @b and @c are indexed by row as in l_subst(), only the rows eliminated by
+ *  schur_factor() are set in @c. @g has the order of the rows of S.
+ */
+void
+schur_l_subst( double c[], double g[], matrix_t* m, const schur_t* s, const double b[] ) {
+    for( size_t ii =0; ii < m->m; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        const indx_t begin =m->row_ptr_begin[i];
+        // The multipliers are the elements left of column ii, or of S
+        const size_t len =SIMD.lower_bound( &m->col_ind[begin], 1 + m->row_ptr_end[i] - begin, std::min( ii, s->k ) );
+        const double v =b[i] - SIMD.dot_perm( &m->values[begin], &m->col_ind[begin], len, m->row_order, c );
+        if( ii < s->k ) c[i] =v;
+        else g[ii - s->k] =v;
+    }
+}
+
+/** Backward substitution with the partial factors: computes x1 in
+ *  U11 x1 = c1 - U12 @y, where @c comes from schur_l_subst() and @y solves
+ *  S y = g. Stores x1 and @y in @x, indexed by the original unknowns.
+ */
+void
+schur_u_subst( double x[], matrix_t* m, const schur_t* s, const double c[], const double y[] ) {
+    // Solution by column of the factors
+    double* w =(double*)malloc( m->m * sizeof(double) );
+    memcpy( &w[s->k], y, s->n * sizeof(double) );
+    for( ssize_t ii =s->k-1; ii >= 0; ii-- ) {
+        const indx_t i =m->row_order[ii];
+        const indx_t begin =m->row_ptr_begin[i];
+        const size_t len =1 + m->row_ptr_end[i] - begin;
+        size_t u =SIMD.lower_bound( &m->col_ind[begin], len, ii );
+        double d_value =1.0;
+        if( u < len && m->col_ind[begin + u] == (indx_t)ii ) d_value =m->values[begin + u++];
+        w[ii] =(c[i] - SIMD.dot( &m->values[begin + u], &m->col_ind[begin + u], len - u, w )) / d_value;
+    }
+    for( size_t j =0; j < m->m; j++ ) x[s->col_perm[j]] =w[j];
+    free( w );
+}
+
+void
+schur_free( schur_t* s ) {
+    free( s->col_perm );
+    free( s->row );
+    free( s->row_ptr );
+    free( s->col_ind );
+    free( s->values );
+    memset( s, 0, sizeof( schur_t ) );
+}
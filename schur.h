@@ -0,0 +1,29 @@
+#ifndef SCHUR_H
+#define SCHUR_H
+
+#include "lup.h"
+
+/* Partial factorisation of A computed by schur_factor(): the k selected
+ * (interior) unknowns are eliminated, leaving the Schur complement
+ * S = A22 - A21 A11^-1 A12 on the other n unknowns, to be solved elsewhere.
+ * Unknown col_perm[j] is column j of the factors, the eliminated ones first.
+ * The rows of S are the rows at positions k.. of m->row_order, and column j
+ * of S is column k+j of the factors.
+ */
+typedef struct {
+    size_t  k;                  // Eliminated unknowns
+    size_t  n;                  // Order of the Schur complement
+    indx_t* col_perm;           // Column -> original unknown (k+n)
+    indx_t* row;                // Original row of each row of S (n)
+    indx_t* row_ptr;            // S in CRS form (n+1)
+    indx_t* col_ind;
+    double* values;
+} schur_t;
+
+int schur_factor( schur_t* s, matrix_t* m, const indx_t unknowns[], size_t k );
+void schur_to_dense( const schur_t* s, double a[] );
+void schur_l_subst( double c[], double g[], matrix_t* m, const schur_t* s, const double b[] );
+void schur_u_subst( double x[], matrix_t* m, const schur_t* s, const double c[], const double y[] );
+void schur_free( schur_t* s );
+
+#endif
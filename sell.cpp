@@ -0,0 +1,149 @@
+#include "sell.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/** Builds the SELL-@C-@sigma representation of @m in its current row order.
+ *  Row ii of the result corresponds to row @m->row_order[ii] of @m, like in 
+ *  mult_matvec(). Returns 0 on success, -1 if memory could not be allocated.
+ */
+int
+sell_build( sell_t* s, matrix_t* m, size_t C, size_t sigma ) {
+    memset( s, 0, sizeof( sell_t ) );
+    if( C == 0 ) C =SELL_DEFAULT_C;
+    if( sigma < C ) sigma =C;
+    sigma -= sigma % C; // Windows consist of whole slices
+
+    s->m =m->m; s->n =m->n;
+    s->C =C; s->sigma =sigma;
+    s->n_slices =(m->m + C - 1) / C;
+
+    s->slice_ptr =(indx_t*)malloc( (s->n_slices+1) * sizeof(indx_t) );
+    s->slice_len =(indx_t*)malloc( s->n_slices * sizeof(indx_t) );
+    s->perm      =(indx_t*)malloc( s->n_slices * C * sizeof(indx_t) );
+    if( !s->slice_ptr || !s->slice_len || !s->perm ) {
+        fprintf( stderr, "(e) sell_build(): out of memory.\n" );
+        sell_free( s );
+        return -1;
+    }
+
+    // Sort the rows by descending length within each window of sigma rows
+    for( size_t ii =0; ii < s->n_slices * C; ii++ ) s->perm[ii] = ii < m->m ? ii : m->m;
+    for( size_t w =0; w < m->m; w += sigma ) {
+        size_t end =std::min( w + sigma, (size_t)m->m );
+        std::stable_sort( &s->perm[w], &s->perm[end], [m]( indx_t a, indx_t b ) {
+            const indx_t ra =m->row_order[a], rb =m->row_order[b];
+            return 1 + m->row_ptr_end[ra] - m->row_ptr_begin[ra] > 1 + m->row_ptr_end[rb] - m->row_ptr_begin[rb];
+        } );
+    }
+
+    // Determine the padded length of each slice
+    s->slice_ptr[0] =0;
+    for( size_t sl =0; sl < s->n_slices; sl++ ) {
+        size_t len =0;
+        for( size_t r =0; r < C; r++ ) {
+            const indx_t ii =s->perm[sl*C+r];
+            if( ii == m->m ) continue;
+            const indx_t i =m->row_order[ii];
+            len =std::max( len, (size_t)(1 + m->row_ptr_end[i] - m->row_ptr_begin[i]) );
+        }
+        s->slice_len[sl] =len;
+        s->slice_ptr[sl+1] =s->slice_ptr[sl] + len * C;
+    }
+    s->count =s->slice_ptr[s->n_slices];
+
+    s->values  =(double*)malloc( s->count * sizeof(double) );
+    s->col_ind =(indx_t*)malloc( s->count * sizeof(indx_t) );
+    if( !s->values || !s->col_ind ) {
+        fprintf( stderr, "(e) sell_build(): out of memory.\n" );
+        sell_free( s );
+        return -1;
+    }
+
+    // Fill the slices column-major, padding is an explicit zero in column 0
+#pragma omp parallel for schedule(static)
+    for( size_t sl =0; sl < s->n_slices; sl++ ) {
+        double* val =&s->values[s->slice_ptr[sl]];
+        indx_t* col =&s->col_ind[s->slice_ptr[sl]];
+        for( size_t r =0; r < C; r++ ) {
+            const indx_t ii =s->perm[sl*C+r];
+            size_t len =0;
+            indx_t begin =0;
+            if( ii != m->m ) {
+                const indx_t i =m->row_order[ii];
+                begin =m->row_ptr_begin[i];
+                len =1 + m->row_ptr_end[i] - begin;
+            }
+            for( size_t j =0; j < s->slice_len[sl]; j++ ) {
+                val[j*C+r] = j < len ? m->values[begin+j] : 0.0;
+                col[j*C+r] = j < len ? m->col_ind[begin+j] : 0;
+            }
+        }
+    }
+    return 0;
+}
+
+void
+sell_free( sell_t* s ) {
+    free( s->slice_ptr );
+    free( s->slice_len );
+    free( s->perm );
+    free( s->values );
+    free( s->col_ind );
+    memset( s, 0, sizeof( sell_t ) );
+}
+
+/** Computes b in Ax = b using the SELL representation @s.
+ *  The inner loop runs over the C rows of a slice and vectorizes without
+ *  remainder handling.
+ */
+void
+sell_matvec( double b[], const sell_t* s, const double x[] ) {
+    const size_t C =s->C;
+#pragma omp parallel for schedule(static)
+    for( size_t sl =0; sl < s->n_slices; sl++ ) {
+        double sum[C];
+        const double* val =&s->values[s->slice_ptr[sl]];
+        const indx_t* col =&s->col_ind[s->slice_ptr[sl]];
+        for( size_t r =0; r < C; r++ ) sum[r] =0.0;
+        for( size_t j =0; j < s->slice_len[sl]; j++ ) {
+#pragma omp simd
+            for( size_t r =0; r < C; r++ )
+                sum[r] += val[j*C+r] * x[col[j*C+r]];
+        }
+        for( size_t r =0; r < C; r++ ) {
+            const indx_t ii =s->perm[sl*C+r];
+            if( ii != s->m ) b[ii] =sum[r];
+        }
+    }
+}
+
+/** Computes @k products at once, i.e. B in AX = B, in a single pass over @s.
+ *  Vector v of X starts at @x + v*@ldx, vector v of B at @b + v*@ldb.
+ */
+void
+sell_matmat( double b[], size_t ldb, const sell_t* s, const double x[], size_t ldx, size_t k ) {
+    const size_t C =s->C;
+#pragma omp parallel for schedule(static)
+    for( size_t sl =0; sl < s->n_slices; sl++ ) {
+        double sum[k][C];
+        const double* val =&s->values[s->slice_ptr[sl]];
+        const indx_t* col =&s->col_ind[s->slice_ptr[sl]];
+        for( size_t v =0; v < k; v++ )
+            for( size_t r =0; r < C; r++ ) sum[v][r] =0.0;
+        for( size_t j =0; j < s->slice_len[sl]; j++ ) {
+            for( size_t v =0; v < k; v++ ) {
+                const double* xv =&x[v*ldx];
+#pragma omp simd
+                for( size_t r =0; r < C; r++ )
+                    sum[v][r] += val[j*C+r] * xv[col[j*C+r]];
+            }
+        }
+        for( size_t r =0; r < C; r++ ) {
+            const indx_t ii =s->perm[sl*C+r];
+            if( ii == s->m ) continue;
+            for( size_t v =0; v < k; v++ ) b[v*ldb+ii] =sum[v][r];
+        }
+    }
+}
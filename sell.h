@@ -0,0 +1,32 @@
+#ifndef SELL_H
+#define SELL_H
+
+#include "lup.h"
+
+#define SELL_DEFAULT_C 8
+#define SELL_DEFAULT_SIGMA 256
+
+/* Sliced ELLPACK (SELL-C-sigma) copy of a CRS matrix.
+ * Rows are sorted by length within windows of @sigma rows and grouped into
+ * slices of @C rows. Each slice is padded to its longest row and stored
+ * column-major, so that C consecutive elements belong to C different rows.
+ */
+typedef struct {
+    size_t  m, n;
+    size_t  C, sigma;
+    size_t  n_slices;
+    indx_t* slice_ptr;          // Offset of each slice in values/col_ind (n_slices+1)
+    indx_t* slice_len;          // Padded row length of each slice
+    indx_t* perm;               // Slice row -> logical row (n_slices*C, padding rows are m)
+    double* values;
+    indx_t* col_ind;
+    size_t  count;              // Stored elements including padding
+} sell_t;
+
+int sell_build( sell_t* s, matrix_t* m, size_t C, size_t sigma );
+void sell_free( sell_t* s );
+
+void sell_matvec( double b[], const sell_t* s, const double x[] );
+void sell_matmat( double b[], size_t ldb, const sell_t* s, const double x[], size_t ldx, size_t k );
+
+#endif
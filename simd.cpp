@@ -0,0 +1,306 @@
+#include "simd.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+
+/*
+ * SSE2, the x86-64 baseline: plain C that -O3 compiles to SSE2 code
+ */
+
+static double
+dot_sse2( const double val[], const indx_t col[], size_t len, const double x[] ) {
+    double s0 =0.0, s1 =0.0;
+    size_t j =0;
+    for( ; j+2 <= len; j += 2 ) {
+        s0 += val[j] * x[col[j]];
+        s1 += val[j+1] * x[col[j+1]];
+    }
+    if( j < len ) s0 += val[j] * x[col[j]];
+    return s0 + s1;
+}
+
+static double
+dot_perm_sse2( const double val[], const indx_t col[], size_t len, const indx_t perm[], const double x[] ) {
+    double s0 =0.0, s1 =0.0;
+    size_t j =0;
+    for( ; j+2 <= len; j += 2 ) {
+        s0 += val[j] * x[perm[col[j]]];
+        s1 += val[j+1] * x[perm[col[j+1]]];
+    }
+    if( j < len ) s0 += val[j] * x[perm[col[j]]];
+    return s0 + s1;
+}
+
+static size_t
+lower_bound_sse2( const indx_t col_ind[], size_t n, indx_t col ) {
+    size_t k =0;
+    while( k < n && col_ind[k] < col ) k++;
+    return k;
+}
+
+static size_t
+iamax_sse2( const double v[], size_t n ) {
+    size_t p =0;
+    for( size_t k =1; k < n; k++ )
+        if( fabs( v[k] ) > fabs( v[p] ) ) p =k;
+    return p;
+}
+
+static void
+axpy_sse2( double y[], double a, const double x[], size_t n ) {
+    for( size_t j =0; j < n; j++ ) y[j] -= a * x[j];
+}
+
+static size_t
+sub_run_sse2( const indx_t ci[], const double vi[], const indx_t ck[], const double vk[], size_t n,
+                double a, indx_t co[], double vo[] ) {
+    size_t j =0;
+    for( ; j < n && ci[j] == ck[j]; j++ ) {
+        const double v =vk[j] - vi[j] * a;
+        if( v == 0.0 ) break;
+        co[j] =ck[j];
+        vo[j] =v;
+    }
+    return j;
+}
+
+/*
+ * AVX2: gathers for the indirect loads, 64-bit compares for the searches
+ */
+
+__attribute__((target("avx2,fma"))) static inline double
+hsum_avx2( __m256d v ) {
+    const __m128d s =_mm_add_pd( _mm256_castpd256_pd128( v ), _mm256_extractf128_pd( v, 1 ) );
+    return _mm_cvtsd_f64( _mm_add_sd( s, _mm_unpackhi_pd( s, s ) ) );
+}
+
+__attribute__((target("avx2,fma"))) static double
+dot_avx2( const double val[], const indx_t col[], size_t len, const double x[] ) {
+    __m256d acc =_mm256_setzero_pd();
+    size_t j =0;
+    for( ; j+4 <= len; j += 4 ) {
+        const __m256i idx =_mm256_loadu_si256( (const __m256i*)&col[j] );
+        acc =_mm256_fmadd_pd( _mm256_loadu_pd( &val[j] ), _mm256_i64gather_pd( x, idx, 8 ), acc );
+    }
+    double s =hsum_avx2( acc );
+    for( ; j < len; j++ ) s += val[j] * x[col[j]];
+    return s;
+}
+
+__attribute__((target("avx2,fma"))) static double
+dot_perm_avx2( const double val[], const indx_t col[], size_t len, const indx_t perm[], const double x[] ) {
+    __m256d acc =_mm256_setzero_pd();
+    size_t j =0;
+    for( ; j+4 <= len; j += 4 ) {
+        const __m256i idx =_mm256_loadu_si256( (const __m256i*)&col[j] );
+        const __m256i pidx =_mm256_i64gather_epi64( (const long long*)perm, idx, 8 );
+        acc =_mm256_fmadd_pd( _mm256_loadu_pd( &val[j] ), _mm256_i64gather_pd( x, pidx, 8 ), acc );
+    }
+    double s =hsum_avx2( acc );
+    for( ; j < len; j++ ) s += val[j] * x[perm[col[j]]];
+    return s;
+}
+
+__attribute__((target("avx2"))) static size_t
+lower_bound_avx2( const indx_t col_ind[], size_t n, indx_t col ) {
+    const __m256i c =_mm256_set1_epi64x( col );
+    size_t k =0;
+    for( ; k+4 <= n; k += 4 ) {
+        const __m256i v =_mm256_loadu_si256( (const __m256i*)&col_ind[k] );
+        // Lanes that are still below @col, indices fit in a signed 64-bit integer
+        const int below =_mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( c, v ) ) );
+        if( below != 0xF ) return k + __builtin_ctz( ~below );
+    }
+    while( k < n && col_ind[k] < col ) k++;
+    return k;
+}
+
+__attribute__((target("avx2"))) static size_t
+iamax_avx2( const double v[], size_t n ) {
+    const __m256d sign =_mm256_set1_pd( -0.0 );
+    __m256d m =_mm256_setzero_pd();
+    size_t k =0;
+    for( ; k+4 <= n; k += 4 ) m =_mm256_max_pd( m, _mm256_andnot_pd( sign, _mm256_loadu_pd( &v[k] ) ) );
+    __m128d h =_mm_max_pd( _mm256_castpd256_pd128( m ), _mm256_extractf128_pd( m, 1 ) );
+    double max =fmax( _mm_cvtsd_f64( h ), _mm_cvtsd_f64( _mm_unpackhi_pd( h, h ) ) );
+    for( ; k < n; k++ ) max =fmax( max, fabs( v[k] ) );
+    // First occurrence of the maximum
+    for( k =0; k < n; k++ )
+        if( fabs( v[k] ) == max ) return k;
+    return 0;
+}
+
+__attribute__((target("avx2"))) static void
+axpy_avx2( double y[], double a, const double x[], size_t n ) {
+    const __m256d av =_mm256_set1_pd( a );
+    size_t j =0;
+    for( ; j+4 <= n; j += 4 )
+        _mm256_storeu_pd( &y[j], _mm256_sub_pd( _mm256_loadu_pd( &y[j] ), _mm256_mul_pd( av, _mm256_loadu_pd( &x[j] ) ) ) );
+    for( ; j < n; j++ ) y[j] -= a * x[j];
+}
+
+__attribute__((target("avx2"))) static size_t
+sub_run_avx2( const indx_t ci[], const double vi[], const indx_t ck[], const double vk[], size_t n,
+              double a, indx_t co[], double vo[] ) {
+    const __m256d av =_mm256_set1_pd( a );
+    size_t j =0;
+    for( ; j+4 <= n; j += 4 ) {
+        const __m256i c =_mm256_loadu_si256( (const __m256i*)&ck[j] );
+        const __m256i eq =_mm256_cmpeq_epi64( _mm256_loadu_si256( (const __m256i*)&ci[j] ), c );
+        if( _mm256_movemask_pd( _mm256_castsi256_pd( eq ) ) != 0xF ) break;
+        const __m256d v =_mm256_sub_pd( _mm256_loadu_pd( &vk[j] ), _mm256_mul_pd( _mm256_loadu_pd( &vi[j] ), av ) );
+        if( _mm256_movemask_pd( _mm256_cmp_pd( v, _mm256_setzero_pd(), _CMP_EQ_OQ ) ) ) break;
+        _mm256_storeu_si256( (__m256i*)&co[j], c );
+        _mm256_storeu_pd( &vo[j], v );
+    }
+    return j + sub_run_sse2( &ci[j], &vi[j], &ck[j], &vk[j], n - j, a, &co[j], &vo[j] );
+}
+
+/*
+ * AVX-512: as AVX2, with masked remainders
+ */
+
+// GCC 12 warns about the _mm512_undefined_*() inside the intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f"))) static double
+dot_avx512( const double val[], const indx_t col[], size_t len, const double x[] ) {
+    __m512d acc =_mm512_setzero_pd();
+    size_t j =0;
+    for( ; j+8 <= len; j += 8 ) {
+        const __m512i idx =_mm512_loadu_si512( &col[j] );
+        acc =_mm512_fmadd_pd( _mm512_loadu_pd( &val[j] ), _mm512_i64gather_pd( idx, x, 8 ), acc );
+    }
+    if( j < len ) {
+        const __mmask8 mask =(1 << (len - j)) - 1;
+        const __m512i idx =_mm512_maskz_loadu_epi64( mask, &col[j] );
+        const __m512d xv =_mm512_mask_i64gather_pd( _mm512_setzero_pd(), mask, idx, x, 8 );
+        acc =_mm512_fmadd_pd( _mm512_maskz_loadu_pd( mask, &val[j] ), xv, acc );
+    }
+    return _mm512_reduce_add_pd( acc );
+}
+
+__attribute__((target("avx512f"))) static double
+dot_perm_avx512( const double val[], const indx_t col[], size_t len, const indx_t perm[], const double x[] ) {
+    __m512d acc =_mm512_setzero_pd();
+    size_t j =0;
+    for( ; j+8 <= len; j += 8 ) {
+        const __m512i idx =_mm512_loadu_si512( &col[j] );
+        const __m512i pidx =_mm512_i64gather_epi64( idx, (const long long*)perm, 8 );
+        acc =_mm512_fmadd_pd( _mm512_loadu_pd( &val[j] ), _mm512_i64gather_pd( pidx, x, 8 ), acc );
+    }
+    if( j < len ) {
+        const __mmask8 mask =(1 << (len - j)) - 1;
+        const __m512i idx =_mm512_maskz_loadu_epi64( mask, &col[j] );
+        const __m512i pidx =_mm512_mask_i64gather_epi64( _mm512_setzero_si512(), mask, idx, (const long long*)perm, 8 );
+        const __m512d xv =_mm512_mask_i64gather_pd( _mm512_setzero_pd(), mask, pidx, x, 8 );
+        acc =_mm512_fmadd_pd( _mm512_maskz_loadu_pd( mask, &val[j] ), xv, acc );
+    }
+    return _mm512_reduce_add_pd( acc );
+}
+
+__attribute__((target("avx512f"))) static size_t
+lower_bound_avx512( const indx_t col_ind[], size_t n, indx_t col ) {
+    const __m512i c =_mm512_set1_epi64( col );
+    size_t k =0;
+    for( ; k+8 <= n; k += 8 ) {
+        const __mmask8 below =_mm512_cmplt_epu64_mask( _mm512_loadu_si512( &col_ind[k] ), c );
+        if( below != 0xFF ) return k + __builtin_ctz( ~below );
+    }
+    if( k < n ) {
+        const __mmask8 mask =(1 << (n - k)) - 1;
+        const __mmask8 below =_mm512_mask_cmplt_epu64_mask( mask, _mm512_maskz_loadu_epi64( mask, &col_ind[k] ), c );
+        return k + __builtin_ctz( ~below );
+    }
+    return k;
+}
+
+__attribute__((target("avx512f"))) static size_t
+iamax_avx512( const double v[], size_t n ) {
+    __m512d m =_mm512_setzero_pd();
+    size_t k =0;
+    for( ; k+8 <= n; k += 8 ) m =_mm512_max_pd( m, _mm512_abs_pd( _mm512_loadu_pd( &v[k] ) ) );
+    if( k < n ) {
+        const __mmask8 mask =(1 << (n - k)) - 1;
+        m =_mm512_max_pd( m, _mm512_abs_pd( _mm512_maskz_loadu_pd( mask, &v[k] ) ) );
+    }
+    const __m512d max =_mm512_set1_pd( _mm512_reduce_max_pd( m ) );
+    for( k =0; k < n; k += 8 ) {
+        const __mmask8 mask =n - k >= 8 ? 0xFF : (1 << (n - k)) - 1;
+        const __mmask8 eq =_mm512_mask_cmpeq_pd_mask( mask, _mm512_abs_pd( _mm512_maskz_loadu_pd( mask, &v[k] ) ), max );
+        if( eq ) return k + __builtin_ctz( eq );
+    }
+    return 0;
+}
+
+// AVX-512 implies FMA, which GCC would otherwise fuse the product into
+__attribute__((target("avx512f"), optimize("fp-contract=off"))) static void
+axpy_avx512( double y[], double a, const double x[], size_t n ) {
+    const __m512d av =_mm512_set1_pd( a );
+    size_t j =0;
+    for( ; j+8 <= n; j += 8 )
+        _mm512_storeu_pd( &y[j], _mm512_sub_pd( _mm512_loadu_pd( &y[j] ), _mm512_mul_pd( av, _mm512_loadu_pd( &x[j] ) ) ) );
+    if( j < n ) {
+        const __mmask8 mask =(1 << (n - j)) - 1;
+        const __m512d yv =_mm512_maskz_loadu_pd( mask, &y[j] );
+        _mm512_mask_storeu_pd( &y[j], mask, _mm512_sub_pd( yv, _mm512_mul_pd( av, _mm512_maskz_loadu_pd( mask, &x[j] ) ) ) );
+    }
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off"))) static size_t
+sub_run_avx512( const indx_t ci[], const double vi[], const indx_t ck[], const double vk[], size_t n,
+                double a, indx_t co[], double vo[] ) {
+    const __m512d av =_mm512_set1_pd( a );
+    size_t j =0;
+    for( ; j+8 <= n; j += 8 ) {
+        const __m512i c =_mm512_loadu_si512( &ck[j] );
+        if( _mm512_cmpneq_epu64_mask( _mm512_loadu_si512( &ci[j] ), c ) ) break;
+        const __m512d v =_mm512_sub_pd( _mm512_loadu_pd( &vk[j] ), _mm512_mul_pd( _mm512_loadu_pd( &vi[j] ), av ) );
+        if( _mm512_cmpeq_pd_mask( v, _mm512_setzero_pd() ) ) break;
+        _mm512_storeu_si512( &co[j], c );
+        _mm512_storeu_pd( &vo[j], v );
+    }
+    return j + sub_run_sse2( &ci[j], &vi[j], &ck[j], &vk[j], n - j, a, &co[j], &vo[j] );
+}
+
+#pragma GCC diagnostic pop
+
+simd_kernels_t SIMD ={ "sse2", dot_sse2, dot_perm_sse2, lower_bound_sse2, iamax_sse2, axpy_sse2, sub_run_sse2 };
+
+static const simd_kernels_t KERNELS[] ={
+    { "avx512", dot_avx512, dot_perm_avx512, lower_bound_avx512, iamax_avx512, axpy_avx512, sub_run_avx512 },
+    { "avx2", dot_avx2, dot_perm_avx2, lower_bound_avx2, iamax_avx2, axpy_avx2, sub_run_avx2 },
+    { "sse2", dot_sse2, dot_perm_sse2, lower_bound_sse2, iamax_sse2, axpy_sse2, sub_run_sse2 }
+};
+
+static bool
+supported( const char* isa ) {
+    __builtin_cpu_init();
+    if( strcmp( isa, "avx512" ) == 0 ) return __builtin_cpu_supports( "avx512f" );
+    if( strcmp( isa, "avx2" ) == 0 ) return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+    return true;
+}
+
+/** Selects the kernels for @isa, "sse2", "avx2" or "avx512", or if @isa is
+ *  NULL or "auto", for the best instruction set of the processor.
+ *  Returns -1 if @isa is unknown or not supported.
+ */
+int
+simd_init( const char* isa ) {
+    const bool automatic =!isa || strcmp( isa, "auto" ) == 0;
+    for( const simd_kernels_t& k : KERNELS ) {
+        if( !automatic && strcmp( isa, k.isa ) != 0 ) continue;
+        if( !supported( k.isa ) ) {
+            if( automatic ) continue;
+            fprintf( stderr, "(e) The processor does not support %s\n", isa );
+            return -1;
+        }
+        SIMD =k;
+        return 0;
+    }
+    fprintf( stderr, "(e) Unknown instruction set '%s'\n", isa );
+    return -1;
+}
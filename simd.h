@@ -0,0 +1,33 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "matrix.h"
+
+/* Hot sparse kernels, compiled for several instruction sets. The baseline
+ * (SSE2) variants are plain C, which x86-64 compiles to SSE2 code; they are
+ * used until simd_init() selects the best variants the processor supports.
+ */
+typedef struct {
+    const char* isa;
+    // Sum of @val[j] * @x[@col[j]]
+    double (*dot)( const double val[], const indx_t col[], size_t len, const double x[] );
+    // Sum of @val[j] * @x[@perm[@col[j]]]
+    double (*dot_perm)( const double val[], const indx_t col[], size_t len, const indx_t perm[], const double x[] );
+    // Offset of the first element of the sorted @col_ind[0..@n) that is at least @col, or @n
+    size_t (*lower_bound)( const indx_t col_ind[], size_t n, indx_t col );
+    // Offset of the first element of @v[0..@n) with the largest magnitude, @n > 0
+    size_t (*iamax)( const double v[], size_t n );
+    // @y[j] -= @a * @x[j], rounded like the scalar expression (no FMA)
+    void (*axpy)( double y[], double a, const double x[], size_t n );
+    // Length of the leading run, at most @n, where @ci and @ck hold the same
+    // columns and @vk[j] - @a * @vi[j] is non-zero, rounded like the scalar
+    // expression; those columns and differences are written to @co and @vo
+    size_t (*sub_run)( const indx_t ci[], const double vi[], const indx_t ck[], const double vk[], size_t n,
+                       double a, indx_t co[], double vo[] );
+} simd_kernels_t;
+
+extern simd_kernels_t SIMD;
+
+int simd_init( const char* isa );
+
+#endif
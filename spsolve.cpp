@@ -0,0 +1,155 @@
+#include "spsolve.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/** Transposes the elements of the rows of @m into columns: the elements of
+ *  the row at position ii in columns jj with @lower ? jj < ii : jj > ii.
+ */
+static void
+split_columns( const matrix_t* m, bool lower, indx_t** ptr, indx_t** ind, double** val ) {
+    const size_t n =m->m;
+    *ptr =(indx_t*)calloc( n + 1, sizeof(indx_t) );
+    for( size_t ii =0; ii < n; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( lower ? m->col_ind[j] < ii : m->col_ind[j] > ii ) (*ptr)[m->col_ind[j]+1]++;
+    }
+    for( size_t jj =0; jj < n; jj++ ) (*ptr)[jj+1] += (*ptr)[jj];
+    *ind =(indx_t*)malloc( ((*ptr)[n] + 1) * sizeof(indx_t) );
+    *val =(double*)malloc( ((*ptr)[n] + 1) * sizeof(double) );
+    indx_t* next =(indx_t*)malloc( n * sizeof(indx_t) );
+    memcpy( next, *ptr, n * sizeof(indx_t) );
+    for( size_t ii =0; ii < n; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const indx_t jj =m->col_ind[j];
+            if( lower ? jj < ii : jj > ii ) {
+                (*ind)[next[jj]] =ii;
+                (*val)[next[jj]++] =m->values[j];
+            }
+        }
+    }
+    free( next );
+}
+
+/** Builds the column form of the factors in @m, which has been factored by
+ *  lup() or one of its variants.
+ */
+void
+spsolve_init( spsolve_t* s, const matrix_t* m ) {
+    const size_t n =m->m;
+    s->n =n;
+    split_columns( m, true, &s->l_ptr, &s->l_ind, &s->l_val );
+    split_columns( m, false, &s->u_ptr, &s->u_ind, &s->u_val );
+    s->u_diag =(double*)malloc( n * sizeof(double) );
+    s->pos =(indx_t*)malloc( n * sizeof(indx_t) );
+    for( size_t ii =0; ii < n; ii++ ) {
+        const indx_t i =m->row_order[ii];
+        s->pos[i] =ii;
+        s->u_diag[ii] =1.0; // As u_subst() does for a missing pivot
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ )
+            if( m->col_ind[j] == ii ) s->u_diag[ii] =m->values[j];
+    }
+    s->work  =(double*)calloc( n, sizeof(double) );
+    s->mark  =(char*)calloc( n, sizeof(char) );
+    s->stack =(indx_t*)malloc( n * sizeof(indx_t) );
+    s->child =(indx_t*)malloc( n * sizeof(indx_t) );
+    s->reach =(indx_t*)malloc( n * sizeof(indx_t) );
+}
+
+/** Computes the set of vertices reachable from the @n_seeds vertices in @seeds
+ *  in the graph with edges jj -> @ind[@ptr[jj]..@ptr[jj+1]-1], using an
+ *  iterative depth-first search. The vertices are stored in @s->reach in 
+ *  topological order (every vertex before the vertices it has edges to), 
+ *  their count is returned. The visited flags are set.
+ */
+static size_t
+reach( spsolve_t* s, const indx_t ptr[], const indx_t ind[], const indx_t seeds[], size_t n_seeds ) {
+    size_t top =s->n; // The reach is filled backwards, in reverse postorder
+    for( size_t k =0; k < n_seeds; k++ ) {
+        if( s->mark[seeds[k]] ) continue;
+        size_t depth =0;
+        s->stack[depth++] =seeds[k];
+        s->mark[seeds[k]] =1;
+        s->child[seeds[k]] =ptr[seeds[k]];
+        while( depth ) {
+            const indx_t jj =s->stack[depth-1];
+            if( s->child[jj] < ptr[jj+1] ) {
+                const indx_t ii =ind[s->child[jj]++];
+                if( !s->mark[ii] ) {
+                    s->mark[ii] =1;
+                    s->child[ii] =ptr[ii];
+                    s->stack[depth++] =ii;
+                }
+            } else {
+                // All successors are done
+                s->reach[--top] =jj;
+                depth--;
+            }
+        }
+    }
+    const size_t count =s->n - top;
+    memmove( s->reach, &s->reach[top], count * sizeof(indx_t) );
+    return count;
+}
+
+/** Solves LUx = b for a sparse b of @b_nnz elements, given by physical row 
+ *  @b_ind and value @b_val. The non-zeroes of x are returned in @x_ind (the 
+ *  index of the unknown) and @x_val, their number is returned; both arrays 
+ *  must be able to hold @s->n elements. The cost is proportional to the 
+ *  number of operations, instead of to the order of the matrix.
+ */
+size_t
+spsolve( spsolve_t* s, const indx_t b_ind[], const double b_val[], size_t b_nnz,
+         indx_t x_ind[], double x_val[] ) {
+
+    // Forward substitution, the columns of L are applied in topological order
+    for( size_t k =0; k < b_nnz; k++ ) {
+        x_ind[k] =s->pos[b_ind[k]];
+        s->work[x_ind[k]] =b_val[k];
+    }
+    size_t n_reach =reach( s, s->l_ptr, s->l_ind, x_ind, b_nnz );
+    for( size_t k =0; k < n_reach; k++ ) {
+        const indx_t jj =s->reach[k];
+        s->mark[jj] =0;
+        const double c =s->work[jj];
+        if( c == 0.0 ) continue;
+        for( indx_t j =s->l_ptr[jj]; j < s->l_ptr[jj+1]; j++ )
+            s->work[s->l_ind[j]] -= s->l_val[j] * c;
+    }
+
+    // Backward substitution, with the non-zeroes of c as seeds
+    memcpy( x_ind, s->reach, n_reach * sizeof(indx_t) );
+    n_reach =reach( s, s->u_ptr, s->u_ind, x_ind, n_reach );
+    size_t x_nnz =0;
+    for( size_t k =0; k < n_reach; k++ ) {
+        const indx_t jj =s->reach[k];
+        s->mark[jj] =0;
+        const double x =s->work[jj] / s->u_diag[jj];
+        s->work[jj] =0.0;
+        if( x == 0.0 ) continue;
+        if( !isfinite( x ) ) {
+            fprintf( stderr, "(e) spsolve: x[%ld] is not a number!\n", jj );
+            abort();
+        }
+        for( indx_t j =s->u_ptr[jj]; j < s->u_ptr[jj+1]; j++ )
+            s->work[s->u_ind[j]] -= s->u_val[j] * x;
+        x_ind[x_nnz] =jj;
+        x_val[x_nnz++] =x;
+    }
+    return x_nnz;
+}
+
+void
+spsolve_free( spsolve_t* s ) {
+    free( s->l_ptr ); free( s->l_ind ); free( s->l_val );
+    free( s->u_ptr ); free( s->u_ind ); free( s->u_val );
+    free( s->u_diag );
+    free( s->pos );
+    free( s->work );
+    free( s->mark );
+    free( s->stack );
+    free( s->child );
+    free( s->reach );
+}
@@ -0,0 +1,35 @@
+#ifndef SPSOLVE_H
+#define SPSOLVE_H
+
+#include "lup.h"
+
+/* Column-oriented copy of the factors computed by lup(), for solves with a
+ * sparse right-hand side. Only the rows reachable from the non-zeroes of b
+ * in the graphs of L and U are visited, see spsolve().
+ * Rows and columns are numbered by position.
+ */
+typedef struct {
+    size_t  n;
+    indx_t* l_ptr;              // Strictly lower part by column (n+1)
+    indx_t* l_ind;
+    double* l_val;
+    indx_t* u_ptr;              // Strictly upper part by column (n+1)
+    indx_t* u_ind;
+    double* u_val;
+    double* u_diag;
+    indx_t* pos;                // Physical row -> position
+
+    // Workspace
+    double* work;               // Dense accumulator, zero between calls
+    char*   mark;               // Visited flags, zero between calls
+    indx_t* stack;
+    indx_t* child;              // Next edge to follow of each vertex on the stack
+    indx_t* reach;
+} spsolve_t;
+
+void spsolve_init( spsolve_t* s, const matrix_t* m );
+size_t spsolve( spsolve_t* s, const indx_t b_ind[], const double b_val[], size_t b_nnz,
+                indx_t x_ind[], double x_val[] );
+void spsolve_free( spsolve_t* s );
+
+#endif
@@ -0,0 +1,95 @@
+#include "sym.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+void
+sym_init( sym_t* s, size_t n ) {
+    s->n =n;
+    s->cholesky =false;
+    s->perm =(indx_t*)malloc( n * sizeof(indx_t) );
+    s->diag =(double*)calloc( n, sizeof(double) );
+    s->off  =(double*)calloc( n, sizeof(double) );
+    s->n_2x2 =0;
+    s->n_negative =0;
+    for( size_t ii =0; ii < n; ii++ ) s->perm[ii] =ii;
+}
+
+/** Solves A x = b with the factors computed by cholesky() or ldlt(). Both @x
+ *  and @b are in natural order, @x and @b may not overlap.
+ */
+void
+sym_solve( double x[], const sym_t* s, matrix_t* m, const double b[] ) {
+    const size_t n =s->n;
+    memcpy( x, b, n * sizeof(double) );
+
+    // Forward substitution L y = b, row by row
+    for( size_t ii =0; ii < n; ii++ ) {
+        const indx_t i =s->perm[ii];
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const indx_t q =m->col_ind[j];
+            if( q != i ) x[i] -= m->values[j] * x[q];
+            else if( s->cholesky ) x[i] /= m->values[j];
+        }
+    }
+
+    // Block diagonal D z = y
+    if( !s->cholesky ) {
+        for( size_t ii =0; ii < n; ii++ ) {
+            const indx_t p =s->perm[ii];
+            if( s->off[ii] == 0.0 ) {
+                x[p] /= s->diag[ii];
+                continue;
+            }
+            const indx_t r =s->perm[ii+1];
+            const double a =s->diag[ii], c =s->diag[ii+1], o =s->off[ii];
+            const double det =a * c - o * o;
+            const double xp =x[p], xr =x[r];
+            x[p] =( c * xp - o * xr ) / det;
+            x[r] =( a * xr - o * xp ) / det;
+            ii++;
+        }
+    }
+
+    // Backward substitution L^T x = z: once x[i] is known, it is scattered
+    // over the rows of L^T, i.e. the columns of row i of L
+    for( ssize_t ii =(ssize_t)n-1; ii >= 0; ii-- ) {
+        const indx_t i =s->perm[ii];
+        if( s->cholesky ) x[i] /= m->values[m->row_ptr_end[i]];
+        if( !isfinite( x[i] ) ) {
+            fprintf( stderr, "(e) sym_solve: x[%ld] is not a number!\n", i );
+            abort();
+        }
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const indx_t q =m->col_ind[j];
+            if( q != i ) x[q] -= m->values[j] * x[i];
+        }
+    }
+}
+
+/** Computes b = A x where @m holds the lower triangle of the symmetric A.
+ *  Every off-diagonal element is used twice: as (i,j) and as (j,i).
+ */
+void
+mult_matvec_sym( double b[], matrix_t* m, const double x[] ) {
+    assert( m->m==m->n );
+    memset( b, 0, m->m * sizeof(double) );
+    for( size_t i =0; i < m->m; i++ ) {
+        double sum =0.0;
+        for( indx_t j =m->row_ptr_begin[i]; j <= m->row_ptr_end[i]; j++ ) {
+            const indx_t q =m->col_ind[j];
+            sum += m->values[j] * x[q];
+            if( q != i ) b[q] += m->values[j] * x[i];
+        }
+        b[i] += sum;
+    }
+}
+
+void
+sym_free( sym_t* s ) {
+    free( s->perm );
+    free( s->diag );
+    free( s->off );
+    memset( s, 0, sizeof( sym_t ) );
+}
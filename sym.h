@@ -0,0 +1,29 @@
+#ifndef SYM_H
+#define SYM_H
+
+#include "lup.h"
+
+/* Factorisation of a symmetric matrix that is stored as its lower triangle,
+ * i.e. row i only holds the columns j <= i, see load_matrix_market().
+ * cholesky() computes A = L L^T in place, the rows of @m then hold the rows
+ * of L including the diagonal. ldlt() computes P A P^T = L D L^T with 1x1 and
+ * 2x2 diagonal blocks in D, the rows of @m then hold the strict lower part
+ * of the (unit) rows of L and the diagonal of D, with the original indices as
+ * columns.
+ */
+typedef struct sym_t {
+    size_t  n;
+    bool    cholesky;           // L L^T, otherwise L D L^T
+    indx_t* perm;               // Pivot position -> original index
+    double* diag;               // Diagonal of D by position
+    double* off;                // D(ii,ii+1) if a 2x2 block starts at position ii, 0 otherwise
+    size_t  n_2x2;
+    size_t  n_negative;         // Number of negative eigenvalues of D and thus of A
+} sym_t;
+
+void sym_init( sym_t* s, size_t n );
+void sym_solve( double x[], const sym_t* s, matrix_t* m, const double b[] );
+void mult_matvec_sym( double b[], matrix_t* m, const double x[] );
+void sym_free( sym_t* s );
+
+#endif
@@ -0,0 +1,161 @@
+#include "transport.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/* Full mesh of Unix domain socket pairs between the processes */
+typedef struct {
+    int*    fd;                 // Socket to each rank, -1 for the own rank
+    pid_t*  pid;                // Process of each rank (rank 0 only)
+} socket_transport_t;
+
+static int
+socket_send( transport_t* t, int dest, const void* buf, size_t len ) {
+    const int fd =((socket_transport_t*)t->impl)->fd[dest];
+    const char* p =(const char*)buf;
+    while( len ) {
+        const ssize_t n =write( fd, p, len );
+        if( n < 0 && errno == EINTR ) continue;
+        if( n <= 0 ) {
+            perror( "(e) transport send" );
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int
+socket_recv( transport_t* t, int src, void* buf, size_t len ) {
+    const int fd =((socket_transport_t*)t->impl)->fd[src];
+    char* p =(char*)buf;
+    while( len ) {
+        const ssize_t n =read( fd, p, len );
+        if( n < 0 && errno == EINTR ) continue;
+        if( n <= 0 ) {
+            if( n == 0 ) fprintf( stderr, "(e) transport recv: rank %d hung up\n", src );
+            else perror( "(e) transport recv" );
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int
+socket_close( transport_t* t ) {
+    socket_transport_t* s =(socket_transport_t*)t->impl;
+    int ret =0;
+    for( int r =0; r < t->size; r++ )
+        if( s->fd[r] != -1 ) close( s->fd[r] );
+    if( t->rank == 0 ) {
+        for( int r =1; r < t->size; r++ ) {
+            int status;
+            if( waitpid( s->pid[r], &status, 0 ) == -1 || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 ) {
+                fprintf( stderr, "(e) Worker process %d failed\n", r );
+                ret =-1;
+            }
+        }
+    }
+    free( s->fd );
+    free( s->pid );
+    free( s );
+    t->impl =NULL;
+    return ret;
+}
+
+/** Starts @n_procs-1 worker processes by forking the calling process, which
+ *  becomes rank 0, and connects all of them by Unix domain sockets. Returns
+ *  in every process with @t set up for its own rank, or -1 in the caller on
+ *  failure. Workers have a copy of the address space of the caller, but
+ *  should only use the OpenMP runtime if the caller did not start it yet.
+ */
+int
+transport_socket_launch( transport_t* t, int n_procs ) {
+    socket_transport_t* s =(socket_transport_t*)malloc( sizeof(socket_transport_t) );
+    int* mesh =(int*)malloc( (size_t)n_procs * n_procs * sizeof(int) );
+    for( int r =0; r < n_procs * n_procs; r++ ) mesh[r] =-1;
+    for( int i =0; i < n_procs; i++ )
+        for( int j =i+1; j < n_procs; j++ ) {
+            int sv[2];
+            if( socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) != 0 ) {
+                perror( "(e) socketpair" );
+                return -1;
+            }
+            mesh[i*n_procs+j] =sv[0];
+            mesh[j*n_procs+i] =sv[1];
+        }
+
+    // Buffered output would otherwise be written by every process
+    fflush( stdout );
+    fflush( stderr );
+    s->pid =(pid_t*)calloc( n_procs, sizeof(pid_t) );
+    int rank =0;
+    for( int r =1; r < n_procs; r++ ) {
+        const pid_t pid =fork();
+        if( pid == -1 ) {
+            perror( "(e) fork" );
+            return -1;
+        }
+        if( pid == 0 ) {
+            rank =r;
+            break;
+        }
+        s->pid[r] =pid;
+    }
+
+    // Keep the sockets of this rank only
+    s->fd =(int*)malloc( n_procs * sizeof(int) );
+    for( int i =0; i < n_procs; i++ )
+        for( int j =0; j < n_procs; j++ ) {
+            if( i == rank ) continue;
+            if( mesh[i*n_procs+j] != -1 ) close( mesh[i*n_procs+j] );
+        }
+    memcpy( s->fd, &mesh[rank*n_procs], n_procs * sizeof(int) );
+    free( mesh );
+
+    t->rank =rank;
+    t->size =n_procs;
+    t->send =socket_send;
+    t->recv =socket_recv;
+    t->close =socket_close;
+    t->impl =s;
+    return 0;
+}
+
+/** Copies @len bytes at @buf of rank @root to @buf of all other ranks.
+ */
+int
+transport_bcast( transport_t* t, int root, void* buf, size_t len ) {
+    if( t->rank != root ) return t->recv( t, root, buf, len );
+    for( int r =0; r < t->size; r++ )
+        if( r != root && t->send( t, r, buf, len ) != 0 ) return -1;
+    return 0;
+}
+
+/** Sets @value and @index in all ranks to the pair with the largest value,
+ *  the smallest index among equal values.
+ */
+int
+transport_allreduce_maxloc( transport_t* t, double* value, sindx_t* index ) {
+    struct { double value; sindx_t index; } loc ={ *value, *index };
+    if( t->rank != 0 ) {
+        if( t->send( t, 0, &loc, sizeof(loc) ) != 0 ) return -1;
+    } else {
+        for( int r =1; r < t->size; r++ ) {
+            struct { double value; sindx_t index; } other;
+            if( t->recv( t, r, &other, sizeof(other) ) != 0 ) return -1;
+            if( other.value > loc.value || (other.value == loc.value && other.index < loc.index) )
+                loc.value =other.value, loc.index =other.index;
+        }
+    }
+    if( transport_bcast( t, 0, &loc, sizeof(loc) ) != 0 ) return -1;
+    *value =loc.value;
+    *index =loc.index;
+    return 0;
+}
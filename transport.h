@@ -0,0 +1,26 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "matrix.h"
+
+/* Point-to-point messages between the processes of a distributed run, see
+ * lup_dist(). Messages between two processes arrive in the order they were
+ * sent. send() and recv() transfer exactly @len bytes and return -1 on
+ * failure. close() ends the participation of the calling process; on rank
+ * 0 it waits for the other processes to exit.
+ */
+typedef struct transport_t {
+    int     rank;               // Rank of the calling process
+    int     size;               // Number of processes
+    int   (*send)( struct transport_t* t, int dest, const void* buf, size_t len );
+    int   (*recv)( struct transport_t* t, int src, void* buf, size_t len );
+    int   (*close)( struct transport_t* t );
+    void*   impl;               // State of the implementation
+} transport_t;
+
+int transport_socket_launch( transport_t* t, int n_procs );
+
+int transport_bcast( transport_t* t, int root, void* buf, size_t len );
+int transport_allreduce_maxloc( transport_t* t, double* value, sindx_t* index );
+
+#endif
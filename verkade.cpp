@@ -2,11 +2,33 @@
 #include <ctime>
 #include <cstring>
 #include <math.h>
+#include <float.h>
 #include <assert.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <algorithm>
+#include <omp.h>
 
 #include "matrix.h"
 #include "lup.h"
 #include "heap.h"
+#include "sell.h"
+#include "krylov.h"
+#include "btf.h"
+#include "mc64.h"
+#include "dense.h"
+#include "ooc.h"
+#include "etree.h"
+#include "spsolve.h"
+#include "lowrank.h"
+#include "sym.h"
+#include "band.h"
+#include "dist.h"
+#include "simd.h"
+#include "schur.h"
+#include "nd.h"
+#include "plan.h"
+#include "ckpt.h"
 
 /* Globals. Yuk. */
 
@@ -14,8 +36,123 @@ static double X_REF[N_REF_VECTORS][MAX_N_ROWS];
 static double B_REF[N_REF_VECTORS][MAX_N_ROWS];
 static double X_OUT[N_REF_VECTORS][MAX_N_ROWS];
 static double C_TMP[MAX_N_ROWS];
+static double X_TMP[MAX_N_ROWS];
 
 static matrix_t M;
+static matrix_t* P; // Preconditioner for the iterative solvers, allocated by the iterative solve
+static matrix_t* A; // Unmodified copy of the input for residuals, allocated where it is needed
+
+#define ILUT_MAX_CONDEST 1e15 // Preconditioners above this estimate are rejected
+#define ILUT_MAX_RETRIES 3 // Times the preconditioner is recomputed with a smaller tolerance and more fill
+#define RHS_DEFAULT_BLOCK 32 // Right-hand sides read and solved at a time with --rhs
+#define TRACE_DEFAULT_INTERVAL 100 // Elimination steps between two heap samples
+
+enum solver_t { SOLVER_DIRECT, SOLVER_GMRES, SOLVER_BICGSTAB };
+
+/* Command line options */
+static struct {
+    int    threads;         // Number of OpenMP threads, 0 for the default
+    const char* isa;        // Instruction set of the kernels, NULL for the best supported
+    bool   sell;            // Use a SELL-C-sigma copy for the reference products
+    size_t sell_c;
+    size_t sell_sigma;
+    solver_t solver;
+    double ilut_tol;        // Drop tolerance of the ILUT preconditioner
+    size_t ilut_fill;       // Additional elements per row in the preconditioner
+    krylov_t krylov;
+    bool   btf;             // Factor only the diagonal blocks of the block triangular form
+    bool   mc64;            // Permute large elements onto the diagonal and scale
+    bool   static_pivot;    // Factor without row interchanges after mc64
+    bool   tree;            // Factor the static pivot order along the elimination tree
+    bool   lookahead;       // Pipeline the elimination steps of the direct solver
+    int    procs;           // Processes the rows are distributed over, 1 for a single process
+    size_t sparse_rhs;      // Columns of the inverse computed by sparse solves
+    const char* rhs;        // File with right-hand sides to solve after the reference vectors
+    const char* out;        // File to write their solutions to, or NULL
+    size_t rhs_block;       // Right-hand sides read and solved at a time
+    bool   transpose;       // Solve A^T x = b with the factors of A
+    size_t update;          // Rows and columns replaced after the direct solve
+    bool   symmetric;       // Keep one triangle of symmetric inputs, factor with Cholesky or LDL^T
+    double rcm;             // RCM ordering, banded LU if the band holds at most rcm*nnz elements, 0 for off
+    bool   nd;              // Nested dissection ordering before lup()
+    int    refine;          // Iterative refinement steps, -1 for the default
+    double dense;           // Defer rows/columns with more than dense*sqrt(n) elements, 0 for off
+    size_t schur;           // Order of the Schur complement left by a partial factorisation, 0 for off
+    const char* ooc;        // File to store the factors in, or NULL to keep them in memory
+    size_t mem_cap;         // Bytes of row storage used by the out-of-core factorisation
+    size_t compact;         // Elements moved per row allocation by incremental compaction
+    double dense_rows;      // Fraction of the remaining columns from which lup() stores a row dense, 0 for off
+    const char* heap_trace; // CSV file for the heap statistics sampled during lup(), or NULL
+    size_t trace_interval;  // Elimination steps between two samples
+    bool   plan;            // Choose the ordering and engine of the direct solver from the structure of A
+    const char* plan_spec;  // Fields of the chosen plan to override, or NULL
+    const char* plan_table; // Rule table to choose the plan from, NULL for the built-in one
+    const char* checkpoint; // File lup() writes checkpoints to, or NULL
+    double checkpoint_interval; // Seconds between two checkpoints
+    bool   resume;          // Continue lup() from the checkpoint if there is one
+} OPT = { 0, NULL, false, SELL_DEFAULT_C, SELL_DEFAULT_SIGMA,
+          SOLVER_DIRECT, 1e-3, 10,
+          { KRYLOV_DEFAULT_RESTART, KRYLOV_DEFAULT_MAX_ITER, KRYLOV_DEFAULT_TOL, 0, 0.0 },
+          false, false, false, false, false, 1, 0, NULL, NULL, RHS_DEFAULT_BLOCK, false, 0, false, 0.0, false, -1, 0.0, 0,
+          NULL, MAX_N_ELEMENTS * (sizeof(double) + sizeof(indx_t)), COMPACT_DEFAULT_BUDGET,
+          DENSE_ROW_DEFAULT_THRESHOLD, NULL, TRACE_DEFAULT_INTERVAL, false, NULL, NULL,
+          NULL, CKPT_DEFAULT_INTERVAL, false };
+
+/* Solves with the factors of the scaled and permuted matrix, see refine() */
+typedef struct {
+    const mc64_t* s;
+    matrix_t*     m;
+} mc64_solver_t;
+
+static void
+mc64_solve_func( double x[], const double b[], void* user ) {
+    mc64_solver_t* solver =(mc64_solver_t*)user;
+    mc64_solve( x, solver->s, solver->m, b );
+}
+
+/** Solves the reference systems with the factors in M of the matrix scaled by
+ *  @mc64, followed by at most @refine_steps steps of iterative refinement 
+ *  against A. If @stop is set, returns -1 as soon as a refinement does not 
+ *  converge; otherwise the failure is reported and 0 is returned.
+ */
+static int
+solve_scaled( const mc64_t* mc64, size_t refine_steps, bool stop ) {
+    mc64_solver_t solver ={ mc64, &M };
+    for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+        printf( "%ld: mc64_solve", i );
+        mc64_solve( X_OUT[i], mc64, &M, B_REF[i] );
+        if( refine_steps ) {
+            krylov_t k ={ 0, refine_steps, OPT.krylov.tol, 0, 0.0 };
+            const int ret =refine( X_OUT[i], A, B_REF[i], mc64_solve_func, &solver, &k );
+            printf( ", %ld refinement steps (residual %.2e)", k.iter, k.resid );
+            if( ret != 0 && stop ) {
+                printf( ", did not converge.\n" );
+                return -1;
+            }
+            if( ret != 0 ) fprintf( stderr, "\n(e) Refinement of X_%ld did not converge (residual %.2e).\n", i, k.resid );
+        }
+        double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+        printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+    }
+    return 0;
+}
+
+/** Returns the option that plan @p cannot be combined with, or NULL. --rhs is
+ *  solved by the plain direct solver only, and --checkpoint is written by
+ *  lup() in the natural and nested dissection order only. */
+static const char*
+plan_conflict( const plan_t* p ) {
+    if( OPT.rhs && (p->ordering != PLAN_NATURAL || p->pivoting != PLAN_PARTIAL) )
+        return "--rhs requires ordering=natural and pivoting=partial";
+    if( OPT.checkpoint && (p->ordering == PLAN_RCM || p->engine != PLAN_LUP || p->pivoting != PLAN_PARTIAL) )
+        return "--checkpoint requires ordering=natural or nd, engine=lup and pivoting=partial";
+    return NULL;
+}
+
+static bool
+plan_supported( const plan_t* p ) {
+    return plan_conflict( p ) == NULL;
+}
 
 static void
 dump_crs( size_t m, size_t nz ) {
@@ -57,13 +194,79 @@ make_reference_vectors( size_t m ) {
         X_REF[4][i] = i%2 ? -100.0 : 100.0;
     }
 
-    for( size_t i =0; i < N_REF_VECTORS; i++ ) {
-        mult_matvec( &B_REF[i][0],
-                     &M,
-                     &X_REF[i][0] );
-/*        printf( "(i) b_%ld = ", i );
-        print_vec( &B_REF[i][0], m, NULL );*/
-    }
+    /* All reference vectors are multiplied in a single pass over the matrix */
+    sell_t sell;
+    if( OPT.symmetric ) {
+        for( size_t i =0; i < N_REF_VECTORS; i++ )
+            mult_matvec_sym( B_REF[i], &M, X_REF[i] );
+    } else if( OPT.transpose ) {
+        for( size_t i =0; i < N_REF_VECTORS; i++ )
+            mult_matvec_transposed( B_REF[i], &M, X_REF[i] );
+    } else if( OPT.sell && sell_build( &sell, &M, OPT.sell_c, OPT.sell_sigma ) == 0 ) {
+        sell_matmat( &B_REF[0][0], MAX_N_ROWS, &sell, &X_REF[0][0], MAX_N_ROWS, N_REF_VECTORS );
+        sell_free( &sell );
+    } else
+        mult_matmat( &B_REF[0][0], MAX_N_ROWS, &M, &X_REF[0][0], MAX_N_ROWS, N_REF_VECTORS );
+/*  for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+        printf( "(i) b_%ld = ", i );
+        print_vec( &B_REF[i][0], m, NULL );
+    }*/
+}
+
+static void
+usage( const char* name ) {
+    fprintf( stderr, "(i) Usage: %s [options] <filename>\n"
+                     "    --threads N        number of threads\n"
+                     "    --isa I            kernels for sse2, avx2, avx512 or auto (default)\n"
+                     "    --sell[=C,sigma]   use a SELL-C-sigma copy of A for matrix products\n"
+                     "    --solver S         direct (default), gmres or bicgstab\n"
+                     "    --ilut-tol T       drop tolerance of the ILUT preconditioner (1e-3)\n"
+                     "    --ilut-fill P      additional elements per row of the preconditioner (10)\n"
+                     "    --restart R        GMRES restart length (30)\n"
+                     "    --max-iter N       maximum number of iterations (1000)\n"
+                     "    --tol T            relative residual tolerance (1e-10)\n"
+                     "    --btf              permute to block triangular form, factor the diagonal blocks\n"
+                     "    --mc64             permute large elements onto the diagonal and scale\n"
+                     "    --static-pivot     --mc64 and factor without row interchanges\n"
+                     "    --tree             --static-pivot, factoring independent subtrees concurrently\n"
+                     "    --lookahead        update the rows of the next pivot first, the others in tasks\n"
+                     "    --procs N          distribute the rows over N processes (direct solver)\n"
+                     "    --sparse-rhs N     compute N columns of the inverse with sparse solves\n"
+                     "    --rhs FILE         solve the right-hand sides in FILE (Matrix Market, array or\n"
+                     "                       coordinate format) after factoring (direct solver)\n"
+                     "    --out FILE         write the solutions of --rhs to FILE in array format\n"
+                     "    --rhs-block N      right-hand sides read and solved at a time (32)\n"
+                     "    --transpose        solve A^T x = b with the factors of A (direct solver)\n"
+                     "    --update N         replace N rows/columns after the direct solve and solve\n"
+                     "                       again using low-rank updates of the factors\n"
+                     "    --symmetric        keep one triangle of a symmetric matrix, factor it with\n"
+                     "                       Cholesky or, if indefinite, LDL^T (direct solver)\n"
+                     "    --rcm[=F]          reverse Cuthill-McKee ordering, factor the band if it holds at\n"
+                     "                       most F times the elements of A (F = 16), else use lup()\n"
+                     "    --nd               nested dissection ordering of A+A^T before lup()\n"
+                     "    --refine N         iterative refinement steps (3 with --static-pivot, else 0)\n"
+                     "    --dense[=F]        order rows/columns with over F*sqrt(n) elements last and\n"
+                     "                       factor them as a dense block (F = 10)\n"
+                     "    --schur N          eliminate all but the last N unknowns, solve the Schur\n"
+                     "                       complement on those as a dense matrix\n"
+                     "    --ooc FILE         store the factors in FILE, keep only the active rows in memory\n"
+                     "    --mem-cap SIZE     memory for the active rows with --ooc, suffix K, M or G\n"
+                     "    --compact N        elements moved per row allocation to keep free space together,\n"
+                     "                       0 to defragment only when an allocation fails (0)\n"
+                     "    --dense-rows D     store rows of lup() that fill at least D of the remaining\n"
+                     "                       columns as dense segments, 0 for off (0)\n"
+                     "    --heap-trace FILE  write heap statistics sampled during the factorisation to FILE\n"
+                     "                       as CSV (plain direct solver)\n"
+                     "    --trace-interval N elimination steps between two heap samples (100)\n"
+                     "    --plan[=SPEC]      choose ordering, engine, pivoting and threads of the direct\n"
+                     "                       solver from the structure of A; SPEC overrides fields of the\n"
+                     "                       chosen plan, e.g. ordering=rcm,engine=band\n"
+                     "    --plan-table FILE  rule table to choose the plan from (see batch_train_plan.sh)\n"
+                     "    --checkpoint FILE  write checkpoints of lup() to FILE (direct solver)\n"
+                     "    --checkpoint-interval S\n"
+                     "                       seconds between two checkpoints (60)\n"
+                     "    --resume           continue lup() from the checkpoint in FILE, if it holds one\n",
+                     name );
 }
 
 /* Code taken from the GLIBC manual.
@@ -119,23 +322,291 @@ main(int argc, char **argv)
     heap_debugPrint( &heap );
     heap_free( &heap, c );
     heap_debugPrint( &heap );*/
-    if (argc != 2)
-    {
-      fprintf(stderr, "(i) Usage: %s <filename>\n", argv[0]);
-      return -1;
+    static const struct option long_options[] = {
+        { "threads", required_argument, 0, 't' },
+        { "isa",     required_argument, 0, 'X' },
+        { "sell",    optional_argument, 0, 's' },
+        { "solver",    required_argument, 0, 'S' },
+        { "ilut-tol",  required_argument, 0, 'd' },
+        { "ilut-fill", required_argument, 0, 'f' },
+        { "restart",   required_argument, 0, 'r' },
+        { "max-iter",  required_argument, 0, 'i' },
+        { "tol",       required_argument, 0, 'e' },
+        { "btf",       no_argument,       0, 'b' },
+        { "mc64",         no_argument,       0, 'M' },
+        { "static-pivot", no_argument,       0, 'P' },
+        { "tree",         no_argument,       0, 'T' },
+        { "lookahead",    no_argument,       0, 'L' },
+        { "procs",        required_argument, 0, 'p' },
+        { "sparse-rhs",   required_argument, 0, 'x' },
+        { "rhs",          required_argument, 0, 'B' },
+        { "out",          required_argument, 0, 'O' },
+        { "rhs-block",    required_argument, 0, 'k' },
+        { "transpose",    no_argument,       0, 'A' },
+        { "update",       required_argument, 0, 'u' },
+        { "symmetric",    no_argument,       0, 'Y' },
+        { "rcm",          optional_argument, 0, 'C' },
+        { "nd",           no_argument,       0, 'N' },
+        { "refine",       required_argument, 0, 'R' },
+        { "dense",        optional_argument, 0, 'D' },
+        { "schur",        required_argument, 0, 'K' },
+        { "ooc",          required_argument, 0, 'o' },
+        { "mem-cap",      required_argument, 0, 'm' },
+        { "compact",      required_argument, 0, 'c' },
+        { "dense-rows",   required_argument, 0, 'W' },
+        { "heap-trace",   required_argument, 0, 'H' },
+        { "trace-interval", required_argument, 0, 'I' },
+        { "plan",         optional_argument, 0, 'Q' },
+        { "plan-table",   required_argument, 0, 'J' },
+        { "checkpoint",   required_argument, 0, 'E' },
+        { "checkpoint-interval", required_argument, 0, 'F' },
+        { "resume",       no_argument,       0, 'Z' },
+        { "help",    no_argument,       0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+    int c;
+    while( (c =getopt_long( argc, argv, "t:h", long_options, NULL )) != -1 ) {
+        switch( c ) {
+            case 't':
+                OPT.threads =atoi( optarg );
+                break;
+            case 'X':
+                OPT.isa =optarg;
+                break;
+            case 's':
+                OPT.sell =true;
+                if( optarg && sscanf( optarg, "%ld,%ld", &OPT.sell_c, &OPT.sell_sigma ) < 1 ) {
+                    usage( argv[0] );
+                    return -1;
+                }
+                break;
+            case 'S':
+                if( strcmp( optarg, "direct" ) == 0 ) OPT.solver =SOLVER_DIRECT;
+                else if( strcmp( optarg, "gmres" ) == 0 ) OPT.solver =SOLVER_GMRES;
+                else if( strcmp( optarg, "bicgstab" ) == 0 ) OPT.solver =SOLVER_BICGSTAB;
+                else {
+                    usage( argv[0] );
+                    return -1;
+                }
+                break;
+            case 'd':
+                OPT.ilut_tol =atof( optarg );
+                break;
+            case 'f':
+                OPT.ilut_fill =atol( optarg );
+                break;
+            case 'r':
+                OPT.krylov.restart =atol( optarg );
+                break;
+            case 'i':
+                OPT.krylov.max_iter =atol( optarg );
+                break;
+            case 'e':
+                OPT.krylov.tol =atof( optarg );
+                break;
+            case 'b':
+                OPT.btf =true;
+                break;
+            case 'M':
+                OPT.mc64 =true;
+                break;
+            case 'P':
+                OPT.mc64 =OPT.static_pivot =true;
+                break;
+            case 'T':
+                OPT.mc64 =OPT.static_pivot =OPT.tree =true;
+                break;
+            case 'L':
+                OPT.lookahead =true;
+                break;
+            case 'p':
+                OPT.procs =atoi( optarg );
+                if( OPT.procs < 1 ) {
+                    usage( argv[0] );
+                    return -1;
+                }
+                break;
+            case 'x':
+                OPT.sparse_rhs =atol( optarg );
+                break;
+            case 'B':
+                OPT.rhs =optarg;
+                break;
+            case 'O':
+                OPT.out =optarg;
+                break;
+            case 'k':
+                OPT.rhs_block =atol( optarg );
+                if( OPT.rhs_block == 0 ) {
+                    usage( argv[0] );
+                    return -1;
+                }
+                break;
+            case 'A':
+                OPT.transpose =true;
+                break;
+            case 'u':
+                OPT.update =atol( optarg );
+                break;
+            case 'Y':
+                OPT.symmetric =true;
+                break;
+            case 'C':
+                OPT.rcm =optarg ? atof( optarg ) : BAND_DEFAULT_FACTOR;
+                break;
+            case 'R':
+                OPT.refine =atoi( optarg );
+                break;
+            case 'D':
+                OPT.dense =optarg ? atof( optarg ) : DENSE_DEFAULT_FACTOR;
+                break;
+            case 'N':
+                OPT.nd =true;
+                break;
+            case 'K':
+                OPT.schur =atol( optarg );
+                break;
+            case 'o':
+                OPT.ooc =optarg;
+                break;
+            case 'm': {
+                char* suffix;
+                OPT.mem_cap =strtoul( optarg, &suffix, 10 );
+                switch( *suffix ) {
+                    case 'G': case 'g': OPT.mem_cap <<= 10; // Fall through
+                    case 'M': case 'm': OPT.mem_cap <<= 10; // Fall through
+                    case 'K': case 'k': OPT.mem_cap <<= 10; break;
+                    case '\0': break;
+                    default:
+                        fprintf( stderr, "(e) Invalid memory size '%s'\n", optarg );
+                        return -1;
+                }
+                break;
+            }
+            case 'c':
+                OPT.compact =atol( optarg );
+                break;
+            case 'W':
+                OPT.dense_rows =atof( optarg );
+                break;
+            case 'H':
+                OPT.heap_trace =optarg;
+                break;
+            case 'I':
+                OPT.trace_interval =atol( optarg );
+                break;
+            case 'Q':
+                OPT.plan =true;
+                OPT.plan_spec =optarg;
+                break;
+            case 'J':
+                OPT.plan =true;
+                OPT.plan_table =optarg;
+                break;
+            case 'E':
+                OPT.checkpoint =optarg;
+                break;
+            case 'F':
+                OPT.checkpoint_interval =atof( optarg );
+                break;
+            case 'Z':
+                OPT.resume =true;
+                break;
+            default:
+                usage( argv[0] );
+                return -1;
+        }
+    }
+    if( optind != argc-1 ) {
+        usage( argv[0] );
+        return -1;
+    }
+    if( OPT.transpose && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc) ) {
+        fprintf( stderr, "(e) --transpose is only supported by the plain direct solver.\n" );
+        return -1;
+    }
+    if( OPT.rhs && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc
+                    || OPT.transpose || OPT.symmetric || OPT.rcm > 0.0) ) {
+        fprintf( stderr, "(e) --rhs is only supported by the plain direct solver.\n" );
+        return -1;
+    }
+    if( OPT.out && !OPT.rhs ) {
+        fprintf( stderr, "(e) --out requires --rhs.\n" );
+        return -1;
+    }
+    if( OPT.procs > 1 && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc
+                          || OPT.lookahead || OPT.symmetric || OPT.rcm > 0.0 || OPT.heap_trace) ) {
+        fprintf( stderr, "(e) --procs is only supported by the plain direct solver.\n" );
+        return -1;
+    }
+    if( OPT.heap_trace && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc
+                           || OPT.lookahead || OPT.symmetric || OPT.rcm > 0.0) ) {
+        fprintf( stderr, "(e) --heap-trace is only supported by the plain direct solver.\n" );
+        return -1;
+    }
+    if( OPT.symmetric && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc
+                          || OPT.lookahead || OPT.sparse_rhs || OPT.transpose || OPT.update) ) {
+        fprintf( stderr, "(e) --symmetric is only supported by the plain direct solver.\n" );
+        return -1;
+    }
+    if( OPT.rcm > 0.0 && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc
+                          || OPT.lookahead || OPT.sparse_rhs || OPT.transpose || OPT.update || OPT.symmetric) ) {
+        fprintf( stderr, "(e) --rcm is only supported by the plain direct solver.\n" );
+        return -1;
+    }
+    if( OPT.nd && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc || OPT.schur
+                   || OPT.lookahead || OPT.sparse_rhs || OPT.transpose || OPT.update || OPT.symmetric || OPT.rcm > 0.0) ) {
+        fprintf( stderr, "(e) --nd is only supported by the plain direct solver.\n" );
+        return -1;
     }
+    if( OPT.plan && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc || OPT.schur
+                     || OPT.lookahead || OPT.procs > 1 || OPT.sparse_rhs || OPT.transpose || OPT.update
+                     || OPT.symmetric || OPT.rcm > 0.0 || OPT.nd || OPT.heap_trace) ) {
+        fprintf( stderr, "(e) --plan chooses the strategy of the direct solver, it excludes the options that set one.\n" );
+        return -1;
+    }
+    if( OPT.checkpoint && (OPT.solver != SOLVER_DIRECT || OPT.btf || OPT.mc64 || OPT.dense > 0.0 || OPT.ooc
+                           || OPT.schur || OPT.lookahead || OPT.procs > 1 || OPT.symmetric || OPT.update
+                           || OPT.rcm > 0.0) ) {
+        fprintf( stderr, "(e) --checkpoint is only supported by lup() in the natural or the nested dissection order.\n" );
+        return -1;
+    }
+    // Only the factorisation of the job checkpoints, not those lup() is used for internally
+    const lup_checkpoint_t checkpoint ={ OPT.checkpoint, OPT.checkpoint_interval, OPT.resume };
+    if( OPT.resume && !OPT.checkpoint ) {
+        fprintf( stderr, "(e) --resume requires --checkpoint.\n" );
+        return -1;
+    }
+    if( OPT.threads > 0 )
+        omp_set_num_threads( OPT.threads );
+    lup_set_compaction( OPT.compact );
+    lup_set_dense_rows( OPT.dense_rows );
+    if( simd_init( OPT.isa ) != 0 ) return -1;
+    printf( "(i) Using the %s kernels\n", SIMD.isa );
 
     bool ok(false);
+    const bool symmetric_requested =OPT.symmetric;
 
-    ok = load_matrix_market(argv[1], MAX_N_ELEMENTS, MAX_N_ROWS,
-                          M.count, M.m, M.n,
-                          M.values, M.col_ind, M.row_ptr_begin, M.row_ptr_end);
+    const size_t name_len =strlen( argv[optind] );
+    if( name_len > 4 && strcmp( argv[optind] + name_len - 4, ".crs" ) == 0 ) {
+        OPT.symmetric =false; // Binary CRS files hold the full matrix
+        ok = load_binary_crs(argv[optind], MAX_N_ELEMENTS, MAX_N_ROWS,
+                             M.count, M.m, M.n,
+                             M.values, M.col_ind, M.row_ptr_begin, M.row_ptr_end);
+    } else
+        ok = load_matrix_market(argv[optind], MAX_N_ELEMENTS, MAX_N_ROWS,
+                              M.count, M.m, M.n,
+                              M.values, M.col_ind, M.row_ptr_begin, M.row_ptr_end,
+                              OPT.symmetric ? &OPT.symmetric : NULL);
     if (!ok)
     {
       fprintf(stderr, "(e) Failed to load matrix.\n");
       return -1;
     }
 
+    if( symmetric_requested && !OPT.symmetric )
+        printf( "(i) Matrix is not symmetric, --symmetric ignored\n" );
+
     // Set the M.row_order array to encode an unpermuted row order
     for( size_t i =0; i < M.m; i++ ) M.row_order[i] =i;
 
@@ -153,22 +624,541 @@ main(int argc, char **argv)
     struct timespec start_time;
     clock_gettime(CLOCK_REALTIME, &start_time);
 
-    /* Perform LU factorization here */
-    const size_t orig_count =M.count;
-    printf( "Computing LUP: ...." );
-    lup( &M );
-    printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
-            (double)M.count/(double)orig_count, M.count, orig_count );
+    indx_t* nd_perm =NULL; // Nested dissection order of the plan, if it chose one
+    nd_stats_t nd;
+    if( OPT.plan ) {
+        /* Choose the strategy from cheap statistics of the structure */
+        plan_table_t table;
+        if( plan_table_load( &table, OPT.plan_table ) != 0 ) return -1;
+        plan_stats_t stats;
+        double time =omp_get_wtime();
+        plan_analyse( &stats, &M );
+        plan_t plan;
+        const plan_filter_t filter =OPT.rhs || OPT.checkpoint ? plan_supported : NULL;
+        const plan_rule_t* rule =plan_select( &plan, &table, &stats, filter );
+        if( plan.ordering == PLAN_ND ) nd_perm =(indx_t*)malloc( M.m * sizeof(indx_t) );
+        const double fill_nd =plan_check_nd( &plan, &stats, &M, filter, nd_perm, &nd );
+        time =omp_get_wtime() - time;
+        char buf[128];
+        plan_format_stats( buf, sizeof( buf ), &stats );
+        printf( "(i) Structure (n nnz symmetry bandwidth row_max row_cv zero_diag fill fill_rcm): %s\n", buf );
+        if( fill_nd > 0.0 )
+            printf( "(i) Estimated fill after nested dissection: %.2f%s\n", fill_nd,
+                    plan.ordering == PLAN_ND ? "" : ", not below the natural and RCM order" );
+        if( OPT.plan_spec && plan_parse( &plan, OPT.plan_spec ) != 0 ) return -1;
+        if( plan_conflict( &plan ) ) {
+            fprintf( stderr, "(e) Invalid plan: %s.\n", plan_conflict( &plan ) );
+            return -1;
+        }
+        plan_format( buf, sizeof( buf ), &plan );
+        printf( "(i) Plan: %s (%s, closest rule %s, %.3f s)\n", buf,
+                OPT.plan_spec ? "overridden" : "chosen", rule ? rule->name : "none", time );
+        plan_table_free( &table );
 
-    for( size_t i =0; i < N_REF_VECTORS; i++ ) {
-        printf( "%ld: l_subst", i );
-        l_subst( C_TMP, &M, B_REF[i] );
-        printf( ", u_subst" );
-        u_subst( X_OUT[i], &M, C_TMP );
-        //printf( "(i) c_%ld = ", i ); print_vec( C_TMP, M.m, M.row_order );
-        //printf( "(i) x_%ld = ", i ); print_vec( X_OUT[i], M.m, M.row_order );
-        double variance =compute_variance( X_OUT[i], X_REF[i], M.row_order, M.m );
-        printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+        OPT.nd =plan.ordering == PLAN_ND;
+        if( !OPT.nd ) {
+            // Not ordered by nested dissection after all
+            free( nd_perm );
+            nd_perm =NULL;
+        }
+        // No band is that small, the reordered matrix goes to lup()
+        if( plan.ordering == PLAN_RCM ) OPT.rcm =plan.engine == PLAN_BAND ? BAND_DEFAULT_FACTOR : DBL_MIN;
+        OPT.lookahead =plan.engine == PLAN_LOOKAHEAD;
+        OPT.mc64 =OPT.static_pivot =plan.pivoting == PLAN_STATIC;
+        if( OPT.threads == 0 && plan.threads > 0 )
+            omp_set_num_threads( plan.threads );
+    }
+
+    btf_t btf;
+    if( OPT.solver == SOLVER_DIRECT && OPT.btf ) {
+        /* Factor the diagonal blocks of the block triangular form only */
+        const size_t orig_count =M.count;
+        printf( "Computing BTF: ..." );
+        if( btf_analyse( &btf, &M ) != 0 ) return -1;
+        btf_apply( &btf, &M );
+        size_t largest =0;
+        for( size_t b =0; b < btf.n_blocks; b++ )
+            largest =std::max( largest, (size_t)(btf.block_ptr[b+1] - btf.block_ptr[b]) );
+        printf( "\b\b\bdone.\n(i) %ld diagonal blocks, largest %ld rows, %ld elements off the diagonal blocks\n",
+                btf.n_blocks, largest, btf.off_ptr[M.m] );
+
+        printf( "Computing LUP: ...." );
+        lup_blocks( &M, btf.block_ptr, btf.n_blocks );
+        printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)(M.count + btf.off_ptr[M.m])/(double)orig_count, M.count + btf.off_ptr[M.m], orig_count );
+
+        for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+            printf( "%ld: btf_solve", i );
+            btf_solve( X_OUT[i], &btf, &M, B_REF[i] );
+            double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+            printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+        }
+        btf_free( &btf );
+    } else if( OPT.solver == SOLVER_DIRECT && OPT.mc64 ) {
+        /* Move the large elements to the diagonal, then factor the scaled matrix */
+        const size_t orig_count =M.count;
+        const size_t refine_steps =OPT.refine >= 0 ? OPT.refine : OPT.static_pivot ? 3 : 0;
+        if( refine_steps && !(A =matrix_dup( &M )) ) return -1;
+
+        mc64_t mc64;
+        printf( "Computing matching: ..." );
+        if( mc64_analyse( &mc64, &M ) != 0 ) return -1;
+        mc64_apply( &mc64, &M );
+        printf( "\b\b\bdone.\n" );
+
+        etree_t tree;
+        if( OPT.tree ) {
+            etree_compute( &tree, &M );
+            printf( "(i) Elimination tree: %ld roots, height %ld\n", tree.n_roots, tree.height );
+        }
+
+        printf( "Computing LUP: ...." );
+        if( OPT.static_pivot ) {
+            // Pivots are perturbed relative to the largest element of the scaled matrix
+            const size_t n_perturbed =OPT.tree ? lup_tree( &M, &tree, sqrt( DBL_EPSILON ) )
+                                               : lup_static( &M, sqrt( DBL_EPSILON ) );
+            printf( "\b\b\b\bdone.\n(i) Static pivotting, %ld pivots perturbed\n", n_perturbed );
+        } else {
+            if( lup( &M ) != 0 ) return -1;
+            printf( "\b\b\b\bdone.\n" );
+        }
+        if( OPT.tree ) etree_free( &tree );
+        printf( "(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)M.count/(double)orig_count, M.count, orig_count );
+
+        if( solve_scaled( &mc64, refine_steps, OPT.static_pivot ) != 0 ) {
+            // The perturbed factors are too inaccurate, start over with partial pivotting
+            printf( "(i) Refinement did not converge, computing LUP with partial pivotting: ...." );
+            matrix_copy( &M, A );
+            mc64_apply( &mc64, &M );
+            if( lup( &M ) != 0 ) return -1;
+            printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                    (double)M.count/(double)orig_count, M.count, orig_count );
+            solve_scaled( &mc64, refine_steps, false );
+        }
+        mc64_free( &mc64 );
+    } else if( OPT.solver == SOLVER_DIRECT && OPT.schur ) {
+        /* Eliminate the interior unknowns, then solve the interface (Schur 
+         * complement) system separately */
+        if( OPT.schur > M.m ) {
+            fprintf( stderr, "(e) --schur %ld exceeds the order of the matrix.\n", OPT.schur );
+            return -1;
+        }
+        const size_t orig_count =M.count;
+        const size_t k =M.m - OPT.schur;
+        indx_t* interior =(indx_t*)malloc( k * sizeof(indx_t) );
+        for( size_t j =0; j < k; j++ ) interior[j] =j;
+        schur_t schur;
+        printf( "Computing partial LUP: ...." );
+        if( schur_factor( &schur, &M, interior, k ) != 0 ) return -1;
+        free( interior );
+        printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)M.count/(double)orig_count, M.count, orig_count );
+        printf( "(i) Schur complement of order %ld with %ld elements\n", schur.n, schur.row_ptr[schur.n] );
+
+        double* s =(double*)malloc( schur.n * schur.n * sizeof(double) );
+        indx_t* perm =(indx_t*)malloc( schur.n * sizeof(indx_t) );
+        double* g =(double*)malloc( schur.n * sizeof(double) );
+        schur_to_dense( &schur, s );
+        if( dense_lu( s, schur.n, perm ) != 0 )
+            printf( "(i) The Schur complement is singular\n" );
+        for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+            printf( "%ld: schur_l_subst", i );
+            schur_l_subst( C_TMP, g, &M, &schur, B_REF[i] );
+            printf( ", dense_solve" );
+            dense_solve( s, schur.n, perm, g );
+            printf( ", schur_u_subst" );
+            schur_u_subst( X_OUT[i], &M, &schur, C_TMP, g );
+            double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+            printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+        }
+        free( s );
+        free( perm );
+        free( g );
+        schur_free( &schur );
+    } else if( OPT.solver == SOLVER_DIRECT && OPT.dense > 0.0 ) {
+        /* Order the dense rows and columns last and factor them as a dense block */
+        const size_t orig_count =M.count;
+        dense_t dense;
+        dense_detect( &dense, &M, OPT.dense );
+        dense_apply( &dense, &M );
+        printf( "(i) %ld dense rows, %ld dense columns, trailing block of %ld\n",
+                dense.n_rows, dense.n_cols, dense.n_trailing );
+
+        printf( "Computing LUP: ...." );
+        const size_t n_zero =lup_deferred( &M, dense.n_rows, dense.n_trailing );
+        printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)M.count/(double)orig_count, M.count, orig_count );
+        if( n_zero ) {
+            fprintf( stderr, "(e) lup_deferred(): %ld zero pivots in the trailing block, the matrix is singular.\n", n_zero );
+            return -1;
+        }
+
+        for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+            printf( "%ld: l_subst", i );
+            l_subst( C_TMP, &M, B_REF[i] );
+            printf( ", u_subst" );
+            u_subst( X_TMP, &M, C_TMP );
+            for( size_t jj =0; jj < M.m; jj++ ) X_OUT[i][dense.col_perm[jj]] =X_TMP[M.row_order[jj]];
+            double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+            printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+        }
+        dense_free( &dense );
+    } else if( OPT.solver == SOLVER_DIRECT && OPT.ooc ) {
+        /* Stream the finished rows of the factors to a file */
+        const size_t orig_count =M.count;
+        const size_t mem_cap =OPT.mem_cap / (sizeof(double) + sizeof(indx_t));
+        ooc_t ooc;
+        if( ooc_open( &ooc, OPT.ooc, M.m ) != 0 ) return -1;
+        printf( "Computing LUP: ...." );
+        if( lup_ooc( &M, &ooc, mem_cap ) != 0 ) return -1;
+        printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)M.count/(double)orig_count, M.count, orig_count );
+        printf( "(i) Factors written to '%s' (%ld KiB in %.3f s), memory cap %ld elements\n", 
+                OPT.ooc, ooc.size >> 10, ooc.write_time, mem_cap );
+
+        for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+            printf( "%ld: ooc_l_subst", i );
+            ooc_l_subst( C_TMP, &ooc, M.row_order, B_REF[i] );
+            printf( ", ooc_u_subst" );
+            ooc_u_subst( X_OUT[i], &ooc, M.row_order, C_TMP );
+            double variance =compute_variance( X_OUT[i], X_REF[i], M.row_order, M.m );
+            printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+        }
+        ooc_close( &ooc );
+    } else if( OPT.solver == SOLVER_DIRECT && OPT.symmetric ) {
+        /* Factor the lower triangle, LDL^T if Cholesky finds an indefinite matrix */
+        const size_t orig_count =M.count;
+        if( !(A =matrix_dup( &M )) ) return -1;
+        sym_t sym;
+        sym_init( &sym, M.m );
+
+        etree_t tree;
+        etree_compute( &tree, &M );
+        printf( "(i) Elimination tree: %ld roots, height %ld\n", tree.n_roots, tree.height );
+        printf( "Computing Cholesky: ...." );
+        const int ret =cholesky( &M, &tree, &sym );
+        etree_free( &tree );
+        if( ret == 0 ) {
+            printf( "\b\b\b\bdone.\n" );
+        } else {
+            printf( "\b\b\b\bfailed.\n(i) Matrix is not positive definite\n" );
+            matrix_copy( &M, A );
+            printf( "Computing LDL^T: ...." );
+            if( ldlt( &M, &sym ) != 0 ) return -1;
+            printf( "\b\b\b\bdone.\n(i) Bunch-Kaufman pivotting, %ld 2x2 pivots, %ld negative eigenvalues\n",
+                    sym.n_2x2, sym.n_negative );
+        }
+        printf( "(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)M.count/(double)orig_count, M.count, orig_count );
+
+        for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+            printf( "%ld: sym_solve", i );
+            sym_solve( X_OUT[i], &sym, &M, B_REF[i] );
+            double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+            printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+        }
+        sym_free( &sym );
+    } else if( OPT.solver == SOLVER_DIRECT && OPT.rcm > 0.0 ) {
+        /* Reduce the bandwidth, then factor the band if it is narrow enough */
+        const size_t orig_count =M.count;
+        band_t band;
+        const size_t band_size =band_analyse( &band, &M );
+        printf( "(i) RCM ordering: %ld subdiagonals, %ld superdiagonals, band of %ld elements\n",
+                band.kl, band.ku, band_size );
+
+        // Band elements take half the memory of CRS elements, but none are skipped
+        if( band_size <= OPT.rcm * orig_count && band_size <= MAX_N_ELEMENTS ) {
+            printf( "Computing band LU: ...." );
+            const size_t n_zero =band_factor( &band, &M );
+            printf( "\b\b\b\bdone.\n(i) Band is %f times the input (%ld KiB / %ld KiB)\n", 
+                    (double)band_size/(double)orig_count, band_size, orig_count );
+            if( n_zero ) {
+                // A zero pivot means the whole column below it is zero, partial pivotting cannot help
+                fprintf( stderr, "(e) band_factor(): %ld zero pivots, the matrix is singular.\n", n_zero );
+                return -1;
+            }
+
+            for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+                printf( "%ld: band_solve", i );
+                band_solve( X_OUT[i], &band, B_REF[i] );
+                double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+                printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+            }
+        } else {
+            // Too wide for the band, factor the reordered matrix instead
+            matrix_permute_columns( &M, band.perm );
+            memcpy( M.row_order, band.perm, M.m * sizeof(indx_t) );
+            printf( "Computing LUP: ...." );
+            if( lup( &M ) != 0 ) return -1;
+            printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                    (double)M.count/(double)orig_count, M.count, orig_count );
+
+            for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+                printf( "%ld: l_subst", i );
+                l_subst( C_TMP, &M, B_REF[i] );
+                printf( ", u_subst" );
+                u_subst( X_TMP, &M, C_TMP );
+                for( size_t jj =0; jj < M.m; jj++ ) X_OUT[i][band.perm[jj]] =X_TMP[M.row_order[jj]];
+                double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+                printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+            }
+        }
+        band_free( &band );
+    } else if( OPT.solver == SOLVER_DIRECT && OPT.nd ) {
+        /* Reorder by nested dissection, then factor the reordered matrix */
+        const size_t orig_count =M.count;
+        indx_t* perm =nd_perm;
+        char how[32] ="from the plan";
+        if( !perm ) {
+            perm =(indx_t*)malloc( M.m * sizeof(indx_t) );
+            double time =omp_get_wtime();
+            nd_order( perm, &M, &nd );
+            snprintf( how, sizeof( how ), "in %.3f s", omp_get_wtime() - time );
+        }
+        matrix_permute_columns( &M, perm );
+        memcpy( M.row_order, perm, M.m * sizeof(indx_t) );
+        etree_t tree;
+        etree_compute( &tree, &M );
+        printf( "(i) Nested dissection %s: %ld separators with %ld vertices, top separator %ld, "
+                "elimination tree height %ld\n", how, nd.n_separators, nd.separator_size, nd.top_separator, tree.height );
+        etree_free( &tree );
+
+        printf( "Computing LUP: ...." );
+        if( lup( &M, NULL, OPT.checkpoint ? &checkpoint : NULL ) != 0 ) return -1;
+        printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)M.count/(double)orig_count, M.count, orig_count );
+
+        for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+            printf( "%ld: l_subst", i );
+            l_subst( C_TMP, &M, B_REF[i] );
+            printf( ", u_subst" );
+            u_subst( X_TMP, &M, C_TMP );
+            for( size_t jj =0; jj < M.m; jj++ ) X_OUT[i][perm[jj]] =X_TMP[M.row_order[jj]];
+            double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+            printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+        }
+        free( perm );
+    } else if( OPT.solver == SOLVER_DIRECT ) {
+        /* Perform LU factorization here */
+        const size_t orig_count =M.count;
+        if( (OPT.sparse_rhs || OPT.update || OPT.rhs) && !(A =matrix_dup( &M )) ) return -1;
+        heap_trace_t trace;
+        if( OPT.heap_trace && heap_trace_open( &trace, OPT.heap_trace, OPT.trace_interval ) != 0 ) return -1;
+        if( OPT.procs > 1 ) {
+            // The workers start here with a copy of this process, and leave
+            // after handing in their part of the factors
+            transport_t transport;
+            if( transport_socket_launch( &transport, OPT.procs ) != 0 ) return -1;
+            if( transport.rank == 0 ) printf( "Computing LUP on %d processes: ....", OPT.procs );
+            const int ret =lup_dist( &M, &transport );
+            const int rank =transport.rank;
+            if( transport.close( &transport ) != 0 || ret != 0 ) {
+                if( rank != 0 ) _exit( 1 );
+                return -1;
+            }
+            if( rank != 0 ) _exit( 0 );
+        } else {
+            printf( "Computing LUP: ...." );
+            const int ret =OPT.lookahead ? lup_lookahead( &M )
+                                         : lup( &M, OPT.heap_trace ? &trace : NULL, OPT.checkpoint ? &checkpoint : NULL );
+            if( ret != 0 ) return -1;
+        }
+        printf( "\b\b\b\bdone.\n(i) Fill-in ratio is %f (%ld KiB / %ld KiB)\n", 
+                (double)M.count/(double)orig_count, M.count, orig_count );
+        if( OPT.heap_trace ) {
+            const heap_stats_t& s =trace.last;
+            printf( "(i) Heap: %ld allocations, %ld defragmentations and %ld compaction steps moved %ld KiB "
+                    "in %.3f s, fragmentation %.3f, trace written to '%s'\n",
+                    s.counters.n_alloc, s.counters.n_defrag, s.counters.n_compact,
+                    (s.counters.moved * (sizeof(double) + sizeof(indx_t))) >> 10,
+                    s.counters.defrag_time + s.counters.compact_time, s.fragmentation, OPT.heap_trace );
+            heap_trace_close( &trace );
+        }
+
+        if( OPT.transpose ) {
+            for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+                printf( "%ld: ut_subst", i );
+                ut_subst( C_TMP, &M, B_REF[i] );
+                printf( ", lt_subst" );
+                lt_subst( X_OUT[i], &M, C_TMP );
+                double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+                printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+            }
+        } else {
+            for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+                printf( "%ld: l_subst", i );
+                l_subst( C_TMP, &M, B_REF[i] );
+                printf( ", u_subst" );
+                u_subst( X_OUT[i], &M, C_TMP );
+                //printf( "(i) c_%ld = ", i ); print_vec( C_TMP, M.m, M.row_order );
+                //printf( "(i) x_%ld = ", i ); print_vec( X_OUT[i], M.m, M.row_order );
+                double variance =compute_variance( X_OUT[i], X_REF[i], M.row_order, M.m );
+                printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+            }
+        }
+
+        if( OPT.rhs ) {
+            /* Solve the right-hand sides of the file a block at a time, writing
+               the solutions as they come */
+            rhs_reader_t rhs;
+            if( !rhs_open( &rhs, OPT.rhs ) ) return -1;
+            if( rhs.n_rows != M.m ) {
+                fprintf( stderr, "(e) '%s' has %ld rows, the matrix has %ld\n", OPT.rhs, rhs.n_rows, M.m );
+                return -1;
+            }
+            FILE* out =NULL;
+            if( OPT.out && !(out =create_array_file( OPT.out, M.m, rhs.n_cols )) ) return -1;
+
+            const size_t block =std::min( OPT.rhs_block, std::max( rhs.n_cols, (size_t)1 ) );
+            double* b =(double*)malloc( 3 * block * M.m * sizeof(double) );
+            double* x =b + block * M.m;
+            double* r =x + block * M.m;
+            size_t n_read, n_solved =0;
+            double max_resid =0.0;
+            printf( "Solving %ld right-hand sides: ....", rhs.n_cols );
+            while( true ) {
+                if( !rhs_read( &rhs, b, M.m, block, n_read ) ) return -1;
+                if( n_read == 0 ) break;
+                lu_solve_block( x, M.m, &M, b, M.m, n_read );
+                if( out && !write_array_columns( out, x, M.m, M.m, n_read ) ) return -1;
+
+                // Relative residuals |b - Ax| / |b| with the unmodified matrix
+                mult_matmat( r, M.m, A, x, M.m, n_read );
+                for( size_t v =0; v < n_read; v++ ) {
+                    double num =0.0, denom =0.0;
+                    for( size_t i =0; i < M.m; i++ ) {
+                        num += pow( b[v*M.m+i] - r[v*M.m+i], 2 );
+                        denom += pow( b[v*M.m+i], 2 );
+                    }
+                    max_resid =fmax( max_resid, denom > 0.0 ? sqrt( num / denom ) : sqrt( num ) );
+                }
+                n_solved += n_read;
+                printf( "\b\b\b\b%3d%%", (int)(100 * n_solved / rhs.n_cols) );
+                fflush( stdout );
+            }
+            printf( "\b\b\b\bdone.\n(i) %ld right-hand sides solved in blocks of %ld, max relative residual %.2e\n",
+                    n_solved, block, max_resid );
+            if( out && fclose( out ) != 0 ) {
+                perror( "fclose" );
+                return -1;
+            }
+            if( out ) printf( "(i) Solutions written to '%s'\n", OPT.out );
+            free( b );
+            rhs_close( &rhs );
+        }
+
+        if( OPT.sparse_rhs ) {
+            /* Columns of the inverse, spread over the matrix */
+            spsolve_t sp;
+            spsolve_init( &sp, &M );
+            indx_t* x_ind =(indx_t*)malloc( M.m * sizeof(indx_t) );
+            double* x_val =(double*)malloc( M.m * sizeof(double) );
+            size_t total_nnz =0;
+            double max_resid =0.0;
+            for( size_t q =0; q < OPT.sparse_rhs; q++ ) {
+                const indx_t col =(q * M.m) / OPT.sparse_rhs;
+                const double one =1.0;
+                const size_t nnz =spsolve( &sp, &col, &one, 1, x_ind, x_val );
+                total_nnz += nnz;
+
+                memset( X_TMP, 0, M.m * sizeof(double) );
+                for( size_t k =0; k < nnz; k++ ) X_TMP[x_ind[k]] =x_val[k];
+                mult_matvec( C_TMP, A, X_TMP );
+                C_TMP[col] -= 1.0;
+                for( size_t i =0; i < M.m; i++ ) max_resid =fmax( max_resid, fabs( C_TMP[i] ) );
+            }
+            printf( "(i) %ld columns of the inverse by sparse solves, %.1f non-zeroes on average, max residual %.2e\n",
+                    OPT.sparse_rhs, (double)total_nnz / OPT.sparse_rhs, max_resid );
+            free( x_ind );
+            free( x_val );
+            spsolve_free( &sp );
+        }
+
+        if( OPT.update ) {
+            /* Scale rows and columns of A by two, alternately, and solve again */
+            lowrank_t lr;
+            lowrank_init( &lr, A, &M, LOWRANK_MAX_UPDATES );
+            double values_tmp[M.m];
+            indx_t ind_tmp[M.m];
+            for( size_t q =0; q < OPT.update; q++ ) {
+                const indx_t r =(q * 7919 + 13) % M.m;
+                size_t len =0;
+                if( q % 2 == 0 ) {
+                    for( indx_t j =A->row_ptr_begin[r]; j <= A->row_ptr_end[r]; j++ ) {
+                        values_tmp[len] =2.0 * A->values[j];
+                        ind_tmp[len++] =A->col_ind[j];
+                    }
+                    if( lowrank_replace_row( &lr, r, values_tmp, ind_tmp, len ) != 0 ) return -1;
+                } else {
+                    for( size_t i =0; i < M.m; i++ )
+                        for( indx_t j =A->row_ptr_begin[i]; j <= A->row_ptr_end[i]; j++ )
+                            if( A->col_ind[j] == r ) {
+                                values_tmp[len] =2.0 * A->values[j];
+                                ind_tmp[len++] =i;
+                            }
+                    if( lowrank_replace_col( &lr, r, values_tmp, ind_tmp, len ) != 0 ) return -1;
+                }
+            }
+            printf( "(i) %ld rows/columns replaced, correction of rank %ld, %ld refactorisations\n",
+                    lr.n_updates, lr.k, lr.n_refactor );
+            for( size_t i =0; i < N_REF_VECTORS; i++ ) {
+                mult_matvec( B_REF[i], A, X_REF[i] );
+                printf( "%ld: lowrank_solve", i );
+                lowrank_solve( X_OUT[i], &lr, B_REF[i] );
+                double variance =compute_variance( X_OUT[i], X_REF[i], NULL, M.m );
+                printf( ", done. Variance(X_%ld): %2.3f\n", i, variance );
+            }
+            lowrank_free( &lr );
+        }
+    } else {
+        /* Preconditioned iterative solve, M is kept as is for the products.
+         * If the preconditioner is unstable or a solve does not converge, it
+         * is recomputed with a hundredth of the tolerance and four times the fill */
+        if( !(P =(matrix_t*)malloc( sizeof( matrix_t ) )) ) {
+            fprintf( stderr, "(e) Out of memory for the preconditioner.\n" );
+            return -1;
+        }
+        const char* name =OPT.solver == SOLVER_GMRES ? "gmres" : "bicgstab";
+        double tau =OPT.ilut_tol;
+        size_t fill =OPT.ilut_fill;
+        for( int attempt =0; ; attempt++ ) {
+            if( attempt > 0 ) {
+                tau /= 100.0;
+                fill *= 4;
+                printf( "(i) Retrying with --ilut-tol %g --ilut-fill %ld\n", tau, fill );
+            }
+            const bool last =attempt == ILUT_MAX_RETRIES;
+            matrix_copy( P, &M );
+            printf( "Computing ILUT: ...." );
+            ilut( P, tau, fill );
+            printf( "\b\b\b\bdone.\n(i) Preconditioner size is %f times nnz(A) (%ld KiB / %ld KiB)\n", 
+                    (double)P->count/(double)M.count, P->count, M.count );
+
+            const double condest =lu_condest( P );
+            if( !(condest < ILUT_MAX_CONDEST) ) {
+                if( !last ) {
+                    printf( "(i) ILUT preconditioner is unstable (condest %e)\n", condest );
+                    continue;
+                }
+                fprintf( stderr, "(e) ILUT preconditioner is unstable (condest %e), try a smaller --ilut-tol or a larger --ilut-fill.\n", condest );
+                return -1;
+            }
+
+            bool converged =true;
+            for( size_t i =0; i < N_REF_VECTORS && converged; i++ ) {
+                memset( X_OUT[i], 0, M.m * sizeof(double) );
+                krylov_t k =OPT.krylov;
+                int ret =OPT.solver == SOLVER_GMRES ? gmres( X_OUT[i], &M, P, B_REF[i], &k )
+                                                    : bicgstab( X_OUT[i], &M, P, B_REF[i], &k );
+                double variance =compute_variance( X_OUT[i], X_REF[i], M.row_order, M.m );
+                printf( "%ld: %s %s after %ld iterations (residual %.2e). Variance(X_%ld): %2.3f\n", 
+                        i, name, ret == 0 ? "converged" : "did not converge", k.iter, k.resid, i, variance );
+                converged =ret == 0 || last;
+            }
+            if( converged ) break;
+        }
+        free( P );
     }
 
     struct timespec end_time;